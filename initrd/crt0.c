@@ -0,0 +1,8 @@
+#include "syscall.h"
+
+int main(void);
+
+// the kernel enters here with an empty stack, there are no arguments yet
+__attribute__((force_align_arg_pointer, noreturn)) void _start(void) {
+    exit(main());
+}
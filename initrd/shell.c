@@ -1,5 +1,97 @@
-int main() {
-    unsigned syscall = 0x1234;
-    asm volatile("int $0x80" : "+a"(syscall));
-    return 0;
+#include "syscall.h"
+#include "time.h"
+
+#define LINE_MAX 128
+
+static unsigned length(const char *str) {
+    unsigned len = 0;
+    while (str[len])
+        len++;
+    return len;
+}
+
+static void print(const char *str) {
+    write(STDOUT_FILENO, str, length(str));
+}
+
+static int starts_with(const char *str, const char *prefix) {
+    while (*prefix)
+        if (*str++ != *prefix++)
+            return 0;
+    return 1;
+}
+
+static int equals(const char *a, const char *b) {
+    return starts_with(a, b) && a[length(b)] == '\0';
+}
+
+// reads a line without its newline, returns its length or -1 on error
+static int read_line(char *line, unsigned size) {
+    unsigned len = 0;
+    while (len < size - 1) {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) != 1)
+            return -1;
+        if (c == '\n')
+            break;
+        if (c == '\b') {
+            if (len > 0)
+                len--;
+            continue;
+        }
+        line[len++] = c;
+    }
+    line[len] = '\0';
+    return len;
+}
+
+static void print_uint(unsigned n) {
+    char buf[11];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    print(buf + i);
+}
+
+static void cat(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        print("cat: can't open ");
+        print(path);
+        print("\n");
+        return;
+    }
+    char buf[512];
+    int n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        write(STDOUT_FILENO, buf, n);
+    close(fd);
+}
+
+int main(void) {
+    char line[LINE_MAX];
+    while (1) {
+        print("$ ");
+        if (read_line(line, sizeof(line)) < 0)
+            return 1;
+
+        if (line[0] == '\0') {
+            continue;
+        } else if (equals(line, "exit")) {
+            return 0;
+        } else if (starts_with(line, "cat ")) {
+            cat(line + 4);
+        } else if (equals(line, "uptime")) {
+            print_uint(time_now_ms());
+            print(" ms\n");
+        } else if (starts_with(line, "echo ")) {
+            print(line + 5);
+            print("\n");
+        } else {
+            print("commands: cat PATH, echo TEXT, uptime, exit\n");
+        }
+    }
 }
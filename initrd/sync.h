@@ -0,0 +1,44 @@
+#pragma once
+
+#include "syscall.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+static inline int futex_wait(unsigned *uaddr, unsigned val) {
+    return syscall3(SYS_FUTEX, (unsigned)uaddr, FUTEX_WAIT, val);
+}
+
+static inline int futex_wake(unsigned *uaddr, unsigned nr_wake) {
+    return syscall3(SYS_FUTEX, (unsigned)uaddr, FUTEX_WAKE, nr_wake);
+}
+
+// futex based mutex, as in "Futexes Are Tricky" (Drepper)
+// 0 - unlocked, 1 - locked, 2 - locked with (possible) waiters
+// the kernel is only entered when the mutex is contended
+typedef struct {
+    unsigned state;
+} user_mutex;
+
+#define USER_MUTEX_INIT {0}
+
+static inline void user_mutex_lock(user_mutex *m) {
+    unsigned c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;  // fast path
+
+    if (c != 2)
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex_wait(&m->state, 2);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static inline void user_mutex_unlock(user_mutex *m) {
+    if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1) {
+        // there may be waiters
+        __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+        futex_wake(&m->state, 1);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// system calls, see kernel/syscalls/init.hpp
+#define SYS_EXIT 1
+#define SYS_READ 3
+#define SYS_WRITE 4
+#define SYS_OPEN 5
+#define SYS_CLOSE 6
+#define SYS_YIELD 158
+#define SYS_FUTEX 240
+
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR 2
+
+static inline int syscall3_int80(unsigned num, unsigned a, unsigned b, unsigned c) {
+    int ret;
+    asm volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(a), "c"(b), "d"(c) : "memory");
+    return ret;
+}
+
+// the kernel returns to edi with the stack pointer from ebp, and clobbers ecx and edx
+static inline int syscall3_sysenter(unsigned num, unsigned a, unsigned b, unsigned c) {
+    int ret;
+    asm volatile(
+        "push %%ebp          \n"
+        "mov %%esp, %%ebp    \n"
+        "mov $1f, %%edi      \n"
+        "sysenter            \n"
+        "1:                  \n"
+        "pop %%ebp           \n"
+        : "=a"(ret), "+c"(b), "+d"(c) : "a"(num), "b"(a) : "edi", "memory");
+    return ret;
+}
+
+// same check as the kernel makes before enabling sysenter
+static inline int has_sysenter(void) {
+    unsigned eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    if (!(edx & (1 << 11)))
+        return 0;
+    // the first Pentium Pros report SEP without implementing it
+    unsigned family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+static int sysenter_supported = -1;
+
+static inline int syscall3(unsigned num, unsigned a, unsigned b, unsigned c) {
+    if (__builtin_expect(sysenter_supported < 0, 0))
+        sysenter_supported = has_sysenter();
+    if (sysenter_supported)
+        return syscall3_sysenter(num, a, b, c);
+    return syscall3_int80(num, a, b, c);
+}
+
+__attribute__((noreturn)) static inline void exit(int status) {
+    syscall3(SYS_EXIT, status, 0, 0);
+    __builtin_unreachable();
+}
+
+static inline int read(int fd, void *buf, unsigned count) {
+    return syscall3(SYS_READ, fd, (unsigned)buf, count);
+}
+
+static inline int write(int fd, const void *buf, unsigned count) {
+    return syscall3(SYS_WRITE, fd, (unsigned)buf, count);
+}
+
+static inline int open(const char *path, int flags) {
+    return syscall3(SYS_OPEN, (unsigned)path, flags, 0);
+}
+
+static inline int close(int fd) {
+    return syscall3(SYS_CLOSE, fd, 0, 0);
+}
+
+static inline int yield(void) {
+    return syscall3(SYS_YIELD, 0, 0, 0);
+}
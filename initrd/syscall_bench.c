@@ -0,0 +1,56 @@
+#include "syscall.h"
+
+// times a system call that does nothing (an unknown number, answered with ENOSYS)
+// through int 0x80 and through sysenter
+#define NULL_SYSCALL 0xffff
+#define ITERATIONS 10000
+
+static inline unsigned long long rdtsc(void) {
+    unsigned low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((unsigned long long)high << 32) | low;
+}
+
+// cycles per call - the total fits in 32 bits, and there's no libgcc for 64-bit division
+static unsigned measure(int (*call)(unsigned, unsigned, unsigned, unsigned)) {
+    call(NULL_SYSCALL, 0, 0, 0);  // warm up
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        call(NULL_SYSCALL, 0, 0, 0);
+    return (unsigned)(rdtsc() - start) / ITERATIONS;
+}
+
+static void print(const char *str) {
+    unsigned len = 0;
+    while (str[len])
+        len++;
+    write(1, str, len);
+}
+
+static void print_uint(unsigned n) {
+    char buf[11];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    print(buf + i);
+}
+
+int main() {
+    unsigned int80 = measure(syscall3_int80);
+    print("int 0x80: ");
+    print_uint(int80);
+    print(" cycles per call\n");
+
+    if (!has_sysenter()) {
+        print("sysenter: not supported\n");
+        return 0;
+    }
+    unsigned sysenter = measure(syscall3_sysenter);
+    print("sysenter: ");
+    print_uint(sysenter);
+    print(" cycles per call\n");
+    return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// reading the clock without a system call, from the page the kernel maps read-only at TIME_PAGE_ADDR
+// the layout has to match kernel/clock/time_page.hpp
+#define TIME_PAGE_ADDR 0xBFFF0000
+
+struct time_page {
+    unsigned seq;  // odd while the kernel updates the page
+    unsigned uses_tsc;
+    unsigned mult;
+    unsigned shift;
+    unsigned long long tsc_base;
+    unsigned long long base_ns;
+    unsigned long long ns_per_tick;
+    unsigned ticks;
+};
+
+#define TIME_PAGE ((const volatile struct time_page *)TIME_PAGE_ADDR)
+
+static inline unsigned long long time_rdtsc(void) {
+    unsigned low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((unsigned long long)high << 32) | low;
+}
+
+// timer interrupts since boot, roughly 1000 per second
+static inline unsigned time_ticks(void) {
+    return TIME_PAGE->ticks;
+}
+
+// nanoseconds since boot, the same clock as the kernel's clock::now_ns
+static inline unsigned long long time_now_ns(void) {
+    const volatile struct time_page *page = TIME_PAGE;
+    unsigned seq, uses_tsc, mult, shift, ticks;
+    unsigned long long tsc_base, base_ns, ns_per_tick, tsc;
+    do {
+        seq = page->seq;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uses_tsc = page->uses_tsc;
+        mult = page->mult;
+        shift = page->shift;
+        tsc_base = page->tsc_base;
+        base_ns = page->base_ns;
+        ns_per_tick = page->ns_per_tick;
+        ticks = page->ticks;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != page->seq);
+
+    if (!uses_tsc)
+        return ticks * ns_per_tick;
+
+    // the 96 bit product of cycles and mult, shifted right - without libgcc
+    tsc = time_rdtsc() - tsc_base;
+    unsigned long long low = (unsigned long long)(unsigned)tsc * mult;
+    unsigned long long high = (unsigned long long)(unsigned)(tsc >> 32) * mult;
+    return base_ns + (high << (32 - shift)) + (low >> shift);
+}
+
+// milliseconds since boot, as 32 bits wrap after 49 days
+static inline unsigned time_now_ms(void) {
+    unsigned long long ns = time_now_ns();
+    unsigned high = (unsigned)(ns >> 32), low = (unsigned)ns, quotient;
+    // 64 by 32 bit division, the high half first so divl can't overflow
+    unsigned remainder = high % 1000000;
+    asm("divl %4" : "=a"(quotient), "=d"(remainder) : "a"(low), "d"(remainder), "rm"(1000000));
+    return quotient;
+}
@@ -0,0 +1,147 @@
+#include <kernel/clock/init.hpp>
+#include <kernel/clock/time_page.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/util/spinlock.hpp>
+#include <kernel/interrupts/pic.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/logging.hpp>
+
+// one timer tick
+static constexpr uint64_t NS_PER_TICK = static_cast<uint64_t>(interrupts::PIT_DIVISOR) * 1000000000 / interrupts::PIT_FREQUENCY;
+
+// measured in two halves, which have to agree
+static constexpr uint32_t CALIBRATION_TICKS = 50;
+static constexpr uint32_t MAX_CALIBRATION_DIFFERENCE = 20;  // 1/20 = 5%
+
+// ns = (cycles * ns_per_cycle_mult) >> MULT_SHIFT
+// 24 bits of fraction keep the multiplier in 32 bits down to a 4MHz TSC
+static constexpr uint32_t MULT_SHIFT = 24;
+static constexpr uint32_t MIN_TSC_KHZ = 4000;
+
+static bool tsc_reliable = false;   // global
+static uint32_t tsc_frequency_khz;  // global
+static uint32_t ns_per_cycle_mult;  // global
+static uint64_t tsc_base;           // global, TSC at base_ns
+static uint64_t base_ns;            // global
+
+// in the kernel image, so it exists before the first tick
+alignas(4096) static union {
+    clock::time_page page;
+    char bytes[4096];
+} shared_time;  // global, written under time_page_lock
+static spinlock time_page_lock;
+
+// writers make seq odd for the duration, readers retry if they see that or a change of seq
+static void time_page_write_begin() {
+    __atomic_store_n(&shared_time.page.seq, shared_time.page.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void time_page_write_end() {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&shared_time.page.seq, shared_time.page.seq + 1, __ATOMIC_RELAXED);
+}
+
+static void wait_ticks_from(uint32_t start, uint32_t n) {
+    while (scheduler::ticks() - start < n)
+        asm volatile("pause" ::: "memory");
+}
+
+void clock::initialize() {
+    {
+        scoped_spinlock lock {time_page_lock};
+        time_page_write_begin();
+        shared_time.page.ns_per_tick = NS_PER_TICK;
+        time_page_write_end();
+    }
+
+    if ((cpu::cpuid(1).edx & cpu::FEATURE_EDX_TSC) == 0) {
+        TINY_WARN("No TSC, the clock has tick resolution");
+        return;
+    }
+
+    // start right after a tick
+    uint32_t start = scheduler::ticks();
+    wait_ticks_from(start, 1);
+    start = scheduler::ticks();
+    uint64_t tsc_start = cpu::rdtsc();
+    wait_ticks_from(start, CALIBRATION_TICKS / 2);
+    uint64_t tsc_middle = cpu::rdtsc();
+    wait_ticks_from(start, CALIBRATION_TICKS);
+    uint64_t tsc_end = cpu::rdtsc();
+
+    // 32 bits of cycles are enough for over 40 GHz times half the calibration period
+    uint32_t first = static_cast<uint32_t>(tsc_middle - tsc_start);
+    uint32_t second = static_cast<uint32_t>(tsc_end - tsc_middle);
+    uint32_t difference = first > second ? first - second : second - first;
+    if (first == 0 || difference > first / MAX_CALIBRATION_DIFFERENCE) {
+        // the TSC rate changes, e.g. with frequency scaling
+        TINY_WARN("Unstable TSC (", first, " and ", second, " cycles), the clock has tick resolution");
+        return;
+    }
+
+    // cycles / (ticks * PIT_DIVISOR / PIT_FREQUENCY seconds) / 1000
+    uint32_t khz = static_cast<uint32_t>(div64_32((static_cast<uint64_t>(first) + second) * interrupts::PIT_FREQUENCY,
+                                                  CALIBRATION_TICKS * interrupts::PIT_DIVISOR * 1000));
+    if (khz < MIN_TSC_KHZ) {
+        TINY_WARN("TSC at ", khz, " kHz is too slow, the clock has tick resolution");
+        return;
+    }
+
+    tsc_frequency_khz = khz;
+    ns_per_cycle_mult = static_cast<uint32_t>(div64_32(static_cast<uint64_t>(1000000) << MULT_SHIFT, khz));
+    // continue where the tick based clock is
+    tsc_base = tsc_start;
+    base_ns = start * NS_PER_TICK;
+    asm volatile("" ::: "memory");
+    __atomic_store_n(&tsc_reliable, true, __ATOMIC_RELEASE);
+
+    {
+        scoped_spinlock lock {time_page_lock};
+        time_page_write_begin();
+        shared_time.page.mult = ns_per_cycle_mult;
+        shared_time.page.shift = MULT_SHIFT;
+        shared_time.page.tsc_base = tsc_base;
+        shared_time.page.base_ns = base_ns;
+        shared_time.page.uses_tsc = 1;
+        time_page_write_end();
+    }
+
+    bool invariant = (cpu::cpuid(0x80000000).eax >= 0x80000007) && (cpu::cpuid(0x80000007).edx & (1 << 8));
+    TINY_INFO("TSC at ", khz, " kHz", invariant ? ", invariant" : "");
+}
+
+uint64_t clock::cycles_to_ns(uint64_t cycles) {
+    // the 96 bit product, shifted right - in two 32x32 bit multiplications
+    uint64_t low = static_cast<uint64_t>(static_cast<uint32_t>(cycles)) * ns_per_cycle_mult;
+    uint64_t high = static_cast<uint64_t>(static_cast<uint32_t>(cycles >> 32)) * ns_per_cycle_mult;
+    return (high << (32 - MULT_SHIFT)) + (low >> MULT_SHIFT);
+}
+
+uint64_t clock::now_ns() {
+    if (__atomic_load_n(&tsc_reliable, __ATOMIC_ACQUIRE)) [[likely]] {
+        return base_ns + cycles_to_ns(cpu::rdtsc() - tsc_base);
+    }
+    return scheduler::ticks() * NS_PER_TICK;
+}
+
+bool clock::uses_tsc() {
+    return tsc_reliable;
+}
+
+uint32_t clock::tsc_khz() {
+    return tsc_frequency_khz;
+}
+
+void clock::map_time_page() {
+    memory::map_user_page(reinterpret_cast<void *>(TIME_PAGE_ADDR), memory::phys_t::from_kmem(&shared_time), false);
+}
+
+void clock::update_time_page_ticks(uint32_t ticks) {
+    kassert_is_interrupt;
+    scoped_spinlock lock {time_page_lock};
+    time_page_write_begin();
+    shared_time.page.ticks = ticks;
+    time_page_write_end();
+}
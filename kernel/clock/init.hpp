@@ -0,0 +1,18 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// monotonic time since boot
+// the TSC is calibrated against the PIT once - the CPUs' TSCs are assumed to be synchronized, as they are after reset
+namespace clock {
+    // call on the bootstrap processor after interrupts::start, while the PIT is still ticking (before smp::initialize)
+    void initialize();
+
+    // nanoseconds since boot, with cycle resolution if the TSC is reliable, otherwise with tick resolution
+    // before initialize, always from ticks
+    uint64_t now_ns();
+    bool uses_tsc();
+    // TSC frequency, 0 without a reliable TSC
+    uint32_t tsc_khz();
+    // convert a difference of TSC values, 0 without a reliable TSC
+    uint64_t cycles_to_ns(uint64_t cycles);
+}
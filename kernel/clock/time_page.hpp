@@ -0,0 +1,28 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// a page the kernel keeps the clock parameters in, mapped read-only into every user address space,
+// so userspace can read the time without a system call - see initrd/time.h, which has to match this layout
+//
+// the fields are protected by a sequence counter: the kernel makes seq odd while it writes, so a reader
+// copies the fields between two reads of an equal, even seq
+namespace clock {
+    constexpr reg_t TIME_PAGE_ADDR = 0xBFFF0000;
+
+    struct time_page {
+        uint32_t seq;
+        uint32_t uses_tsc;     // 0: time is ticks * ns_per_tick, 1: base_ns + ((TSC - tsc_base) * mult) >> shift
+        uint32_t mult;
+        uint32_t shift;
+        uint64_t tsc_base;
+        uint64_t base_ns;
+        uint64_t ns_per_tick;
+        uint32_t ticks;        // timer interrupts since boot, as scheduler::ticks
+    };
+    static_assert(sizeof(time_page) <= 4096);
+
+    // map the time page into the current address space, called by elf_loader::load_elf
+    void map_time_page();
+    // update the tick count, called from the timer interrupt on the bootstrap processor
+    void update_time_page_ticks(uint32_t ticks);
+}
@@ -0,0 +1,38 @@
+#include <kernel/devices/console.hpp>
+#include <kernel/devices/keyboard.hpp>
+#include <kernel/serial.hpp>
+#include <kernel/logging.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+
+static scheduler::concurrency::wait_queue console_wait_queue;  // global
+
+static bool has_input() {
+    return devices::keyboard::has_input() || serial::has_input();
+}
+
+void devices::console::wake() {
+    console_wait_queue.wake_one();
+}
+
+size_t devices::console::read(char *buf, size_t count) {
+    kassert_not_interrupt;
+    if (count == 0) return 0;
+
+    while (true) {
+        // readers are exclusive waiters - one typed character shouldn't wake up all of them
+        console_wait_queue.wait_until(has_input, true);
+
+        // one source per read, so the characters of a read are in the order they came in
+        size_t done = keyboard::try_read(buf, count);
+        if (done == 0)
+            done = serial::try_read(buf, count);
+        if (done == 0)
+            continue;  // another reader was faster
+
+        if (has_input()) {
+            // leftovers for another reader
+            console_wait_queue.wake_one();
+        }
+        return done;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// the input of the console, which is stdin - characters typed on the keyboard or received on the serial port,
+// so a headless machine can be driven over the serial line
+namespace devices::console {
+    // read up to count characters from whichever has input first
+    // blocks until at least one character is available, do NOT call from interrupt context
+    size_t read(char *buf, size_t count);
+
+    // called when the keyboard or the serial port has new input, may be called from interrupt context
+    void wake();
+}
@@ -1,12 +1,76 @@
 #include <kernel/util.hpp>
 #include <kernel/devices/keyboard.hpp>
+#include <kernel/devices/console.hpp>
 #include <kernel/tty.hpp>
 #include <kernel/logging.hpp>
 #include <kernel/util/lock.hpp>
+#include <kernel/interrupts/deferred.hpp>
+#include <kernel/interrupts/stats.hpp>
+#include <kernel/interrupts/profiler.hpp>
+#include <kernel/scheduler/workqueue.hpp>
+#include <kernel/scheduler/accounting.hpp>
+#include <kernel/scheduler/latency.hpp>
 
 // 128 bits of is_down
 static uint32_t is_down[4];  // global
 
+// typed characters waiting to be read from the console, ring buffer
+static constexpr size_t INPUT_BUF_SIZE = 256;
+static char input_buf[INPUT_BUF_SIZE];                         // global
+static size_t input_head;                                      // global, next index to read
+static size_t input_count;                                     // global
+static spinlock input_lock;                                    // global, guards the above and is_down
+
+// typed characters waiting to be echoed, ring buffer guarded by input_lock
+// writing to the screen is too slow for the interrupt handler, so it is deferred
+static constexpr size_t ECHO_BUF_SIZE = 64;
+static char echo_buf[ECHO_BUF_SIZE];                           // global
+static size_t echo_head;                                       // global, next index to echo
+static size_t echo_count;                                      // global
+
+static void echo_typed() {
+    while (true) {
+        // everything typed meanwhile in one write, which moves the cursor once
+        char echo[ECHO_BUF_SIZE];
+        size_t length = 0;
+        {
+            scoped_spinlock lock {input_lock};
+            if (echo_count == 0)
+                return;
+            while (echo_count != 0) {
+                echo[length++] = echo_buf[echo_head];
+                echo_head = (echo_head + 1) % ECHO_BUF_SIZE;
+                echo_count--;
+            }
+        }
+        tty::write(echo, length);
+    }
+}
+static interrupts::deferred_work echo_work {echo_typed};
+
+// F12 writes the kernel's statistics to the serial port, from a worker since it takes a while
+static constexpr unsigned char SCAN_CODE_F12 = 0x58;
+
+static void dump_stats(scheduler::work_item *) {
+    interrupts::dump_stats();
+    scheduler::dump_task_stats();
+    scheduler::latency::dump();
+}
+static scheduler::work_item dump_stats_work {dump_stats};
+
+// F11 starts the profiler, and the next F11 stops it and writes the samples to the serial port
+static constexpr unsigned char SCAN_CODE_F11 = 0x57;
+
+static void toggle_profiler(scheduler::work_item *) {
+    if (interrupts::profiler::is_running()) {
+        interrupts::profiler::stop();
+        interrupts::profiler::dump();
+    } else {
+        interrupts::profiler::start();
+    }
+}
+static scheduler::work_item toggle_profiler_work {toggle_profiler};
+
 char kbd_us[128] = {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b', '\t',
     'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n', 0,
@@ -17,7 +81,7 @@ char kbd_us[128] = {
 };
 
 void devices::keyboard::on_scan_code(unsigned char scan_code) {
-    scoped_intlock lock;
+    scoped_spinlock lock {input_lock};
 
     if (scan_code & 0x80) {
         // up event
@@ -26,6 +90,10 @@ void devices::keyboard::on_scan_code(unsigned char scan_code) {
     } else {
         // down event
         is_down[scan_code >> 5] |=  (1u << (scan_code & 0x1f));
+        if (scan_code == SCAN_CODE_F12)
+            scheduler::queue_work(dump_stats_work);
+        if (scan_code == SCAN_CODE_F11)
+            scheduler::queue_work(toggle_profiler_work);
 
         char us_char = kbd_us[scan_code];
         if (us_char != 0) {
@@ -34,7 +102,32 @@ void devices::keyboard::on_scan_code(unsigned char scan_code) {
                 us_char -= 32;
             }
 
-            tty::put(us_char);
+            if (echo_count < ECHO_BUF_SIZE) {
+                echo_buf[(echo_head + echo_count) % ECHO_BUF_SIZE] = us_char;
+                echo_count++;
+                interrupts::defer(echo_work);
+            }  // otherwise the echo is dropped
+
+            if (input_count < INPUT_BUF_SIZE) {
+                input_buf[(input_head + input_count) % INPUT_BUF_SIZE] = us_char;
+                input_count++;
+                devices::console::wake();
+            }  // otherwise the character is dropped
         }
     }
 }
+
+bool devices::keyboard::has_input() {
+    return __atomic_load_n(&input_count, __ATOMIC_RELAXED) != 0;
+}
+
+size_t devices::keyboard::try_read(char *buf, size_t count) {
+    scoped_spinlock lock {input_lock};
+    size_t i = 0;
+    while (i < count && input_count != 0) {
+        buf[i++] = input_buf[input_head];
+        input_head = (input_head + 1) % INPUT_BUF_SIZE;
+        input_count--;
+    }
+    return i;
+}
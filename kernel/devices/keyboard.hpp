@@ -1,5 +1,10 @@
 #pragma once
+#include <kernel/util.hpp>
 
 namespace devices::keyboard {
-    void on_scan_code(unsigned char scan_code);
+    void on_scan_code(unsigned char scan_code);  // called from interrupt context
+
+    // read up to count characters typed on the keyboard, without blocking - devices::console::read waits for them
+    size_t try_read(char *buf, size_t count);
+    bool has_input();
 }
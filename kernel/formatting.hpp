@@ -35,7 +35,50 @@ namespace formatting {
         inline explicit color_pair(color fg, color bg) : fg{fg}, bg{bg} {}
     };
 
-    template <void F(char c), void G(color_pair set_color)>
+    inline const char *errno_name(errno e) {
+        switch (e) {
+            case errno::ok:
+                return "errno::ok";
+            case errno::not_permitted:
+                return "errno::not_permitted";
+            case errno::no_entry:
+                return "errno::no_entry";
+            case errno::no_process:
+                return "errno::no_process";
+            case errno::interrupted:
+                return "errno::interrupted";
+            case errno::io_error:
+                return "errno::io_error";
+            case errno::bad_fd:
+                return "errno::bad_fd";
+            case errno::again:
+                return "errno::again";
+            case errno::no_memory:
+                return "errno::no_memory";
+            case errno::no_access:
+                return "errno::no_access";
+            case errno::fault:
+                return "errno::fault";
+            case errno::exists:
+                return "errno::exists";
+            case errno::not_dir:
+                return "errno::not_dir";
+            case errno::is_dir:
+                return "errno::is_dir";
+            case errno::invalid:
+                return "errno::invalid";
+            case errno::too_many_files:
+                return "errno::too_many_files";
+            case errno::no_syscall:
+                return "errno::no_syscall";
+            case errno::path_too_long:
+                return "errno::path_too_long";
+        }
+        return "errno::?";
+    }
+
+    // W writes a whole string at once, if the output has a faster way than F for every character
+    template <void F(char c), void G(color_pair set_color), void (*W)(const char *s, size_t length) = nullptr>
     struct log_driver {
     private:
         static inline void _write(char c) {
@@ -43,8 +86,12 @@ namespace formatting {
         }
 
         static inline void _write(const string_buf &s) {
-            for (size_t i = 0; i < s.length; i++) {
-                write(s.data[i]);
+            if constexpr (W != nullptr) {
+                W(s.data, s.length);
+            } else {
+                for (size_t i = 0; i < s.length; i++) {
+                    write(s.data[i]);
+                }
             }
         }
 
@@ -67,45 +114,8 @@ namespace formatting {
             G(set_color);
         }
 
-        static void _write(errno e) {
-            switch (e) {
-                case errno::ok:
-                    _write("errno::ok");
-                    break;
-                case errno::not_permitted:
-                    _write("errno::not_permitted");
-                    break;
-                case errno::no_entry:
-                    _write("errno::no_entry");
-                    break;
-                case errno::no_process:
-                    _write("errno::no_process");
-                    break;
-                case errno::interrupted:
-                    _write("errno::interrupted");
-                    break;
-                case errno::io_error:
-                    _write("errno::io_error");
-                    break;
-                case errno::no_memory:
-                    _write("errno::no_memory");
-                    break;
-                case errno::no_access:
-                    _write("errno::no_access");
-                    break;
-                case errno::exists:
-                    _write("errno::exists");
-                    break;
-                case errno::not_dir:
-                    _write("errno::not_dir");
-                    break;
-                case errno::is_dir:
-                    _write("errno::is_dir");
-                    break;
-                case errno::path_too_long:
-                    _write("errno::path_too_long");
-                    break;
-            }
+        static inline void _write(errno e) {
+            write(errno_name(e));
         }
 
     public:
@@ -0,0 +1,41 @@
+#include <kernel/fs/fd_table.hpp>
+#include <kernel/fs/vfs.hpp>
+
+using namespace fs;
+
+int fd_table::install(file_desc *f) {
+    for (int fd = FIRST_FD; fd < MAX_FILES; fd++) {
+        if (m_files[fd] == nullptr) {
+            m_files[fd] = f;
+            return fd;
+        }
+    }
+    return static_cast<int>(errno::too_many_files);
+}
+
+file_desc *fd_table::get(int fd) {
+    if (fd < FIRST_FD || fd >= MAX_FILES)
+        return nullptr;
+    return m_files[fd];
+}
+
+errno fd_table::close(int fd) {
+    file_desc *f = get(fd);
+    if (f == nullptr)
+        return errno::bad_fd;
+    m_files[fd] = nullptr;
+    file_desc::release(f);
+    return errno::ok;
+}
+
+void fd_table::close_all() {
+    for (int fd = FIRST_FD; fd < MAX_FILES; fd++) {
+        if (m_files[fd] != nullptr)
+            close(fd);
+    }
+}
+
+fd_table::~fd_table() {
+    for (int fd = 0; fd < MAX_FILES; fd++)
+        kassert(m_files[fd] == nullptr);
+}
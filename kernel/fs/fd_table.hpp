@@ -0,0 +1,30 @@
+#pragma once
+#include <kernel/util.hpp>
+
+namespace fs {
+    struct file_desc;
+
+    constexpr int MAX_FILES = 32;
+
+    // the open files of a task, indexed by file descriptor
+    // only the task itself uses its table, so there is no lock
+    struct fd_table {
+        // 0, 1 and 2 are the console (see syscalls/files.hpp), files get the descriptors after them
+        static constexpr int FIRST_FD = 3;
+
+        // takes over the reference to f, returns the lowest free descriptor or errno::too_many_files
+        int install(file_desc *f);
+        // the open file of a descriptor, or nullptr - the reference stays with the table
+        file_desc *get(int fd);
+        errno close(int fd);
+        // close everything, when the task exits
+        void close_all();
+
+        inline fd_table() : m_files{} {}
+        // all files must be closed while the task still runs, releasing one may block
+        ~fd_table();
+
+    private:
+        file_desc *m_files[MAX_FILES];
+    };
+}
@@ -0,0 +1,188 @@
+#include <kernel/fs/procfs.hpp>
+#include <kernel/klog.hpp>
+#include <kernel/serial.hpp>
+#include <kernel/logging.hpp>
+using namespace fs;
+
+// the root directory, then a fixed inode number for every file
+static constexpr uint32_t DMESG_INODE = 3;
+static constexpr uint32_t TTYS0_INODE = 3;
+
+struct proc_file {
+    const char *name;
+    uint32_t i_num;
+    bool is_device;  // a character device, which can be written, else a read-only file
+    ssize_t (*read)(file_desc *self, char *buf, size_t count, uint64_t pos);
+    ssize_t (*write)(file_desc *self, char *buf, size_t count, uint64_t pos);
+};
+
+static ssize_t proc_write(file_desc *, char *, size_t, uint64_t) {
+    return static_cast<ssize_t>(errno::not_permitted);
+}
+
+static ssize_t dmesg_read(file_desc *, char *buf, size_t count, uint64_t pos) {
+    return klog::read_text(buf, count, pos);
+}
+
+static const proc_file proc_files[] = {
+    {"dmesg", DMESG_INODE, false, dmesg_read, proc_write},
+};
+
+// character devices have no position
+static ssize_t ttyS0_read(file_desc *, char *buf, size_t count, uint64_t) {
+    return static_cast<ssize_t>(serial::read(buf, count));
+}
+
+static ssize_t ttyS0_write(file_desc *, char *buf, size_t count, uint64_t) {
+    for (size_t i = 0; i < count; i++)
+        serial::put(buf[i]);
+    return static_cast<ssize_t>(count);
+}
+
+static const proc_file dev_files[] = {
+    {"ttyS0", TTYS0_INODE, true, ttyS0_read, ttyS0_write},
+};
+
+struct vfs_proc : public vfs {
+    const proc_file *m_files;
+    size_t m_num_files;
+
+    const proc_file *find_file(uint32_t i_num);
+    inline vfs_proc(const proc_file *files, size_t num_files) : m_files(files), m_num_files(num_files) {}
+
+    virtual inode *alloc_root_inode_struct() override;
+    virtual inode *alloc_inode_struct(uint32_t, inode *) override;
+    virtual void free_inode_struct(inode *) override;
+    virtual void read_inode_disk(inode *) override;
+    virtual void write_inode_disk(inode *) override;
+    virtual void delete_inode_disk(inode *) override;
+};
+
+struct inode_proc : public inode {
+    virtual errno lookup(string_buf name, uint32_t &found_i) override;
+    virtual errno create(string_buf name, uint16_t mode, uint32_t &new_i) override;
+    virtual errno unlink(string_buf name) override;
+    virtual void set_file_methods(file_desc *) override;
+
+    const proc_file *m_file;  // nullptr for the root directory
+
+    inode_proc(vfs *owner, inode *parent_ref);
+    ~inode_proc();
+};
+
+// untyped, so that only the allocation itself is done under the lock, like the tar inodes
+static memory::untyped_slab_allocator<sizeof(inode_proc)> inode_alloc;
+static spinlock inode_alloc_lock;
+
+static inode_proc *new_inode_proc(vfs *owner, inode *parent_ref) {
+    void *ptr;
+    {
+        scoped_spinlock lock {inode_alloc_lock};
+        ptr = inode_alloc.allocate();
+    }
+    return new (ptr) inode_proc(owner, parent_ref);
+}
+
+
+// vfs definitions
+
+
+const proc_file *vfs_proc::find_file(uint32_t i_num) {
+    for (size_t i = 0; i < m_num_files; i++) {
+        if (m_files[i].i_num == i_num)
+            return &m_files[i];
+    }
+    return nullptr;
+}
+
+inode *vfs_proc::alloc_root_inode_struct() {
+    inode_proc *result = new_inode_proc(this, nullptr);
+    result->i_num = root_inode;
+    result->i_mode = S_IFDIR | S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+    return result;
+}
+
+inode *vfs_proc::alloc_inode_struct(uint32_t i_num, inode *parent_ref) {
+    inode_proc *result = new_inode_proc(this, parent_ref);
+    result->i_num = i_num;
+    return result;
+}
+
+void vfs_proc::free_inode_struct(inode *node) {
+    inode_proc *cast_node = static_cast<inode_proc *>(node);
+    cast_node->~inode_proc();
+    scoped_spinlock lock {inode_alloc_lock};
+    inode_alloc.free(cast_node);
+}
+
+void vfs_proc::read_inode_disk(inode *node) {
+    inode_proc *cast_node = static_cast<inode_proc *>(node);
+    cast_node->m_file = find_file(node->i_num);
+    kassert(cast_node->m_file != nullptr);
+    if (cast_node->m_file->is_device)
+        node->i_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    else
+        node->i_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+    node->i_size = 0;  // unknown until read
+}
+
+void vfs_proc::write_inode_disk(inode *) {}
+
+void vfs_proc::delete_inode_disk(inode *) {
+    kpanic("procfs and devfs files can't be deleted");
+}
+
+
+// inode definitions
+
+
+inode_proc::inode_proc(vfs *owner, inode *parent) : inode(owner, parent), m_file(nullptr) {
+    take_parent_struct(this);
+}
+inode_proc::~inode_proc() {
+    release_parent_struct(this);
+}
+
+errno inode_proc::lookup(string_buf name, uint32_t &found_i) {
+    if (m_file != nullptr)
+        return errno::not_dir;
+    vfs_proc *fs = static_cast<vfs_proc *>(owner_fs);
+    for (size_t i = 0; i < fs->m_num_files; i++) {
+        const proc_file &f = fs->m_files[i];
+        if (strlen(f.name) == name.length && !memcmp(f.name, name.data, name.length)) {
+            found_i = f.i_num;
+            return errno::ok;
+        }
+    }
+    return errno::no_entry;
+}
+
+errno inode_proc::create(string_buf, uint16_t, uint32_t &) {
+    return errno::not_permitted;
+}
+
+errno inode_proc::unlink(string_buf) {
+    return errno::not_permitted;
+}
+
+static ssize_t proc_read_dir(file_desc *, char *, size_t, uint64_t) {
+    return static_cast<ssize_t>(errno::is_dir);
+}
+
+void inode_proc::set_file_methods(file_desc *f) {
+    f->f_read = m_file != nullptr ? m_file->read : proc_read_dir;
+    f->f_write = m_file != nullptr ? m_file->write : proc_write;
+}
+
+static char static_procfs_allocation[sizeof(vfs_proc)];
+static char static_devfs_allocation[sizeof(vfs_proc)];
+
+void fs::register_procfs(string_buf path) {
+    vfs_proc *fs = new (static_procfs_allocation) vfs_proc(proc_files, sizeof(proc_files) / sizeof(proc_files[0]));
+    fs::mount(path, fs);
+}
+
+void fs::register_devfs(string_buf path) {
+    vfs_proc *fs = new (static_devfs_allocation) vfs_proc(dev_files, sizeof(dev_files) / sizeof(dev_files[0]));
+    fs::mount(path, fs);
+}
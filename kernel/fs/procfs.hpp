@@ -0,0 +1,12 @@
+#pragma once
+#include <kernel/fs/vfs.hpp>
+
+namespace fs {
+    // a directory of read-only files the kernel generates when they are read:
+    //   dmesg - the kernel log as text, see klog::read_text
+    void register_procfs(string_buf path);
+
+    // the same for devices:
+    //   ttyS0 - COM1, reads block until characters are received, see serial::read
+    void register_devfs(string_buf path);
+}
@@ -109,7 +109,18 @@ struct inode_tar : public inode {
     ~inode_tar();
 };
 
-static memory::slab_allocator<inode_tar> inode_alloc;
+// untyped, so that only the allocation itself is done under the lock - constructing and destructing inodes may block
+static memory::untyped_slab_allocator<sizeof(inode_tar)> inode_alloc;
+static spinlock inode_alloc_lock;
+
+static inode_tar *new_inode_tar(vfs *owner, inode *parent_ref) {
+    void *ptr;
+    {
+        scoped_spinlock lock {inode_alloc_lock};
+        ptr = inode_alloc.allocate();
+    }
+    return new (ptr) inode_tar(owner, parent_ref);
+}
 
 
 // vfs definitiions
@@ -119,19 +130,22 @@ vfs_tar::vfs_tar(char *archive) : m_archive(archive) {}
 vfs_tar::~vfs_tar() {}
 
 inode *vfs_tar::alloc_root_inode_struct() {
-    inode *result = inode_alloc.allocate(this, nullptr);
+    inode *result = new_inode_tar(this, nullptr);
     result->i_num = root_inode;
     return result;
 }
 
 inode *vfs_tar::alloc_inode_struct(uint32_t i_num, inode *parent_ref) {
-    inode *result = inode_alloc.allocate(this, parent_ref);
+    inode *result = new_inode_tar(this, parent_ref);
     result->i_num = i_num;
     return result;
 }
 
 void vfs_tar::free_inode_struct(inode *node) {
-    inode_alloc.free(static_cast<inode_tar *>(node));
+    inode_tar *cast_node = static_cast<inode_tar *>(node);
+    cast_node->~inode_tar();
+    scoped_spinlock lock {inode_alloc_lock};
+    inode_alloc.free(cast_node);
 }
 
 void vfs_tar::read_inode_disk(inode *node) {
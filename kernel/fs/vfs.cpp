@@ -4,18 +4,21 @@
 #include <kernel/util/string.hpp>
 #include <kernel/util/ds/list.hpp>
 #include <kernel/util/ds/hashtable.hpp>
+#include <kernel/scheduler/rcu.hpp>
 #include <kernel/logging.hpp>
 using namespace fs;
 
 memory::untyped_slab_allocator<PATH_NAME_MAX> path_name_alloc;
 
 // mount points are implemented as a linked list of path names we have to compare to
-struct mount_point : ds::intrusive_doubly_linked_node<mount_point> {
+// the list is read under RCU, so path walks don't lock anything to find their mount point
+struct mount_point {
+    mount_point *m_next;
     char m_path[PATH_NAME_MAX];
     size_t m_path_length;
     vfs *m_fs;
 
-    inline mount_point(string_buf path, vfs *fs) : m_fs(fs) {
+    inline mount_point(string_buf path, vfs *fs) : m_next(nullptr), m_fs(fs) {
         kassert(path.length < PATH_NAME_MAX);
         kassert(path.length != 0);
         kassert(path.length == 1 || (path.data[path.length - 1] != '/'));  // must not end with slash
@@ -27,6 +30,7 @@ struct mount_point : ds::intrusive_doubly_linked_node<mount_point> {
 
 static memory::slab_allocator<mount_point> mount_point_alloc;
 static mount_point *first_mount_point = nullptr;
+static scheduler::concurrency::mutex mount_lock;  // held by writers of the mount point list
 
 static ssize_t default_f_read(file_desc *, char *, size_t, uint64_t) {
     kpanic("file read not defined");
@@ -57,7 +61,11 @@ ssize_t file_desc::pread(char *buf, size_t count, uint64_t pos) {
 }
 
 ssize_t file_desc::write(char *buf, size_t count) {
-    return this->f_write(this, buf, count, f_pos);
+    ssize_t res = this->f_write(this, buf, count, f_pos);
+    if (res >= 0)
+        f_pos += res;
+
+    return res;
 }
 
 ssize_t file_desc::pwrite(char *buf, size_t count, uint64_t pos) {
@@ -74,14 +82,16 @@ void fs::mount(string_buf canonical_path, vfs *fs) {
     fs->__hashtable = memory::kmem_alloc_4k();
     ds::hashtable<256> *ht = new (fs->__hashtable) ds::hashtable<256>();  // placement new - call constructor
 
-    ht->insert(fs->root_inode, fs->alloc_root_inode_struct());
+    {
+        scoped_write_lock lock { fs->__hashtable_lock };
+        ht->insert(fs->root_inode, fs->alloc_root_inode_struct());
+    }
 
-    // put in mount point linked list
+    // put in mount point linked list - fully initialized before it is published to readers
+    scoped_mutex lock { mount_lock };
     mount_point *m = mount_point_alloc.allocate(canonical_path, fs);
-    if (first_mount_point == nullptr)
-        first_mount_point = m;
-    else
-        first_mount_point->add_after_self(m);
+    m->m_next = first_mount_point;
+    scheduler::rcu::assign_pointer(first_mount_point, m);
 }
 
 // virtual filesystem operations
@@ -91,8 +101,21 @@ void fs::mount(string_buf canonical_path, vfs *fs) {
 static inode *get_inode_struct(vfs *fs, uint32_t i_num, inode *parent) {
     ds::hashtable<256> *ht = reinterpret_cast<ds::hashtable<256> *>(fs->__hashtable);
 
-    inode *result = reinterpret_cast<inode *>(ht->lookup(i_num));
+    {
+        // common case - concurrent lookups
+        scoped_read_lock lock { fs->__hashtable_lock };
+        inode *result = reinterpret_cast<inode *>(ht->lookup(i_num));
+        if (result != nullptr) {
+            kassert(i_num == result->i_num);
+            // can't be released meanwhile, releasing needs the write lock
+            result->take_ref_locked();
+            return result;
+        }
+    }
 
+    scoped_write_lock lock { fs->__hashtable_lock };
+    // somebody may have inserted it after we released the read lock
+    inode *result = reinterpret_cast<inode *>(ht->lookup(i_num));
     if (result != nullptr) {
         kassert(i_num == result->i_num);
         result->take_ref_locked();
@@ -107,9 +130,17 @@ static inode *get_inode_struct(vfs *fs, uint32_t i_num, inode *parent) {
 }
 
 void fs::inode::release(inode *obj) {
-    if (obj->release_ref_locked()) {
-        ds::hashtable<256> *ht = reinterpret_cast<ds::hashtable<256> *>(obj->owner_fs->__hashtable);
-        ht->remove(obj->i_num);
+    bool last_ref;
+    {
+        scoped_write_lock lock { obj->owner_fs->__hashtable_lock };
+        last_ref = obj->release_ref_locked();
+        if (last_ref) {
+            ds::hashtable<256> *ht = reinterpret_cast<ds::hashtable<256> *>(obj->owner_fs->__hashtable);
+            ht->remove(obj->i_num);
+        }
+    }
+    // outside of the lock - freeing releases the parent inode too
+    if (last_ref) {
         obj->owner_fs->free_inode_struct(obj);
     }
 }
@@ -123,33 +154,30 @@ void fs::release_parent_struct(inode *i) {
 }
 
 errno fs::traverse(string_buf path, inode *&result) {
-    // no preemption during fs traverse
-    scoped_preemptlock lock;
+    // preemption is allowed during fs traverse - the lookups can be long
 
     if (path.length == 0) return errno::no_entry;
 
-    if (first_mount_point == nullptr) {
-        return errno::no_entry;
-    }
-
     // TODO TODO TODO make mount point list sorted by length so this will be faster
     // step 1. find longest matching mount point
     mount_point *best_mnt = nullptr;
     size_t best_mnt_path_length = 0;
+    vfs *fs;
 
-    for (mount_point &mnt : *first_mount_point) {
-        if ((mnt.m_path_length <= best_mnt_path_length) || (mnt.m_path_length > path.length)) {
+    scheduler::rcu::read_lock();
+    for (mount_point *mnt = scheduler::rcu::dereference(first_mount_point); mnt != nullptr; mnt = scheduler::rcu::dereference(mnt->m_next)) {
+        if ((mnt->m_path_length <= best_mnt_path_length) || (mnt->m_path_length > path.length)) {
             continue;  // can't be a better match or can't match since it is longer than path itself
         }
-        // now guaranteed: path.length >= mnt.m_path_length
+        // now guaranteed: path.length >= mnt->m_path_length
 
-        if (!(mnt.m_path_length == 1 || path.length == mnt.m_path_length || path.data[mnt.m_path_length] == '/')) {
+        if (!(mnt->m_path_length == 1 || path.length == mnt->m_path_length || path.data[mnt->m_path_length] == '/')) {
             continue;  // needed: either no trailing slash or after the mount's length there's a slash, or mnt is root so it always matches
         }
 
         bool match = true;
-        for (size_t i = 0; i < mnt.m_path_length; i++) {
-            if (mnt.m_path[i] != path.data[i]) {
+        for (size_t i = 0; i < mnt->m_path_length; i++) {
+            if (mnt->m_path[i] != path.data[i]) {
                 match = false;
                 break;
             }
@@ -158,21 +186,27 @@ errno fs::traverse(string_buf path, inode *&result) {
 
         // found a match: all the characters until the mount's length match
         // and after the exact mount name there is either nothing or /
-        best_mnt = &mnt;
+        best_mnt = mnt;
         best_mnt_path_length = best_mnt->m_path_length;  // used to avoid dereferencing null cheaply
     }
 
     if (best_mnt == nullptr) {
+        scheduler::rcu::read_unlock();
         return errno::no_entry;
     }
 
     // found mount point, start traversal
-    vfs *fs = best_mnt->m_fs;
+    fs = best_mnt->m_fs;
+    scheduler::rcu::read_unlock();
     ds::hashtable<256> *ht = reinterpret_cast<ds::hashtable<256> *>(fs->__hashtable);
 
-    // start from root inode
+    // start from root inode - always in the hash table, without references
     uint32_t root_inode_num = fs->root_inode;
-    inode *curr_inode = reinterpret_cast<inode *>(ht->lookup(root_inode_num));
+    inode *curr_inode;
+    {
+        scoped_read_lock lock { fs->__hashtable_lock };
+        curr_inode = reinterpret_cast<inode *>(ht->lookup(root_inode_num));
+    }
     kassert(curr_inode != nullptr);
 
     // destructively parse path and traverse inodes
@@ -3,6 +3,7 @@
 #include <kernel/util/string.hpp>
 #include <kernel/memory/slab.hpp>
 #include <kernel/scheduler/mutex.hpp>
+#include <kernel/scheduler/rwlock.hpp>
 #include <kernel/util/ds/refcount.hpp>
 
 namespace fs {
@@ -47,6 +48,7 @@ namespace fs {
     struct inode {
     public:
         // lock needed to decrease refcount, and change the inode itself
+        // adaptive, because it is mostly held for a few instructions to change the refcount
         scheduler::concurrency::mutex i_lock;
 
     private:
@@ -103,7 +105,8 @@ namespace fs {
 
     protected:
         // do not call constructor directly
-        inline inode(vfs *owner, inode *parent) : owner_fs(owner), i_parent_ref(parent) {}
+        // with the reference of whoever allocates it
+        inline inode(vfs *owner, inode *parent) : i_lock(true), i_rc(1), owner_fs(owner), i_parent_ref(parent) {}
         // some destructing work is done by release()
         inline ~inode() {};
     };
@@ -154,6 +157,8 @@ namespace fs {
 
         // used internally to map inode number to inode struct
         void *__hashtable;
+        // protects __hashtable - lookups are readers, inserting and releasing inodes are writers
+        scheduler::concurrency::rwlock __hashtable_lock;
         uint32_t root_inode;
         inline vfs() : root_inode(2) {}
 
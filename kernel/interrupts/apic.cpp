@@ -0,0 +1,168 @@
+#include <kernel/interrupts/apic.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/smp/percpu.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/util/lock.hpp>
+#include <kernel/logging.hpp>
+
+static volatile uint32_t *lapic_regs = nullptr;
+
+static constexpr uint32_t SVR_ENABLE = 1 << 8;
+static constexpr uint32_t ICR_DELIVERY_INIT = 0b101 << 8;
+static constexpr uint32_t ICR_DELIVERY_STARTUP = 0b110 << 8;
+static constexpr uint32_t ICR_SEND_PENDING = 1 << 12;
+static constexpr uint32_t ICR_LEVEL_ASSERT = 1 << 14;
+static constexpr uint32_t ICR_ALL_BUT_SELF = 0b11 << 18;
+
+static constexpr uint32_t LVT_MASKED = 1 << 16;
+static constexpr uint32_t LVT_TIMER_ONE_SHOT = 0b00 << 17;
+static constexpr uint32_t LVT_TIMER_TSC_DEADLINE = 0b10 << 17;
+static constexpr uint32_t TIMER_DIVIDE_16 = 0b0011;
+static constexpr uint32_t MSR_TSC_DEADLINE = 0x6E0;
+
+// measured over this many PIT ticks
+static constexpr uint32_t CALIBRATION_TICKS = 20;
+
+// timer counts (after dividing by 16) and TSC cycles per tick, the same on every CPU
+static uint32_t timer_counts_per_tick = 0;
+static uint32_t timer_tsc_per_tick = 0;
+static bool tsc_deadline = false;
+
+void interrupts::apic::map(memory::phys_t lapic_phys) {
+    kassert(lapic_regs == nullptr);
+    lapic_regs = static_cast<volatile uint32_t *>(memory::map_mmio_page(lapic_phys));
+}
+
+bool interrupts::apic::is_mapped() {
+    return lapic_regs != nullptr;
+}
+
+uint32_t interrupts::apic::read(uint reg) {
+    return lapic_regs[reg / 4];
+}
+
+void interrupts::apic::write(uint reg, uint32_t value) {
+    lapic_regs[reg / 4] = value;
+}
+
+static void spurious_interrupt_handler(interrupts::interrupt_args &) {
+    // nothing to do, and no EOI for spurious interrupts
+}
+
+void interrupts::apic::enable() {
+    kassert(lapic_regs != nullptr);
+    register_handler(SPURIOUS_VECTOR, spurious_interrupt_handler);
+    write(REG_TPR, 0);  // accept all interrupts
+    write(REG_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+}
+
+uint8_t interrupts::apic::id() {
+    return read(REG_ID) >> 24;
+}
+
+void interrupts::apic::end_of_interrupt() {
+    write(REG_EOI, 0);
+}
+
+static void send_ipi(uint8_t apic_id, uint32_t command) {
+    using namespace interrupts::apic;
+    write(REG_ESR, 0);
+    write(REG_ICR_HIGH, static_cast<uint32_t>(apic_id) << 24);
+    write(REG_ICR_LOW, command);  // writing the low half sends it
+    while (read(REG_ICR_LOW) & ICR_SEND_PENDING)
+        asm volatile("pause" ::: "memory");
+}
+
+void interrupts::apic::send_init(uint8_t apic_id) {
+    send_ipi(apic_id, ICR_DELIVERY_INIT | ICR_LEVEL_ASSERT);
+}
+
+void interrupts::apic::send_startup(uint8_t apic_id, memory::phys_t start) {
+    // the AP starts in real mode at start, which must be page aligned and below 1MB
+    kassert((start.value() & 0xFFF) == 0 && start.value() < 0x100000);
+    send_ipi(apic_id, ICR_DELIVERY_STARTUP | ICR_LEVEL_ASSERT | (start.value() >> 12));
+}
+
+void interrupts::apic::send_ipi_others(uint vector) {
+    kassert(vector >= 0x20 && vector < 0x100);
+    // the destination field is ignored with a shorthand
+    send_ipi(0, ICR_ALL_BUT_SELF | ICR_LEVEL_ASSERT | vector);
+}
+
+// the next tick is one period after the previous deadline, not after the interrupt was handled, so ticks don't drift
+static void arm_timer() {
+    using namespace interrupts::apic;
+    if (tsc_deadline) {
+        smp::percpu *local = smp::this_cpu();
+        uint64_t now = cpu::rdtsc();
+        local->timer_deadline += timer_tsc_per_tick;
+        if (local->timer_deadline <= now)
+            local->timer_deadline = now + timer_tsc_per_tick;  // fell behind, e.g. interrupts were disabled for long
+        cpu::wrmsr(MSR_TSC_DEADLINE, local->timer_deadline);
+    } else {
+        write(REG_TIMER_INITIAL, timer_counts_per_tick);
+    }
+}
+
+static void timer_interrupt_handler(interrupts::interrupt_args &args) {
+    arm_timer();
+    interrupts::apic::end_of_interrupt();
+    scheduler::timeslice_passed(args);  // NOTE: might not return
+}
+
+void interrupts::apic::calibrate_timer() {
+    kassert(lapic_regs != nullptr && timer_counts_per_tick == 0);
+    write(REG_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    write(REG_LVT_TIMER, LVT_MASKED | LVT_TIMER_ONE_SHOT | TIMER_VECTOR);
+
+    // start right after a tick
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() == start)
+        asm volatile("pause" ::: "memory");
+    start = scheduler::ticks();
+    uint64_t tsc_start = cpu::rdtsc();
+    write(REG_TIMER_INITIAL, 0xFFFFFFFF);
+
+    while (scheduler::ticks() - start < CALIBRATION_TICKS)
+        asm volatile("pause" ::: "memory");
+    uint32_t counts = 0xFFFFFFFF - read(REG_TIMER_CURRENT);
+    // 32 bits of TSC cycles are enough for over 4 GHz times the calibration period
+    uint32_t tsc_cycles = static_cast<uint32_t>(cpu::rdtsc() - tsc_start);
+    write(REG_TIMER_INITIAL, 0);
+
+    timer_counts_per_tick = counts / CALIBRATION_TICKS;
+    timer_tsc_per_tick = tsc_cycles / CALIBRATION_TICKS;
+    tsc_deadline = (cpu::cpuid(1).ecx & cpu::FEATURE_ECX_TSC_DEADLINE) != 0;
+    kassert(timer_counts_per_tick != 0);
+    register_handler(TIMER_VECTOR, timer_interrupt_handler);
+    TINY_INFO("APIC timer: ", timer_counts_per_tick, " counts and ", timer_tsc_per_tick, " TSC cycles per tick",
+              tsc_deadline ? ", TSC deadline mode" : ", one shot mode");
+}
+
+bool interrupts::apic::is_timer_calibrated() {
+    return timer_counts_per_tick != 0;
+}
+
+void interrupts::apic::start_timer() {
+    kassert(timer_counts_per_tick != 0);
+    scoped_intlock lock;
+    if (tsc_deadline) {
+        write(REG_LVT_TIMER, LVT_TIMER_TSC_DEADLINE | TIMER_VECTOR);
+        // the LVT write must be done before the deadline is set
+        asm volatile("mfence" ::: "memory");
+        smp::this_cpu()->timer_deadline = cpu::rdtsc();
+    } else {
+        write(REG_TIMER_DIVIDE, TIMER_DIVIDE_16);
+        write(REG_LVT_TIMER, LVT_TIMER_ONE_SHOT | TIMER_VECTOR);
+    }
+    arm_timer();
+}
+
+bool interrupts::apic::uses_tsc_deadline() {
+    return tsc_deadline;
+}
+
+uint32_t interrupts::apic::tsc_per_tick() {
+    return timer_tsc_per_tick;
+}
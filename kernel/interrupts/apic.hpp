@@ -0,0 +1,53 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/memory/page_allocator.hpp>
+
+// local APIC - one per CPU, at the same physical address on all of them
+namespace interrupts::apic {
+    // spurious interrupts need no end of interrupt
+    constexpr uint SPURIOUS_VECTOR = 0xFF;
+    // the local timer of every CPU ends its time slices
+    constexpr uint TIMER_VECTOR = 0xF0;
+
+    // register offsets
+    constexpr uint REG_ID = 0x20;
+    constexpr uint REG_VERSION = 0x30;
+    constexpr uint REG_TPR = 0x80;
+    constexpr uint REG_EOI = 0xB0;
+    constexpr uint REG_SVR = 0xF0;
+    constexpr uint REG_ESR = 0x280;
+    constexpr uint REG_ICR_LOW = 0x300;
+    constexpr uint REG_ICR_HIGH = 0x310;
+    constexpr uint REG_LVT_TIMER = 0x320;
+    constexpr uint REG_TIMER_INITIAL = 0x380;
+    constexpr uint REG_TIMER_CURRENT = 0x390;
+    constexpr uint REG_TIMER_DIVIDE = 0x3E0;
+
+    // maps the registers, called once at boot on the bootstrap processor
+    void map(memory::phys_t lapic_phys);
+    bool is_mapped();
+
+    uint32_t read(uint reg);
+    void write(uint reg, uint32_t value);
+
+    // enable the local APIC of the calling CPU
+    void enable();
+    uint8_t id();
+    void end_of_interrupt();
+
+    // inter-processor interrupts used to start an application processor
+    void send_init(uint8_t apic_id);
+    void send_startup(uint8_t apic_id, memory::phys_t start);
+    // send an interrupt to every CPU but the calling one, with interrupts disabled
+    void send_ipi_others(uint vector);
+
+    // measure the local timer and the TSC against the PIT, which must be ticking (see scheduler::ticks)
+    // called once on the bootstrap processor - all local timers run at the same rate
+    void calibrate_timer();
+    bool is_timer_calibrated();
+    // start the local timer of the calling CPU, one shot per tick - in TSC deadline mode if the CPU has it
+    void start_timer();
+    bool uses_tsc_deadline();
+    // TSC cycles per tick, as measured by calibrate_timer
+    uint32_t tsc_per_tick();
+}
@@ -0,0 +1,31 @@
+#include <kernel/interrupts/deferred.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/smp/percpu.hpp>
+
+using interrupts::deferred_work;
+
+// work queued on each CPU, only touched by that CPU with interrupts disabled
+static ds::intrusive_doubly_linked_node<deferred_work> pending[smp::MAX_CPUS];  // per CPU
+
+void interrupts::defer(deferred_work &work) {
+    kassert_is_interrupt;
+    if (__atomic_exchange_n(&work.queued, true, __ATOMIC_ACQ_REL))
+        return;  // already waiting, on this or another CPU
+    // at the tail, so work runs in the order it was queued
+    pending[smp::this_cpu()->index].get_prev()->add_after_self(&work);
+}
+
+void interrupts::run_deferred_work() {
+    kassert_is_interrupt;
+    auto &queue = pending[smp::this_cpu()->index];
+    for (uint i = 0; i < MAX_DEFERRED_PER_PASS && !queue.lonely(); i++) {
+        deferred_work *work = queue.get_next();
+        work->unlink();
+        // queueing it again while it runs runs it again
+        __atomic_store_n(&work->queued, false, __ATOMIC_RELEASE);
+
+        interrupts::sti();
+        work->func();
+        interrupts::cli();
+    }
+}
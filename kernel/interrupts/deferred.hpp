@@ -0,0 +1,29 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/util/ds/list.hpp>
+
+// work an interrupt handler leaves for later, so it can return quickly
+// queued work runs on the same CPU when its outermost interrupt handler returns, with interrupts enabled -
+// but still in interrupt context, so it may not block
+//
+// work left behind by a handler which switches tasks (the timer) waits for the next interrupt on that CPU
+namespace interrupts {
+    struct deferred_work final : ds::intrusive_doubly_linked_node<deferred_work> {
+        void (*func)();
+        // set from queueing until func starts running - queued again by another CPU meanwhile,
+        // func may run on two CPUs at once
+        bool queued;
+
+        inline constexpr deferred_work(void (*f)()) : func(f), queued(false) {}
+    };
+
+    // items which are still waiting after this many ran in a pass wait for the next one
+    constexpr uint MAX_DEFERRED_PER_PASS = 16;
+
+    // queue work on this CPU, called from interrupt context
+    // does nothing if it is already queued, so a handler can queue the same item for every interrupt
+    void defer(deferred_work &work);
+
+    // called by the interrupt handler when leaving the outermost interrupt, with interrupts disabled
+    void run_deferred_work();
+}
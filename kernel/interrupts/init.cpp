@@ -1,9 +1,13 @@
 #include <kernel/interrupts/init.hpp>
+#include <kernel/interrupts/deferred.hpp>
+#include <kernel/interrupts/stats.hpp>
 #include <kernel/util.hpp>
 #include <kernel/tty.hpp>
 #include <kernel/logging.hpp>
 #include <kernel/util/lock.hpp>
 #include <kernel/util/asm_wrap.hpp>
+#include <kernel/interrupts/apic.hpp>
+#include <kernel/smp/percpu.hpp>
 
 extern "C" {
     extern char interrupt_handler_0;
@@ -55,6 +59,8 @@ extern "C" {
     extern char interrupt_handler_46;
     extern char interrupt_handler_47;
     extern char interrupt_handler_128;
+    extern char interrupt_handler_240;
+    extern char interrupt_handler_255;
 }
 
 struct __attribute__((packed)) idt_entry {
@@ -71,8 +77,6 @@ static_assert(sizeof(idt_entry) == 8, "wrong idt entry size");
 __attribute__((aligned(0x10)))
 idt_entry idt_arr[256];  // global
 
-static int interrupt_context_depth;
-
 struct {
     unsigned short size;
     unsigned int address;
@@ -81,7 +85,7 @@ struct {
 static void (*interrupt_handler_table[256])(interrupts::interrupt_args &arg);  // global
 
 void interrupts::register_handler(uint interrupt, void (*interrupt_handler)(interrupt_args &args)) {
-    kassert(interrupt < 48);
+    kassert(interrupt < 256 && idt_arr[interrupt].attributes != 0);  // must have an entry stub
     interrupt_handler_table[interrupt] = interrupt_handler;
 }
 
@@ -102,37 +106,63 @@ void interrupts::initialize() {
         idt_arr[i].reserved = 0;
         idt_arr[i].attributes = 0x8e;  // Interrupt Gate, not Trap Gate
     }
-    idt_arr[0x80].kernel_cs = 0x08;
-    idt_arr[0x80].isr_low  = reinterpret_cast<uint32_t>(&interrupt_handler_128) & 0xFFFF;
-    idt_arr[0x80].isr_high = reinterpret_cast<uint32_t>(&interrupt_handler_128) >> 16;
-    idt_arr[0x80].reserved = 0;
-    idt_arr[0x80].attributes = 0xee;  // Interrupt Gate, DPL=11
+    idt_arr[SYSCALL_VECTOR].kernel_cs = 0x08;
+    idt_arr[SYSCALL_VECTOR].isr_low  = reinterpret_cast<uint32_t>(&interrupt_handler_128) & 0xFFFF;
+    idt_arr[SYSCALL_VECTOR].isr_high = reinterpret_cast<uint32_t>(&interrupt_handler_128) >> 16;
+    idt_arr[SYSCALL_VECTOR].reserved = 0;
+    idt_arr[SYSCALL_VECTOR].attributes = 0xee;  // Interrupt Gate, DPL=11
+    idt_arr[apic::TIMER_VECTOR].kernel_cs = 0x08;
+    idt_arr[apic::TIMER_VECTOR].isr_low  = reinterpret_cast<uint32_t>(&interrupt_handler_240) & 0xFFFF;
+    idt_arr[apic::TIMER_VECTOR].isr_high = reinterpret_cast<uint32_t>(&interrupt_handler_240) >> 16;
+    idt_arr[apic::TIMER_VECTOR].reserved = 0;
+    idt_arr[apic::TIMER_VECTOR].attributes = 0x8e;
+    idt_arr[apic::SPURIOUS_VECTOR].kernel_cs = 0x08;
+    idt_arr[apic::SPURIOUS_VECTOR].isr_low  = reinterpret_cast<uint32_t>(&interrupt_handler_255) & 0xFFFF;
+    idt_arr[apic::SPURIOUS_VECTOR].isr_high = reinterpret_cast<uint32_t>(&interrupt_handler_255) >> 16;
+    idt_arr[apic::SPURIOUS_VECTOR].reserved = 0;
+    idt_arr[apic::SPURIOUS_VECTOR].attributes = 0x8e;
 
     idtr.address = reinterpret_cast<uint32_t>(idt_arr);
     idtr.size = sizeof(idt_arr) - 1;
-    interrupt_context_depth = 0;
 }
 
-void interrupts::start() {
+void interrupts::load_idt() {
+    // the IDT is shared by all CPUs
     asm_lidt(&idtr);
+    this_cpu_write(interrupt_context_depth, 0);
+}
+
+void interrupts::start() {
+    load_idt();
     sti();
 }
 
+// the interrupt context depth is per-CPU, and interrupt handlers are never moved to another CPU
 void interrupts::reduce_interrupt_depth() {
-    int dep = __atomic_sub_fetch(&interrupt_context_depth, 1, __ATOMIC_SEQ_CST);
+    int dep = this_cpu_read(interrupt_context_depth) - 1;
+    this_cpu_write(interrupt_context_depth, dep);
     kassert(dep >= 0);
 }
 
 bool interrupts::is_interrupt_context() {
-    return interrupt_context_depth != 0;
+    return this_cpu_read(interrupt_context_depth) != 0;
 }
 
 int interrupts::get_interrupt_context_depth() {
-    return interrupt_context_depth;
+    return this_cpu_read(interrupt_context_depth);
 }
 
 extern "C" void internal_interrupt_handler(interrupts::interrupt_args *arg) {
-    __atomic_add_fetch(&interrupt_context_depth, 1, __ATOMIC_SEQ_CST);
+    if (arg->interrupt_number == interrupts::SYSCALL_VECTOR) {
+        // system calls run in the context of the calling task - they may block, and may be preempted
+        kassert(interrupt_handler_table[interrupts::SYSCALL_VECTOR] != nullptr);
+        interrupts::sti();
+        interrupt_handler_table[interrupts::SYSCALL_VECTOR](*arg);
+        return;
+    }
+
+    smp::percpu *cpu = smp::this_cpu();
+    cpu->interrupt_context_depth++;
 
     if (interrupt_handler_table[arg->interrupt_number] == nullptr) [[unlikely]] {
         reg_t cr2;
@@ -143,7 +173,12 @@ extern "C" void internal_interrupt_handler(interrupts::interrupt_args *arg) {
         kpanic("Unhandled interrupt: ", arg->interrupt_number, " error code ", arg->error_code, " (0x", hex{arg->error_code}, ')');
         return;
     }
+    uint64_t start = interrupts::handler_start(arg->interrupt_number);
     interrupt_handler_table[arg->interrupt_number](*arg);
+    interrupts::handler_done(arg->interrupt_number, start);
 
-    kassert(__atomic_sub_fetch(&interrupt_context_depth, 1, __ATOMIC_SEQ_CST) >= 0);
+    // nested interrupts leave their work to the outermost one, which runs it with interrupts enabled
+    if (cpu->interrupt_context_depth == 1)
+        interrupts::run_deferred_work();
+    kassert(--cpu->interrupt_context_depth >= 0);
 }
@@ -19,11 +19,17 @@ namespace interrupts {
         reg_t eflags;
     };
 
+    // the FPU is switched lazily, see scheduler/fpu.hpp
+    constexpr uint DEVICE_NOT_AVAILABLE_VECTOR = 7;
+    // int 0x80 enters a system call, see syscalls/init.hpp
+    constexpr uint SYSCALL_VECTOR = 0x80;
+
     void reduce_interrupt_depth();  // called by e.g. scheduler
     bool is_interrupt_context();  // is currently inside an interrupt?
     int get_interrupt_context_depth();  // current depth of interrupt context
     void initialize();
-    void start();  // start getting interrupts
+    void load_idt();  // load the IDT on the calling CPU, with interrupts still disabled
+    void start();  // load the IDT and start getting interrupts
     void register_handler(uint interrupt, void (*interrupt_handler)(interrupt_args &args));
 
     inline void sti() {
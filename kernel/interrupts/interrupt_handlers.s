@@ -25,6 +25,10 @@ common_interrupt_handler:               ; the common parts of the generic interr
     mov eax, cr3
     push eax
 
+    ; gs points to the per-CPU data in the kernel, but may be anything if we came from usermode
+    mov ax, 0x30
+    mov gs, ax
+
     ; pass a parameter, which is a pointer to the stack structure passed
     push esp
 
@@ -106,3 +110,5 @@ isr_no_err_stub 46
 isr_no_err_stub 47
 
 isr_no_err_stub 128
+isr_no_err_stub 240
+isr_no_err_stub 255
@@ -0,0 +1,65 @@
+#include <kernel/interrupts/ioapic.hpp>
+#include <kernel/smp/init.hpp>
+#include <kernel/logging.hpp>
+
+static volatile uint32_t *ioapic_regs = nullptr;
+static uint num_pins;
+
+static constexpr uint IOREGSEL = 0x00 / 4;
+static constexpr uint IOWIN = 0x10 / 4;
+
+static constexpr uint32_t REDIR_ACTIVE_LOW = 1 << 13;
+static constexpr uint32_t REDIR_LEVEL = 1 << 15;
+static constexpr uint32_t REDIR_MASKED = 1 << 16;
+
+void interrupts::ioapic::initialize(memory::phys_t ioapic_phys) {
+    kassert(ioapic_regs == nullptr);
+    ioapic_regs = static_cast<volatile uint32_t *>(memory::map_mmio_page(ioapic_phys));
+    num_pins = ((read(REG_VERSION) >> 16) & 0xFF) + 1;
+    for (uint pin = 0; pin < num_pins; pin++)
+        mask(pin);
+    TINY_INFO("IOAPIC with ", num_pins, " inputs");
+}
+
+bool interrupts::ioapic::is_initialized() {
+    return ioapic_regs != nullptr;
+}
+
+// the select/window pair is shared, so this is only used during boot, or under the caller's lock
+uint32_t interrupts::ioapic::read(uint reg) {
+    ioapic_regs[IOREGSEL] = reg;
+    return ioapic_regs[IOWIN];
+}
+
+void interrupts::ioapic::write(uint reg, uint32_t value) {
+    ioapic_regs[IOREGSEL] = reg;
+    ioapic_regs[IOWIN] = value;
+}
+
+void interrupts::ioapic::route(uint pin, uint vector, uint8_t apic_id, bool level_triggered, bool active_low) {
+    kassert(pin < num_pins && vector >= 0x20 && vector < 0x100);
+    uint32_t low = vector;  // fixed delivery, physical destination
+    if (level_triggered)
+        low |= REDIR_LEVEL;
+    if (active_low)
+        low |= REDIR_ACTIVE_LOW;
+    // masked while changing, the high half holds the destination
+    write(REG_REDIRECTION + 2 * pin, REDIR_MASKED);
+    write(REG_REDIRECTION + 2 * pin + 1, static_cast<uint32_t>(apic_id) << 24);
+    write(REG_REDIRECTION + 2 * pin, low);
+}
+
+void interrupts::ioapic::mask(uint pin) {
+    kassert(pin < num_pins);
+    write(REG_REDIRECTION + 2 * pin, REDIR_MASKED);
+}
+
+void interrupts::ioapic::route_isa_irq(uint irq, uint vector, uint8_t apic_id) {
+    kassert(irq < 16);
+    const smp::topology &machine = smp::get_topology();
+    // MP specification interrupt flags: polarity in bits 0-1, trigger mode in bits 2-3, 0 conforms to the bus (ISA: edge, high)
+    uint16_t flags = machine.isa_irq_flags[irq];
+    bool active_low = (flags & 3) == 3;
+    bool level = ((flags >> 2) & 3) == 3;
+    route(machine.isa_irq_pin[irq], vector, apic_id, level, active_low);
+}
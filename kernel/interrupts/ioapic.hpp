@@ -0,0 +1,25 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/memory/page_allocator.hpp>
+
+// I/O APIC - routes device interrupts to the local APICs, instead of the 8259 PIC
+namespace interrupts::ioapic {
+    // register indices, accessed through the select and window registers
+    constexpr uint REG_ID = 0x00;
+    constexpr uint REG_VERSION = 0x01;
+    constexpr uint REG_REDIRECTION = 0x10;  // two registers per input pin
+
+    // maps the registers and masks every input, called once at boot on the bootstrap processor
+    void initialize(memory::phys_t ioapic_phys);
+    bool is_initialized();
+
+    uint32_t read(uint reg);
+    void write(uint reg, uint32_t value);
+
+    // deliver an input pin as vector to the CPU with apic_id
+    void route(uint pin, uint vector, uint8_t apic_id, bool level_triggered, bool active_low);
+    void mask(uint pin);
+
+    // route a legacy ISA IRQ (as numbered on the PIC) - the firmware may have wired it to another pin
+    void route_isa_irq(uint irq, uint vector, uint8_t apic_id);
+}
@@ -3,7 +3,10 @@
 #include <kernel/interrupts/pic.hpp>
 #include <kernel/util/asm_wrap.hpp>
 #include <kernel/devices/keyboard.hpp>
+#include <kernel/serial.hpp>
 #include <kernel/scheduler/init.hpp>
+#include <kernel/interrupts/apic.hpp>
+#include <kernel/util/lock.hpp>
 
 static constexpr unsigned short PIC1 = 0x20; // IO base address for master PIC
 static constexpr unsigned short PIC2 = 0xA0; // IO base address for slave PIC
@@ -14,7 +17,14 @@ static constexpr unsigned short PIC2_DATA = PIC2 + 1;
 static constexpr unsigned short KB_PORT = 0x60;
 constexpr unsigned char PIC_EOI = 0x20;  // end of interrupt, sent at end of IRQ-based interrupt routine
 
+// once the IOAPIC delivers the IRQs, they end at the local APIC
+static bool routed_through_ioapic = false;  // global
+
 static void send_end_of_interrupt(uint interrupt) {
+    if (routed_through_ioapic) {
+        interrupts::apic::end_of_interrupt();
+        return;
+    }
     if(interrupt >= 8) {
         asm_outb(PIC2_CMD, PIC_EOI);
     }
@@ -31,6 +41,8 @@ static void pic_interrupt_handler(interrupts::interrupt_args &args) {
     } else if (num == 1) {
         unsigned char scan_code = asm_inb(KB_PORT);
         devices::keyboard::on_scan_code(scan_code);
+    } else if (num == 4) {
+        serial::on_interrupt();
     } else {
         kpanic("Invalid PIC interrupt ", num);
     }
@@ -60,12 +72,23 @@ void interrupts::init_pic() {
     asm_outb(PIC2_DATA, 0x01);  // Set as slave
 
     // set masks - 1 is ignored
-    asm_outb(PIC1_DATA, 0xfc);  // master PIC - allow only timer and keyboard
+    asm_outb(PIC1_DATA, 0xec);  // master PIC - allow only timer, keyboard and COM1
     asm_outb(PIC2_DATA, 0xff);  // slave PIC  - block all
 
     // setup timer
-    int divisor = 1193180 / 1000;  // 1000Hz
     asm_outb(0x43, 52);
-    asm_outb(0x40, divisor & 0xFF);
-    asm_outb(0x40, divisor >> 8);
+    asm_outb(0x40, PIT_DIVISOR & 0xFF);
+    asm_outb(0x40, PIT_DIVISOR >> 8);
+}
+
+void interrupts::pic_disable_timer() {
+    scoped_intlock lock;
+    asm_outb(PIC1_DATA, 0xed);  // master PIC - allow only keyboard and COM1
+}
+
+void interrupts::pic_disable() {
+    scoped_intlock lock;
+    asm_outb(PIC1_DATA, 0xff);
+    asm_outb(PIC2_DATA, 0xff);
+    routed_through_ioapic = true;
 }
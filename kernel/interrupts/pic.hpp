@@ -2,5 +2,14 @@
 #include <kernel/interrupts/init.hpp>
 
 namespace interrupts {
+    // the PIT runs at PIT_FREQUENCY / PIT_DIVISOR, roughly 1000Hz
+    constexpr uint32_t PIT_FREQUENCY = 1193180;
+    constexpr uint32_t PIT_DIVISOR = PIT_FREQUENCY / 1000;
+
+    // the 8259 PICs deliver the timer (PIT, 1000Hz), keyboard and COM1 IRQs until the APICs take over
     void init_pic();
+    // the local APIC timers took over, stop the PIT's ticks
+    void pic_disable_timer();
+    // the IOAPIC took over - mask all IRQs at the PICs, the IRQ handlers send their end of interrupt to the local APIC
+    void pic_disable();
 }
@@ -0,0 +1,121 @@
+#include <kernel/interrupts/profiler.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/smp/percpu.hpp>
+#include <kernel/logging.hpp>
+
+using interrupts::profiler::sample;
+
+static constexpr uint RING_SIZE = 32768 / sizeof(sample);
+
+// written only by the timer interrupt of its CPU
+struct ring {
+    sample *samples;  // allocated by the first start
+    uint32_t taken;   // the next sample goes to samples[taken % RING_SIZE]
+};
+
+static ring rings[smp::MAX_CPUS];  // global
+static bool running;               // global
+static uint32_t sample_interval;   // global
+
+struct stack_frame {
+    stack_frame *ebp;
+    uint32_t eip;
+};
+
+void interrupts::profiler::start(uint32_t interval) {
+    kassert_not_interrupt;
+    kassert(!is_running() && interval != 0);
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        if (rings[cpu].samples == nullptr)
+            rings[cpu].samples = static_cast<sample *>(memory::kmem_alloc_32k());
+        rings[cpu].taken = 0;
+    }
+    sample_interval = interval;
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+}
+
+void interrupts::profiler::stop() {
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+}
+
+bool interrupts::profiler::is_running() {
+    return __atomic_load_n(&running, __ATOMIC_ACQUIRE);
+}
+
+void interrupts::profiler::tick(const interrupt_args &args) {
+    if (!is_running() || this_cpu_read(local_ticks) % sample_interval != 0)
+        return;
+    ring &r = rings[this_cpu_read(index)];
+    sample &s = r.samples[r.taken % RING_SIZE];
+
+    scheduler::task *current = scheduler::get_current_task();
+    s.eip = args.eip;
+    s.pid = current != nullptr ? current->pid : 0;
+    s.user = (args.cs & 3) != 0;
+    s.depth = 0;
+    if (!s.user) {
+        // the frames of the interrupted code, as long as they stay on its 8K kernel stack, see kpanic
+        uintptr_t frame_min = args.ebp & ~8191u, frame_max = frame_min + 8192 - sizeof(stack_frame);
+        stack_frame *frame = reinterpret_cast<stack_frame *>(args.ebp);
+        while (s.depth < MAX_FRAMES && frame_min <= reinterpret_cast<uintptr_t>(frame) && reinterpret_cast<uintptr_t>(frame) <= frame_max) {
+            s.frames[s.depth++] = frame->eip;
+            if (reinterpret_cast<uintptr_t>(frame->ebp) <= reinterpret_cast<uintptr_t>(frame))
+                break;
+            frame = frame->ebp;
+        }
+    }
+    __atomic_store_n(&r.taken, r.taken + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t interrupts::profiler::samples_taken() {
+    uint32_t taken = 0;
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++)
+        taken += __atomic_load_n(&rings[cpu].taken, __ATOMIC_ACQUIRE);
+    return taken;
+}
+
+uint32_t interrupts::profiler::samples_lost() {
+    uint32_t lost = 0;
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        uint32_t taken = __atomic_load_n(&rings[cpu].taken, __ATOMIC_ACQUIRE);
+        if (taken > RING_SIZE)
+            lost += taken - RING_SIZE;
+    }
+    return lost;
+}
+
+uint interrupts::profiler::get_samples(uint cpu, sample *out, uint max) {
+    kassert(cpu < smp::cpu_count());
+    const ring &r = rings[cpu];
+    if (r.samples == nullptr)
+        return 0;
+    uint32_t taken = __atomic_load_n(&r.taken, __ATOMIC_ACQUIRE);
+    uint32_t first = taken > RING_SIZE ? taken - RING_SIZE : 0;
+    uint count = 0;
+    for (uint32_t i = first; i < taken && count < max; i++)
+        out[count++] = r.samples[i % RING_SIZE];
+    return count;
+}
+
+void interrupts::profiler::dump() {
+    kassert_not_interrupt;
+    using formatting::hex;
+    LOCKED(serial_driver::write("PROF_BEGIN ", samples_taken(), " samples, ", samples_lost(), " lost\n"));
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        const ring &r = rings[cpu];
+        if (r.samples == nullptr)
+            continue;
+        uint32_t taken = __atomic_load_n(&r.taken, __ATOMIC_ACQUIRE);
+        for (uint32_t i = taken > RING_SIZE ? taken - RING_SIZE : 0; i < taken; i++) {
+            const sample &s = r.samples[i % RING_SIZE];
+            // PROF cpu pid user|kernel eip return addresses..., see scripts/profile.py
+            scoped_spinlock lock {log_lock};
+            serial_driver::write("PROF ", cpu, ' ', s.pid, s.user ? " user " : " kernel ", hex{s.eip});
+            for (uint f = 0; f < s.depth; f++)
+                serial_driver::write(' ', hex{s.frames[f]});
+            serial_driver::write('\n');
+        }
+    }
+    LOCKED(serial_driver::write("PROF_END\n"));
+}
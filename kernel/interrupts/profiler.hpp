@@ -0,0 +1,37 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/interrupts/init.hpp>
+
+// statistical profiler: while running, the timer interrupt of every CPU records where it interrupted - the
+// instruction pointer, the running task and, in the kernel, a frame pointer backtrace - into a ring of the CPU.
+// The oldest samples are overwritten when a ring is full.
+// dump writes them to the serial port, for scripts/profile.py to turn into folded stacks for flame graphs
+namespace interrupts::profiler {
+    constexpr uint MAX_FRAMES = 8;
+
+    struct sample {
+        uint32_t eip;
+        uint32_t pid;
+        bool user;                    // interrupted usermode, there is no backtrace then
+        uint8_t depth;                // frames in use
+        uint32_t frames[MAX_FRAMES];  // return addresses, innermost first
+    };
+
+    // sample every interval ticks of each CPU, discarding the samples of the last run
+    // do NOT call from interrupt context, or while running
+    void start(uint32_t interval = 1);
+    // stop sampling - a CPU which is in the middle of taking a sample finishes it
+    void stop();
+    bool is_running();
+
+    // called by the timer interrupt of every CPU
+    void tick(const interrupt_args &args);
+
+    // samples taken since start, and how many of those were overwritten
+    uint32_t samples_taken();
+    uint32_t samples_lost();
+    // copy the samples a CPU still has, oldest first, returns the number written
+    uint get_samples(uint cpu, sample *out, uint max);
+    // write all samples as PROF lines to the serial port, after stop, do NOT call from interrupt context
+    void dump();
+}
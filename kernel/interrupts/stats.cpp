@@ -0,0 +1,212 @@
+#include <kernel/interrupts/stats.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/clock/init.hpp>
+#include <kernel/smp/percpu.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/logging.hpp>
+
+using interrupts::vector_stats;
+using interrupts::irqs_off_site;
+using interrupts::MAX_IRQS_OFF_SITES;
+
+// only written by their own CPU, with interrupts disabled
+static vector_stats vectors[smp::MAX_CPUS][256];  // global
+
+// the outermost handler running on a CPU, for handler_switching_away
+struct outer_handler {
+    uint64_t start;
+    uint vector;
+};
+static outer_handler outer[smp::MAX_CPUS];  // global
+
+// open addressing by file and line, a table per CPU - only written by their own CPU, with interrupts disabled, so
+// releasing a lock doesn't touch a cache line another CPU writes. Sites are never removed, so a found site stays
+// valid. Interrupts are only enabled after init_gdt, so note_irqs_off can always tell its CPU
+static irqs_off_site sites[smp::MAX_CPUS][MAX_IRQS_OFF_SITES];  // global
+
+static inline uint site_hash(const char *file, uint32_t line) {
+    return ((reinterpret_cast<uintptr_t>(file) >> 2) ^ (line * 2654435761u)) % MAX_IRQS_OFF_SITES;
+}
+
+// the site in a CPU's table, or nullptr
+static const irqs_off_site *find_site(uint cpu, const char *file, uint32_t line) {
+    uint i = site_hash(file, line);
+    for (uint probe = 0; probe < MAX_IRQS_OFF_SITES; probe++, i = (i + 1) % MAX_IRQS_OFF_SITES) {
+        const irqs_off_site &s = sites[cpu][i];
+        const char *f = __atomic_load_n(&s.file, __ATOMIC_ACQUIRE);
+        if (f == nullptr)
+            return nullptr;
+        if (f == file && s.line == line)
+            return &s;
+    }
+    return nullptr;
+}
+
+// a site summed over all CPUs, starting from the table of the first CPU which has it
+static irqs_off_site sum_site(uint first_cpu, const irqs_off_site &first) {
+    irqs_off_site sum {first.file, first.line, 0, 0};
+    for (uint cpu = first_cpu; cpu < smp::cpu_count(); cpu++) {
+        const irqs_off_site *s = cpu == first_cpu ? &first : find_site(cpu, first.file, first.line);
+        if (s == nullptr)
+            continue;
+        sum.count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        uint32_t max_cycles = __atomic_load_n(&s->max_cycles, __ATOMIC_RELAXED);
+        if (max_cycles > sum.max_cycles)
+            sum.max_cycles = max_cycles;
+    }
+    return sum;
+}
+
+static inline uint32_t saturate(uint64_t cycles) {
+    return cycles > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32_t>(cycles);
+}
+
+uint64_t interrupts::handler_start(uint vector) {
+    uint64_t start = cpu::rdtsc();
+    if (get_interrupt_context_depth() == 1)
+        outer[this_cpu_read(index)] = outer_handler{start, vector};
+    return start;
+}
+
+void interrupts::handler_done(uint vector, uint64_t start) {
+    uint32_t cycles = saturate(cpu::rdtsc() - start);
+    vector_stats &s = vectors[this_cpu_read(index)][vector];
+    s.count++;
+    s.total_cycles += cycles;
+    if (cycles > s.max_cycles)
+        s.max_cycles = cycles;
+}
+
+void interrupts::handler_switching_away() {
+    kassert(get_interrupt_context_depth() == 1);
+    const outer_handler &o = outer[this_cpu_read(index)];
+    handler_done(o.vector, o.start);
+}
+
+void interrupts::note_irqs_off(const char *file, uint32_t line, uint64_t cycles) {
+    irqs_off_site *table = sites[this_cpu_read(index)];
+    uint i = site_hash(file, line);
+    for (uint probe = 0; probe < MAX_IRQS_OFF_SITES; probe++, i = (i + 1) % MAX_IRQS_OFF_SITES) {
+        irqs_off_site &s = table[i];
+        if (s.file == nullptr) {
+            s.line = line;
+            // readers on other CPUs see the line once they see the file
+            __atomic_store_n(&s.file, file, __ATOMIC_RELEASE);
+        }
+        if (s.file == file && s.line == line) {
+            __atomic_store_n(&s.count, s.count + 1, __ATOMIC_RELAXED);
+            uint32_t value = saturate(cycles);
+            if (value > s.max_cycles)
+                __atomic_store_n(&s.max_cycles, value, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+vector_stats interrupts::get_vector_stats(uint vector) {
+    kassert(vector < 256);
+    vector_stats sum {0, 0, 0};
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        const vector_stats &s = vectors[cpu][vector];
+        sum.count += s.count;
+        sum.total_cycles += s.total_cycles;
+        if (s.max_cycles > sum.max_cycles)
+            sum.max_cycles = s.max_cycles;
+    }
+    return sum;
+}
+
+uint interrupts::get_irqs_off_sites(irqs_off_site *out, uint max) {
+    uint count = 0;
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        for (uint i = 0; i < MAX_IRQS_OFF_SITES; i++) {
+            const irqs_off_site &site = sites[cpu][i];
+            const char *file = __atomic_load_n(&site.file, __ATOMIC_ACQUIRE);
+            if (file == nullptr)
+                continue;
+            // counted with the first CPU which has it
+            bool seen = false;
+            for (uint before = 0; before < cpu && !seen; before++)
+                seen = find_site(before, file, site.line) != nullptr;
+            if (seen)
+                continue;
+            irqs_off_site s = sum_site(cpu, site);
+            // insertion sort, keeping the longest max first - when full, the shortest falls out
+            uint j;
+            if (count < max) {
+                j = count++;
+            } else if (max != 0 && out[max - 1].max_cycles < s.max_cycles) {
+                j = max - 1;
+            } else {
+                continue;
+            }
+            for (; j > 0 && out[j - 1].max_cycles < s.max_cycles; j--)
+                out[j] = out[j - 1];
+            out[j] = s;
+        }
+    }
+    return count;
+}
+
+irqs_off_site interrupts::get_irqs_off_site(const char *file, uint32_t line) {
+    size_t length = strlen(file);
+    irqs_off_site sum {nullptr, line, 0, 0};
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        for (uint i = 0; i < MAX_IRQS_OFF_SITES; i++) {
+            const irqs_off_site &s = sites[cpu][i];
+            const char *f = __atomic_load_n(&s.file, __ATOMIC_ACQUIRE);
+            if (f == nullptr || s.line != line || strlen(f) != length || memcmp(f, file, length) != 0)
+                continue;
+            sum.file = f;
+            sum.count += __atomic_load_n(&s.count, __ATOMIC_RELAXED);
+            uint32_t max_cycles = __atomic_load_n(&s.max_cycles, __ATOMIC_RELAXED);
+            if (max_cycles > sum.max_cycles)
+                sum.max_cycles = max_cycles;
+        }
+    }
+    return sum;
+}
+
+void interrupts::reset_stats() {
+    scoped_intlock lock;
+    for (uint cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        for (uint vector = 0; vector < 256; vector++)
+            vectors[cpu][vector] = vector_stats{0, 0, 0};
+    }
+    // the sites stay, so a CPU which just found one keeps a valid slot
+    for (uint cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        for (uint i = 0; i < MAX_IRQS_OFF_SITES; i++) {
+            __atomic_store_n(&sites[cpu][i].count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&sites[cpu][i].max_cycles, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+    return static_cast<uint32_t>(div64_32(clock::cycles_to_ns(cycles), 1000));
+}
+
+void interrupts::dump_stats() {
+    kassert_not_interrupt;
+    for (uint vector = 0; vector < 256; vector++) {
+        vector_stats s = get_vector_stats(vector);
+        if (s.count == 0)
+            continue;
+        uint32_t avg = static_cast<uint32_t>(div64_32(s.total_cycles, s.count));
+        LOCKED(serial_driver::write("[IRQ] vector ", vector, ": ", s.count, " times, avg ", avg, " cycles, max ",
+                                    s.max_cycles, " cycles (", cycles_to_us(s.max_cycles), "us)\n"));
+    }
+
+    // only the worst, copied first so writing them slowly doesn't hold anything
+    constexpr uint MAX_SHOWN = 32;
+    irqs_off_site *shown = static_cast<irqs_off_site *>(memory::kmem_alloc_4k());
+    static_assert(MAX_SHOWN * sizeof(irqs_off_site) <= 4096);
+    uint count = get_irqs_off_sites(shown, MAX_SHOWN);
+    for (uint i = 0; i < count; i++) {
+        const irqs_off_site &s = shown[i];
+        LOCKED(serial_driver::write("[IRQ] interrupts off at ", s.file, ':', s.line, ": ", s.count, " times, max ",
+                                    s.max_cycles, " cycles (", cycles_to_us(s.max_cycles), "us)\n"));
+    }
+    memory::kmem_free_4k(shown);
+}
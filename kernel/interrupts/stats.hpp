@@ -0,0 +1,42 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// interrupt instrumentation, in TSC cycles: the invocations and handler times of every vector, and the longest
+// time every scoped_intlock and scoped_spinlock site kept interrupts disabled (nested sections are part of the
+// outermost one, which is what delays interrupts)
+namespace interrupts {
+    constexpr uint MAX_IRQS_OFF_SITES = 256;
+
+    struct vector_stats {
+        uint32_t count;
+        uint32_t max_cycles;
+        uint64_t total_cycles;
+    };
+
+    struct irqs_off_site {
+        const char *file;  // nullptr for a free slot
+        uint32_t line;
+        uint32_t count;    // sections which disabled interrupts
+        uint32_t max_cycles;
+    };
+
+    // called by internal_interrupt_handler around a handler
+    uint64_t handler_start(uint vector);
+    void handler_done(uint vector, uint64_t start);
+    // called by a handler of the outermost interrupt which switches tasks, instead of returning
+    void handler_switching_away();
+
+    // called by a section which disabled interrupts at file:line, right before it enables them again
+    // sites which don't fit in the CPU's table anymore are not counted
+    void note_irqs_off(const char *file, uint32_t line, uint64_t cycles);
+
+    // summed over all CPUs - the counters are not read atomically
+    vector_stats get_vector_stats(uint vector);
+    // copy up to max sites summed over all CPUs, the longest sections first, returns the number written
+    uint get_irqs_off_sites(irqs_off_site *out, uint max);
+    // one site summed over all CPUs, the file compared by its name - file is nullptr if it was never counted
+    irqs_off_site get_irqs_off_site(const char *file, uint32_t line);
+    void reset_stats();
+    // write the stats to the serial port, do NOT call from interrupt context
+    void dump_stats();
+}
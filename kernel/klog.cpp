@@ -0,0 +1,300 @@
+#include <kernel/klog.hpp>
+#include <kernel/logging.hpp>
+#include <kernel/clock/init.hpp>
+#include <kernel/scheduler/workqueue.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/memory/page_allocator.hpp>
+
+using klog::level;
+
+// records follow each other in the ring, never wrapping around its end - padding fills the rest, a record without
+// a site, or nothing if not even the header fits
+struct record_header {
+    uint32_t size;  // the whole record, a multiple of the alignment
+    const klog::site *where;
+    klog::format_fn format;
+    uint64_t time_ns;
+};
+static constexpr size_t MAX_RECORD_SIZE = sizeof(record_header) + klog::MAX_ARGS_SIZE;
+
+// positions only grow, the record at position p starts at ring[p % RING_SIZE]
+alignas(record_header) static char ring[klog::RING_SIZE];  // global
+static uint32_t ring_head;      // global, where the next record goes
+static uint32_t ring_tail;      // global, the oldest record
+static uint32_t ring_flushed;   // global, the first record which wasn't formatted to the serial port, from ring_tail on
+static uint32_t ring_lost;      // global
+static spinlock ring_lock;      // global, guards the ring, only held to copy records in and out
+
+static spinlock flushing;       // global, taken with try_lock by whoever formats records to the serial port
+static bool deferred;           // global, set once by start_flusher
+
+static_assert(klog::RING_SIZE % alignof(record_header) == 0 && MAX_RECORD_SIZE * 4 <= klog::RING_SIZE);
+
+static inline record_header *header_at(uint32_t pos) {
+    return reinterpret_cast<record_header *>(&ring[pos % klog::RING_SIZE]);
+}
+
+static inline bool is_padding(uint32_t pos) {
+    return klog::RING_SIZE - pos % klog::RING_SIZE < sizeof(record_header) || header_at(pos)->where == nullptr;
+}
+
+static inline uint32_t size_at(uint32_t pos) {
+    uint32_t left = klog::RING_SIZE - pos % klog::RING_SIZE;
+    return left < sizeof(record_header) ? left : header_at(pos)->size;
+}
+
+// drop records until size more bytes fit after ring_head
+static void make_room(uint32_t size) {
+    while (ring_head + size - ring_tail > klog::RING_SIZE) {
+        uint32_t dropped = size_at(ring_tail);
+        if (ring_flushed == ring_tail) {
+            // the serial port will not see it
+            if (!is_padding(ring_tail))
+                ring_lost++;
+            ring_flushed += dropped;
+        }
+        ring_tail += dropped;
+    }
+}
+
+// make room for a record of size bytes, returns where it goes
+static uint32_t reserve(uint32_t size) {
+    uint32_t offset = ring_head % klog::RING_SIZE;
+    if (offset + size > klog::RING_SIZE) {
+        // no room before the end of the ring
+        uint32_t padding = klog::RING_SIZE - offset;
+        make_room(padding);
+        if (padding >= sizeof(record_header)) {
+            record_header *pad = header_at(ring_head);
+            pad->size = padding;
+            pad->where = nullptr;
+        }
+        ring_head += padding;
+    }
+    make_room(size);
+    uint32_t pos = ring_head;
+    ring_head += size;
+    return pos;
+}
+
+void klog::__append(const site &where, format_fn format, const char *args, size_t args_size) {
+    uint32_t size = (sizeof(record_header) + args_size + alignof(record_header) - 1) & ~(alignof(record_header) - 1);
+    uint64_t now = clock::now_ns();
+    {
+        scoped_spinlock lock {ring_lock};
+        uint32_t pos = reserve(size);
+        record_header *h = header_at(pos);
+        h->size = size;
+        h->where = &where;
+        h->format = format;
+        h->time_ns = now;
+        memcpy(h + 1, args, args_size);
+    }
+    if (!__atomic_load_n(&deferred, __ATOMIC_ACQUIRE) || where.lvl >= level::warn)
+        flush();
+}
+
+// copy out the record at pos, or the oldest one if it was overwritten meanwhile - returns the position after it,
+// or pos if there is none
+static uint32_t copy_record(uint32_t pos, char *out) {
+    scoped_spinlock lock {ring_lock};
+    if (static_cast<int32_t>(ring_tail - pos) > 0)
+        pos = ring_tail;
+    while (pos != ring_head && is_padding(pos))
+        pos += size_at(pos);
+    if (pos == ring_head)
+        return pos;
+    record_header *h = header_at(pos);
+    memcpy(out, h, h->size);
+    return pos + h->size;
+}
+
+void klog::__format_string(const sink &out, const char *s, size_t length) {
+    out.write(s, length);
+}
+
+void klog::__format_int(const sink &out, int val) {
+    int_to_str_stack_buf buf;
+    string_buf s = str_util::dec(val, buf);
+    out.write(s.data, s.length);
+}
+
+void klog::__format_uint(const sink &out, uint val) {
+    int_to_str_stack_buf buf;
+    string_buf s = str_util::dec(val, buf);
+    out.write(s.data, s.length);
+}
+
+void klog::__format_hex(const sink &out, uintptr_t val) {
+    int_to_str_stack_buf buf;
+    string_buf s = str_util::hex(val, buf);
+    out.write(s.data, s.length);
+}
+
+static const char *level_prefix(level lvl) {
+    switch (lvl) {
+        case level::debug:
+            return "[DBUG] ";
+        case level::info:
+            return "[INFO] ";
+        case level::warn:
+            return "[WARN] ";
+        case level::err:
+            return "[ERR!] ";
+    }
+    return "[????] ";
+}
+
+// the same line the log macros wrote directly before, optionally with the time in front
+static void format_record(const record_header *h, const klog::sink &out, bool with_time) {
+    const klog::site &where = *h->where;
+    if (with_time) {
+        // split in 64 bits, microseconds alone wrap after 71 minutes
+        uint32_t seconds = static_cast<uint32_t>(div64_32(h->time_ns, 1000000000));
+        uint32_t us = static_cast<uint32_t>(h->time_ns - static_cast<uint64_t>(seconds) * 1000000000) / 1000;
+        int_to_str_stack_buf buf;
+        string_buf sec = str_util::dec(seconds, buf);
+        out.write("[", 1);
+        out.write(sec.data, sec.length);
+        char frac[8] = {'.', 0, 0, 0, 0, 0, 0, ']'};
+        for (uint i = 6, rest = us; i >= 1; i--, rest /= 10)
+            frac[i] = '0' + rest % 10;
+        out.write(frac, sizeof(frac));
+        out.write(" ", 1);
+    }
+    const char *prefix = level_prefix(where.lvl);
+    out.write(prefix, strlen(prefix));
+    h->format(reinterpret_cast<const char *>(h + 1), out);
+    out.write(" in file ", 9);
+    out.write(where.file, strlen(where.file));
+    out.write(":", 1);
+    klog::__format_uint(out, where.line);
+    out.write(" (", 2);
+    out.write(where.function, strlen(where.function));
+    out.write(")\n", 2);
+}
+
+static void put_serial(const char *s, size_t length, void *) {
+    for (size_t i = 0; i < length; i++)
+        serial::put(s[i]);
+}
+
+static void flush_records(bool panicking) {
+    alignas(record_header) char record[MAX_RECORD_SIZE];
+    klog::sink out {put_serial, nullptr};
+    while (true) {
+        uint32_t pos = __atomic_load_n(&ring_flushed, __ATOMIC_ACQUIRE);
+        uint32_t next = copy_record(pos, record);
+        if (next == pos)
+            return;
+        {
+            scoped_spinlock lock {ring_lock};
+            // lost records moved ring_flushed on - the copy was the oldest left then
+            if (static_cast<int32_t>(next - ring_flushed) > 0)
+                ring_flushed = next;
+        }
+        // a line at a time, like the log macros
+        if (panicking) {
+            format_record(reinterpret_cast<record_header *>(record), out, false);
+        } else {
+            scoped_spinlock lock {log_lock};
+            format_record(reinterpret_cast<record_header *>(record), out, false);
+        }
+    }
+}
+
+void klog::flush() {
+    bool deferring = __atomic_load_n(&deferred, __ATOMIC_ACQUIRE);
+    while (true) {
+        // whoever holds flushing looks for new records again after unlocking - and doesn't switch tasks
+        // meanwhile, preemption is disabled before taking it, so a task may wait for it to finish,
+        // an interrupt handler (or early boot) leaves it to them
+        if (deferring)
+            scheduler::preempt_up();
+        if (!flushing.try_lock()) {
+            if (deferring)
+                scheduler::preempt_down();
+            if (!deferring || interrupts::is_interrupt_context())
+                return;
+            while (flushing.is_locked())
+                asm volatile("pause" ::: "memory");
+            continue;
+        }
+        flush_records(false);
+        flushing.unlock();
+        if (deferring)
+            scheduler::preempt_down();
+        uint32_t flushed, head;
+        {
+            scoped_spinlock lock {ring_lock};
+            flushed = ring_flushed;
+            head = ring_head;
+        }
+        if (flushed == head)
+            return;
+    }
+}
+
+void klog::flush_panic() {
+    // the other CPUs may be stuck holding the locks, or this one
+    if (!ring_lock.is_locked() && flushing.try_lock())
+        flush_records(true);
+}
+
+uint32_t klog::lost() {
+    scoped_spinlock lock {ring_lock};
+    return ring_lost;
+}
+
+static void flusher(scheduler::work_item *w) {
+    klog::flush();
+    scheduler::queue_delayed_work(*scheduler::delayed_work::from(w), klog::FLUSH_INTERVAL);
+}
+static scheduler::delayed_work flusher_work {flusher};
+
+void klog::start_flusher() {
+    kassert(!deferred);
+    __atomic_store_n(&deferred, true, __ATOMIC_RELEASE);
+    scheduler::queue_delayed_work(flusher_work, FLUSH_INTERVAL);
+}
+
+// copies the part of the text between pos and pos + count to buf
+struct text_window {
+    char *buf;
+    size_t count;
+    uint64_t pos;
+    uint64_t at;  // position of the next character of the text
+};
+
+static void put_window(const char *s, size_t length, void *ctx) {
+    text_window &w = *static_cast<text_window *>(ctx);
+    for (size_t i = 0; i < length; i++, w.at++) {
+        if (w.at >= w.pos && w.at < w.pos + w.count)
+            w.buf[w.at - w.pos] = s[i];
+    }
+}
+
+ssize_t klog::read_text(char *buf, size_t count, uint64_t pos) {
+    kassert_not_interrupt;
+    char *record = static_cast<char *>(memory::kmem_alloc_4k());
+    static_assert(MAX_RECORD_SIZE <= 4096);
+    text_window w {buf, count, pos, 0};
+    sink out {put_window, &w};
+    uint32_t at;
+    {
+        scoped_spinlock lock {ring_lock};
+        at = ring_tail;
+    }
+    while (w.at < pos + count) {
+        uint32_t next = copy_record(at, record);
+        if (next == at)
+            break;
+        format_record(reinterpret_cast<record_header *>(record), out, true);
+        at = next;
+    }
+    memory::kmem_free_4k(record);
+    if (w.at <= pos)
+        return 0;
+    return static_cast<ssize_t>((w.at < pos + count ? w.at : pos + count) - pos);
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/formatting.hpp>
+
+extern char _rodata_start;
+extern char _rodata_end;
+
+// sites logging below this level are not compiled in, build with -DKLOG_MIN_LEVEL=0 for debug logs
+#ifndef KLOG_MIN_LEVEL
+#define KLOG_MIN_LEVEL 1
+#endif
+
+// kernel log: logging only copies the arguments into a ring of binary records, next to the site which logged them.
+// A worker formats the records to the serial port every FLUSH_INTERVAL ticks - warnings and errors right away, and
+// everything right away before start_flusher. The ring keeps the latest records for /dmesg, as text
+namespace klog {
+    enum class level : uint8_t {
+        debug,
+        info,
+        warn,
+        err,
+    };
+    constexpr level MIN_LEVEL = static_cast<level>(KLOG_MIN_LEVEL);
+
+    constexpr uint32_t RING_SIZE = 32768;
+    constexpr uint32_t FLUSH_INTERVAL = 10;
+    constexpr size_t MAX_STRING = 96;      // longer strings are cut
+    constexpr size_t MAX_ARGS_SIZE = 480;  // of a record's arguments
+
+    // a line of code which logs, the same for every record it logs
+    struct site {
+        level lvl;
+        const char *file;
+        uint32_t line;
+        const char *function;
+    };
+
+    // where records are formatted to
+    struct sink {
+        void (*put)(const char *s, size_t length, void *ctx);
+        void *ctx;
+
+        inline void write(const char *s, size_t length) const { put(s, length, ctx); }
+    };
+
+    // reads back the arguments after args, and formats them to out
+    using format_fn = void (*)(const char *args, const sink &out);
+
+    // called by the macros in logging.hpp
+    void __append(const site &where, format_fn format, const char *args, size_t args_size);
+
+    void __format_string(const sink &out, const char *s, size_t length);
+    void __format_int(const sink &out, int val);
+    void __format_uint(const sink &out, uint val);
+    void __format_hex(const sink &out, uintptr_t val);
+
+    // how an argument is kept in a record
+    enum class __kind {
+        none,       // colors only matter for the tty
+        character,
+        integer,
+        unsigned_integer,
+        hex,
+        error,
+        string,     // its length in front, then its address if it is read-only data, else a copy
+    };
+    constexpr uint16_t __STATIC_STRING = 0x8000;  // in the length of a string kept by address
+
+    // everything else is kept as an int, like log_driver promotes it - wider types would be cut silently
+    template <class T> struct __arg {
+        static_assert(sizeof(T) <= sizeof(int), "klog can't keep this argument type");
+        static constexpr __kind kind = __kind::integer;
+    };
+    template <class T> struct __arg<const T> : __arg<T> {};
+    template <> struct __arg<char> { static constexpr __kind kind = __kind::character; };
+    template <> struct __arg<uint> { static constexpr __kind kind = __kind::unsigned_integer; };
+    template <> struct __arg<formatting::hex> { static constexpr __kind kind = __kind::hex; };
+    template <> struct __arg<errno> { static constexpr __kind kind = __kind::error; };
+    template <> struct __arg<formatting::color_pair> { static constexpr __kind kind = __kind::none; };
+    template <size_t N> struct __arg<char[N]> { static constexpr __kind kind = __kind::string; };
+    template <> struct __arg<const char *> { static constexpr __kind kind = __kind::string; };
+    template <> struct __arg<char *> { static constexpr __kind kind = __kind::string; };
+    template <> struct __arg<string_buf> { static constexpr __kind kind = __kind::string; };
+
+    // the argument types, as the records keep them - so sites with the same kinds of arguments share __format
+    template <class T> struct __stored { using type = T; };
+    template <class T> struct __stored<const T> : __stored<T> {};
+    template <size_t N> struct __stored<char[N]> { using type = const char *; };
+    template <> struct __stored<char *> { using type = const char *; };
+
+    // strings kept by address take their length and a pointer, arrays are copied up to their size
+    template <class T> struct __array_size { static constexpr size_t value = MAX_STRING; };
+    template <class T> struct __array_size<const T> : __array_size<T> {};
+    template <size_t N> struct __array_size<char[N]> { static constexpr size_t value = N < MAX_STRING ? N : MAX_STRING; };
+
+    template <class T>
+    constexpr size_t __max_size() {
+        switch (__arg<T>::kind) {
+            case __kind::none:
+                return 0;
+            case __kind::character:
+                return 1;
+            case __kind::string:
+                return sizeof(uint16_t) + (__array_size<T>::value < sizeof(char *) ? sizeof(char *) : __array_size<T>::value);
+            default:
+                return sizeof(uintptr_t);
+        }
+    }
+
+    template <class T>
+    inline void __put(char *&p, const T &val) {
+        __builtin_memcpy(p, &val, sizeof(T));
+        p += sizeof(T);
+    }
+
+    template <class T>
+    inline T __get(const char *&p) {
+        T val;
+        __builtin_memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+
+    template <class T>
+    inline void __encode(char *&p, const T &arg) {
+        constexpr __kind kind = __arg<T>::kind;
+        if constexpr (kind == __kind::character) {
+            __put<char>(p, arg);
+        } else if constexpr (kind == __kind::integer) {
+            __put<int>(p, arg);
+        } else if constexpr (kind == __kind::unsigned_integer) {
+            __put<uint>(p, arg);
+        } else if constexpr (kind == __kind::error) {
+            __put<errno>(p, arg);
+        } else if constexpr (kind == __kind::hex) {
+            __put<uintptr_t>(p, arg.val);
+        } else if constexpr (kind == __kind::string) {
+            string_buf s {arg};
+            if (&_rodata_start <= s.data && s.data < &_rodata_end && s.length < __STATIC_STRING) {
+                // string literals, mostly
+                __put<uint16_t>(p, __STATIC_STRING | s.length);
+                __put<const char *>(p, s.data);
+            } else {
+                uint16_t length = s.length < MAX_STRING ? s.length : MAX_STRING;
+                __put<uint16_t>(p, length);
+                __builtin_memcpy(p, s.data, length);
+                p += length;
+            }
+        }
+    }
+
+    template <class T>
+    inline void __decode(const char *&p, const sink &out) {
+        constexpr __kind kind = __arg<T>::kind;
+        if constexpr (kind == __kind::character) {
+            out.write(p++, 1);
+        } else if constexpr (kind == __kind::integer) {
+            __format_int(out, __get<int>(p));
+        } else if constexpr (kind == __kind::unsigned_integer) {
+            __format_uint(out, __get<uint>(p));
+        } else if constexpr (kind == __kind::error) {
+            const char *name = formatting::errno_name(__get<errno>(p));
+            __format_string(out, name, strlen(name));
+        } else if constexpr (kind == __kind::hex) {
+            __format_hex(out, __get<uintptr_t>(p));
+        } else if constexpr (kind == __kind::string) {
+            uint16_t length = __get<uint16_t>(p);
+            if (length & __STATIC_STRING) {
+                __format_string(out, __get<const char *>(p), length & ~__STATIC_STRING);
+            } else {
+                __format_string(out, p, length);
+                p += length;
+            }
+        }
+    }
+
+    template <class... Args>
+    void __format(const char *args, const sink &out) {
+        (__decode<Args>(args, out), ...);
+    }
+
+    template <class... Args>
+    inline void log(const site &where, const Args &...args) {
+        constexpr size_t max_size = (__max_size<Args>() + ... + 0);
+        static_assert(max_size <= MAX_ARGS_SIZE, "too many arguments to log");
+        char buf[max_size + 1];
+        char *p = buf;
+        (__encode<Args>(p, args), ...);
+        __append(where, __format<typename __stored<Args>::type...>, buf, p - buf);
+    }
+
+    // start formatting info and debug records from a worker, after scheduler::init_workqueue
+    void start_flusher();
+    // format all records which were not formatted yet, may be called from interrupt context
+    void flush();
+    // flush without waiting for locks, kpanic only
+    void flush_panic();
+    // records which were overwritten before they were formatted
+    uint32_t lost();
+
+    // the records in the ring as text lines with the time, the file contents of /dmesg
+    // the ring moves on while it is read, so pos is only roughly where the last read ended
+    ssize_t read_text(char *buf, size_t count, uint64_t pos);
+}
@@ -6,12 +6,18 @@
 #include <kernel/memory/page_allocator.hpp>
 #include <kernel/interrupts/init.hpp>
 #include <kernel/interrupts/pic.hpp>
+#include <kernel/syscalls/init.hpp>
+#include <kernel/smp/init.hpp>
 #include <kernel/scheduler/init.hpp>
+#include <kernel/scheduler/fpu.hpp>
 #include <kernel/scheduler/task.hpp>
+#include <kernel/scheduler/workqueue.hpp>
 #include <kernel/fs/tar.hpp>
+#include <kernel/fs/procfs.hpp>
 #include <kernel/fs/vfs.hpp>
 #include <kernel/scheduler/elf.hpp>
 #include <kernel/util/asm_wrap.hpp>
+#include <kernel/clock/init.hpp>
 
 static void show_splash();
 
@@ -42,7 +48,7 @@ static void main_task() {
     void *entry;
     e = elf_loader::load_elf(f, entry);
     kassert(e == errno::ok);
-    asm_enter_usermode(entry, memory::kmem_alloc_4k());
+    asm_enter_usermode(entry, elf_loader::map_user_stack());
 }
 
 
@@ -57,10 +63,19 @@ extern "C" void kmain(multiboot_info_t *multiboot_data, uint multiboot_magic) {
 
     interrupts::initialize();
     interrupts::init_pic();
+    syscalls::initialize();
+    scheduler::fpu::initialize();
     interrupts::start();
+    serial::enable_interrupts();
+    clock::initialize();
+    smp::initialize();
 
     fs::register_initrd("/initrd");
+    fs::register_procfs("/proc");
+    fs::register_devfs("/dev");
     scheduler::initialize();
+    scheduler::init_workqueue();
+    klog::start_flusher();
     scheduler::task *main = scheduler::task::allocate(main_task);
     kassert(main != nullptr);
     scheduler::link_task(main);
@@ -1,10 +1,24 @@
 #pragma once
 #include <kernel/serial.hpp>
+#include <kernel/util/spinlock.hpp>
+#include <kernel/klog.hpp>
+
+// serializes log lines from all CPUs
+extern spinlock log_lock;
 
 #define LOCKED(expr) do { \
-    scoped_intlock lock; \
+    scoped_spinlock lock {log_lock}; \
     expr; \
 } while (0);
-#define TINY_INFO(expr...) LOCKED(serial_driver::write("[INFO] ", expr, " in file ", __FILE__, ':', __LINE__, ' ', '(', __PRETTY_FUNCTION__, ')', '\n'))
-#define TINY_WARN(expr...) LOCKED(serial_driver::write("[WARN] ", expr, " in file ", __FILE__, ':', __LINE__, ' ', '(', __PRETTY_FUNCTION__, ')', '\n'))
-#define TINY_ERR(expr...)  LOCKED(serial_driver::write("[ERR!] ", expr, " in file ", __FILE__, ':', __LINE__, ' ', '(', __PRETTY_FUNCTION__, ')', '\n'))
+
+// log a line to the kernel log, see klog.hpp - sites below KLOG_MIN_LEVEL are left out of the build
+#define TINY_LOG(lvl, expr...) do { \
+    if constexpr (lvl >= klog::MIN_LEVEL) { \
+        static constexpr klog::site __klog_site {lvl, __FILE__, __LINE__, __PRETTY_FUNCTION__}; \
+        klog::log(__klog_site, expr); \
+    } \
+} while (0)
+#define TINY_DEBUG(expr...) TINY_LOG(klog::level::debug, expr)
+#define TINY_INFO(expr...)  TINY_LOG(klog::level::info, expr)
+#define TINY_WARN(expr...)  TINY_LOG(klog::level::warn, expr)
+#define TINY_ERR(expr...)   TINY_LOG(klog::level::err, expr)
@@ -1,8 +1,8 @@
 #include <kernel/util.hpp>
 #include <kernel/memory/gdt.hpp>
 #include <kernel/util/asm_wrap.hpp>
-#include <kernel/scheduler/init.hpp>
-using scheduler::global_tss;
+#include <kernel/smp/percpu.hpp>
+#include <kernel/util/string.hpp>
 
 struct gdt_entry {
     uint32_t base;
@@ -72,8 +72,8 @@ static consteval encoded_gdt_entry gdt_entry(gdt_entry source) {
 // 1 - 1 if 64-bit code segment
 // 0 - reserved
 
-__attribute__((aligned(4)))
-encoded_gdt_array<6> gdt_arr { concat_gdt_entries(  // global
+// template for the GDT of every CPU, bases of the TSS and the per-CPU segment are set by init_cpu_gdt
+static constexpr encoded_gdt_array<memory::GDT_ENTRIES> gdt_template { concat_gdt_entries(
     // null descriptor
     gdt_entry({ .base = 0, .limit = 0,       .access_byte = 0,          .flags = 0      }),
     // kernel cs
@@ -85,27 +85,50 @@ encoded_gdt_array<6> gdt_arr { concat_gdt_entries(  // global
     // user ds
     gdt_entry({ .base = 0, .limit = 0xFFFFF, .access_byte = 0b11110010, .flags = 0b1100 }),
     // TSS
-    gdt_entry({ .base = 0, .limit = sizeof(global_tss), .access_byte = 0b10001001, .flags = 0 })) };
+    gdt_entry({ .base = 0, .limit = sizeof(memory::tss_entry), .access_byte = 0b10001001, .flags = 0 }),
+    // per-CPU data, kernel only
+    gdt_entry({ .base = 0, .limit = sizeof(smp::percpu), .access_byte = 0b10010010, .flags = 0b0100 })) };
 
-struct {
-    unsigned short size;
-    unsigned int address;
-} __attribute__((packed, aligned(4))) gdtr;  // global
+static_assert(sizeof(gdt_template) == sizeof(smp::percpu::gdt));
+
+static void set_base(uint8_t *gdt, uint selector, uint32_t base) {
+    gdt[selector + 2] = base & 0xFF;
+    gdt[selector + 3] = (base >> 8) & 0xFF;
+    gdt[selector + 4] = (base >> 16) & 0xFF;
+    gdt[selector + 7] = (base >> 24) & 0xFF;
+}
 
 void memory::init_gdt() {
+    smp::percpu &bsp = smp::get_cpu(0);
+    init_cpu_gdt(bsp);
+    bsp.online = true;
+}
+
+void memory::init_cpu_gdt(smp::percpu &cpu) {
+    struct {
+        unsigned short size;
+        unsigned int address;
+    } __attribute__((packed, aligned(4))) gdtr;
+
     // make sure LDT is cleared
     gdtr.address = 0;
     gdtr.size = 0;
     asm_lldt(&gdtr);
+
     // set GDT
-    uint32_t tss_addr = (uint32_t)&global_tss;
-    gdt_arr.a[0x28 + 2] = tss_addr & 0xFF;
-    gdt_arr.a[0x28 + 3] = (tss_addr >> 8) & 0xFF;
-    gdt_arr.a[0x28 + 4] = (tss_addr >> 16) & 0xFF;
-    gdt_arr.a[0x28 + 7] = (tss_addr >> 24) & 0xFF;
-    gdtr.address = reinterpret_cast<unsigned int>(&gdt_arr.a);
-    gdtr.size = sizeof(gdt_arr) - 1;
+    cpu.self = &cpu;
+    uint8_t *gdt = reinterpret_cast<uint8_t *>(cpu.gdt);
+    memcpy(gdt, gdt_template.a, sizeof(gdt_template));
+    set_base(gdt, tss_selector, reinterpret_cast<uint32_t>(&cpu.tss));
+    set_base(gdt, percpu_ds, reinterpret_cast<uint32_t>(&cpu));
+    gdtr.address = reinterpret_cast<unsigned int>(gdt);
+    gdtr.size = sizeof(gdt_template) - 1;
     asm_lgdt(&gdtr);
+    asm volatile("movw %w0, %%gs" :: "r"(percpu_ds) : "memory");
+
     // set TSS
+    memset(&cpu.tss, 0, sizeof(cpu.tss));
+    cpu.tss.ss0 = 0x10;
+    cpu.tss.iomap_base = sizeof(cpu.tss);  // no I/O permission bitmap
     asm_flush_tss();
 }
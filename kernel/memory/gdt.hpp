@@ -1,6 +1,50 @@
 #pragma once
+#include <kernel/util.hpp>
+
+namespace smp {
+    struct percpu;
+}
+
 namespace memory {
     constexpr int user_cs = 0x1b;
     constexpr int kernel_cs = 0x08;
+    constexpr int tss_selector = 0x28;
+    constexpr int percpu_ds = 0x30;  // loaded into gs while in the kernel, see smp/percpu.hpp
+    constexpr uint GDT_ENTRIES = 7;
+
+    struct __attribute__((packed)) tss_entry {
+        uint32_t prev_tss;
+        uint32_t esp0;  // The stack pointer to load when changing to kernel mode
+        uint32_t ss0;   // The stack segment to load when changing to kernel mode
+        // Everything below here is unused.
+        uint32_t esp1;  // esp and ss 1 and 2 would be used when switching to rings 1 or 2
+        uint32_t ss1;
+        uint32_t esp2;
+        uint32_t ss2;
+        uint32_t cr3;
+        uint32_t eip;
+        uint32_t eflags;
+        uint32_t eax;
+        uint32_t ecx;
+        uint32_t edx;
+        uint32_t ebx;
+        uint32_t esp;
+        uint32_t ebp;
+        uint32_t esi;
+        uint32_t edi;
+        uint32_t es;
+        uint32_t cs;
+        uint32_t ss;
+        uint32_t ds;
+        uint32_t fs;
+        uint32_t gs;
+        uint32_t ldt;
+        uint16_t trap;
+        uint16_t iomap_base;
+    };
+
+    // sets up the GDT and TSS of the bootstrap processor
     void init_gdt();
+    // sets up the GDT and TSS of the calling processor - each CPU has its own, pointing to its per-CPU data
+    void init_cpu_gdt(smp::percpu &cpu);
 }
@@ -372,6 +372,16 @@ static_assert(buddies_in_page == 64, "wrong amount of buddies, buddy");
 __attribute__((aligned(4096)))
 static uint32_t first_page_directory[1024];
 
+// lock order: kmem_lock, then map_lock - _map_page allocates page tables before taking map_lock
+static spinlock kmem_lock;  // buddies
+static spinlock map_lock;   // page tables
+static spinlock hmem_lock;  // hmem free list
+
+// uncached device memory is mapped here, with a page table shared by all page directories
+static constexpr uint32_t MMIO_WINDOW_START = 0xFF800000;
+static constexpr uint32_t MMIO_WINDOW_END = 0xFFC00000;  // hmem mappings are above
+static uint32_t mmio_next = MMIO_WINDOW_START;
+
 template <size_t N>
 static void *buddy_alloc() {
     buddy &first = kmem_allocator.first_N<N>();
@@ -423,7 +433,7 @@ static void kmem_buddy_new() {
 }
 
 void *memory::kmem_alloc_4k() {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     void *result = buddy_alloc<4096>();
     if (result == nullptr) [[unlikely]] {
@@ -435,7 +445,7 @@ void *memory::kmem_alloc_4k() {
 }
 
 void *memory::kmem_alloc_8k() {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     void *result = buddy_alloc<8192>();
     if (result == nullptr) [[unlikely]] {
@@ -447,7 +457,7 @@ void *memory::kmem_alloc_8k() {
 }
 
 void *memory::kmem_alloc_16k() {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     void *result = buddy_alloc<16384>();
     if (result == nullptr) [[unlikely]] {
@@ -459,7 +469,7 @@ void *memory::kmem_alloc_16k() {
 }
 
 void *memory::kmem_alloc_32k() {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     void *result = buddy_alloc<32768>();
     if (result == nullptr) [[unlikely]] {
@@ -471,7 +481,7 @@ void *memory::kmem_alloc_32k() {
 }
 
 void memory::kmem_free_4k(void *ptr) {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     uint32_t buddy_rel_pos = (uint32_t)ptr - ((uint32_t)buddy_array) - buddy_array_size;
     buddy &bud = buddy_array[buddy_rel_pos >> 19];
@@ -481,7 +491,7 @@ void memory::kmem_free_4k(void *ptr) {
 }
 
 void memory::kmem_free_8k(void *ptr) {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     uint32_t buddy_rel_pos = (uint32_t)ptr - ((uint32_t)buddy_array) - buddy_array_size;
     buddy &bud = buddy_array[buddy_rel_pos >> 19];
@@ -491,7 +501,7 @@ void memory::kmem_free_8k(void *ptr) {
 }
 
 void memory::kmem_free_16k(void *ptr) {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     uint32_t buddy_rel_pos = (uint32_t)ptr - ((uint32_t)buddy_array) - buddy_array_size;
     buddy &bud = buddy_array[buddy_rel_pos >> 19];
@@ -501,7 +511,7 @@ void memory::kmem_free_16k(void *ptr) {
 }
 
 void memory::kmem_free_32k(void *ptr) {
-    scoped_intlock lock;  // block interrupts
+    scoped_spinlock lock {kmem_lock};  // block interrupts and other CPUs
 
     uint32_t buddy_rel_pos = (uint32_t)ptr - ((uint32_t)buddy_array) - buddy_array_size;
     buddy &bud = buddy_array[buddy_rel_pos >> 19];
@@ -512,39 +522,76 @@ void memory::kmem_free_32k(void *ptr) {
 
 reg_t memory::new_page_directory() {
     uint32_t *page_table = static_cast<uint32_t *>(kmem_alloc_4k());  // TODO allocate this page table in hmem
-    memcpy(page_table, first_page_directory, 4096);
+    copy_page(page_table, first_page_directory);
     return reinterpret_cast<reg_t>(phys_t::from_kmem(page_table).value());
 }
 
+void memory::free_page_directory(reg_t page_directory) {
+    kassert_not_interrupt;
+    uint32_t *pd = reinterpret_cast<uint32_t *>(phys_t(page_directory).to_virt());
+    constexpr uint32_t present = (uint32_t)page_flag::present;
+    constexpr uint32_t user = (uint32_t)page_flag::user;
+    constexpr uint32_t page_size = 1 << 7;  // 4MB page, not a page table
+
+    // hmem grows down, so every page allocated from it so far is above its current end
+    phys_t hmem_end;
+    {
+        scoped_spinlock lock {hmem_lock};
+        hmem_end = hmem_phys_end;
+    }
+
+    for (uint32_t i = 0; i < 1024; i++) {
+        uint32_t dir_entry = pd[i];
+        if ((dir_entry & present) == 0 || (dir_entry & page_size) != 0 || dir_entry == first_page_directory[i])
+            continue;  // nothing there, or shared with the kernel
+        uint32_t *page_table = reinterpret_cast<uint32_t *>(phys_t(dir_entry).align_page_down().to_virt());
+        if (i < (0xC0000000 >> 22)) {
+            if ((dir_entry & user) == 0)
+                continue;  // the low identity mapping, copied while booting other CPUs
+            for (uint32_t j = 0; j < 1024; j++) {
+                // user pages are in hmem, except for pages shared with the kernel (e.g. the time page)
+                phys_t page = phys_t(page_table[j]).align_page_down();
+                if ((page_table[j] & present) && page.value() >= hmem_end.value())
+                    hmem_free_page(page);
+            }
+        }
+        // user page tables, and the task's own hmem mapping table
+        kmem_free_4k(page_table);
+    }
+    kmem_free_4k(pd);
+}
+
 static void _map_page(void *virt, uint32_t pde_flags, uint32_t pte, uint32_t *pd /* default first_page_directory*/) {
-    scoped_intlock lock;  // block interrupts
     kassert(((uint32_t)virt & 0xFFF) == 0);  // make sure address is page aligned
 
     uint32_t dir_index = (uint32_t)virt >> 22;
     uint32_t tab_index = (uint32_t)virt >> 12 & 0x03FF;
 
     uint32_t &dir_entry = pd[dir_index];
-    uint32_t *page_table;
+    uint32_t *new_page_table = nullptr;
 
-    if (dir_entry & (uint32_t)page_flag::present) {
-        // page table already exists!
-        page_table = (uint32_t *)(void *)(phys_t(dir_entry).align_page_down().to_virt());
-        page_table[tab_index] = pte;
-    } else {
-        // need to allocate new page table
-        page_table = (uint32_t *)kmem_alloc_4k();
-        if (dir_entry & (uint32_t)page_flag::present) [[unlikely]] {
-            // kmem_alloc_4k created a page table for us, so we don't need this one anymore
-            kmem_free_4k(page_table);
-            page_table = (uint32_t *)(void *)(phys_t(dir_entry).align_page_down().to_virt());
-            page_table[tab_index] = pte;
-            return;
+    if ((__atomic_load_n(&dir_entry, __ATOMIC_ACQUIRE) & (uint32_t)page_flag::present) == 0) {
+        // might need to allocate new page table - do it before taking map_lock, kmem_alloc_4k may map pages itself
+        new_page_table = (uint32_t *)kmem_alloc_4k();
+        clear_page(new_page_table);
+    }
+
+    {
+        scoped_spinlock lock {map_lock};  // block interrupts and other CPUs
+        if ((dir_entry & (uint32_t)page_flag::present) == 0) {
+            // page directory entries are never removed, so it was not present before either
+            kassert(new_page_table != nullptr);
+            dir_entry = phys_t::from_kmem(new_page_table).value() | pde_flags;
+            new_page_table = nullptr;
         }
-        // normal path
-        memset(page_table, 0, 4096);
-        dir_entry = phys_t::from_kmem(page_table).value() | pde_flags;
+        uint32_t *page_table = (uint32_t *)(void *)(phys_t(dir_entry).align_page_down().to_virt());
         page_table[tab_index] = pte;
     }
+
+    if (new_page_table != nullptr) [[unlikely]] {
+        // somebody else (maybe kmem_alloc_4k) created the page table for us, so we don't need this one anymore
+        kmem_free_4k(new_page_table);
+    }
 }
 
 void memory::map_user_page(void *virt, phys_t phys, bool writable) {
@@ -559,11 +606,59 @@ void memory::map_user_page(void *virt, phys_t phys, bool writable) {
     _map_page(virt, prwr, pte, reinterpret_cast<uint32_t *>(phys_t(cr3).to_virt()));
 }
 
+bool memory::user_virt_to_phys(const void *virt, bool writable, phys_t &phys) {
+    uint32_t required = (uint32_t)page_flag::present | (uint32_t)page_flag::user;
+    if (writable)
+        required |= (uint32_t)page_flag::write;
+
+    if ((uint32_t)virt >= 0xC0000000)
+        return false;
+
+    uint32_t cr3;
+    asm volatile("movl %%cr3, %0" : "=r"(cr3) ::);
+    uint32_t *page_dir = reinterpret_cast<uint32_t *>(phys_t(cr3).to_virt());
+    uint32_t dir_entry = page_dir[(uint32_t)virt >> 22];
+    if ((dir_entry & required) != required)
+        return false;
+
+    // page tables are always in kmem
+    uint32_t *page_table = (uint32_t *)(void *)(phys_t(dir_entry).align_page_down().to_virt());
+    uint32_t pte = page_table[(uint32_t)virt >> 12 & 0x03FF];
+    if ((pte & required) != required)
+        return false;
+
+    phys = phys_t(phys_t(pte).align_page_down().value() | ((uint32_t)virt & 0xFFF));
+    return true;
+}
+
+void *memory::map_mmio_page(phys_t phys) {
+    kassert((phys.value() & 0xFFF) == 0);
+    uint32_t virt = __atomic_fetch_add(&mmio_next, 4096, __ATOMIC_RELAXED);
+    kassert(virt < MMIO_WINDOW_END);
+
+    constexpr uint32_t prwr = (uint32_t)page_flag::present | (uint32_t)page_flag::write;
+    constexpr uint32_t uncached = (uint32_t)page_flag::cache_disable | (uint32_t)page_flag::write_through;
+    _map_page((void *)virt, prwr, phys.value() | prwr | uncached);
+    return (void *)virt;
+}
+
+reg_t memory::kernel_page_directory() {
+    return phys_t::from_kmem(first_page_directory).value();
+}
+
+void memory::set_low_identity_mapping(bool enabled) {
+    // the first 4MB of physical memory are mapped at 0xC0000000 too, so reuse that page table
+    scoped_spinlock lock {map_lock};
+    first_page_directory[0] = enabled ? first_page_directory[0xC0000000 >> 22] : 0;
+    reg_t cr3;
+    asm volatile("movl %%cr3, %0 ; movl %0, %%cr3" : "=r"(cr3) :: "memory");  // flush TLB
+}
+
 // hmem linked list physical pages allocator
 // do NOT call from interrupt context!
 phys_t memory::hmem_alloc_page() {
     kassert_not_interrupt;
-    scoped_preemptlock lock;
+    scoped_spinlock lock {hmem_lock};
 
     if (hmem_phys_list.value() == 0) {
         // no value in linked list, must reduce hmem_phys_end
@@ -583,7 +678,7 @@ phys_t memory::hmem_alloc_page() {
 
 void memory::hmem_free_page(phys_t addr) {
     kassert_not_interrupt;
-    scoped_preemptlock lock;
+    scoped_spinlock lock {hmem_lock};
 
     kassert(addr.value() >= hmem_phys_end.value());
     // add addr to hmem_phys_list
@@ -598,7 +693,7 @@ void memory::hmem_free_page(phys_t addr) {
 }
 
 memory::scoped_hmem_mapping::scoped_hmem_mapping(phys_t addr) {
-    kassert(scheduler::current_task != 0);
+    kassert(scheduler::get_current_task() != 0);
     char *&hmem_end = scheduler::get_current_task_internal()->hmem_end;
     hmem_end -= 4096;
     m_virt = hmem_end;
@@ -621,7 +716,7 @@ memory::scoped_hmem_mapping::scoped_hmem_mapping(phys_t addr) {
 }
 
 memory::scoped_hmem_mapping::~scoped_hmem_mapping() {
-    kassert(scheduler::current_task != 0);
+    kassert(scheduler::get_current_task() != 0);
     char *&hmem_end = scheduler::get_current_task_internal()->hmem_end;
     kassert(hmem_end == m_virt)
     hmem_end += 4096;
@@ -660,7 +755,7 @@ void memory::init_page_allocator() {
 
     uint32_t initially_mapped = kmem_phys_end.to_virt();
 
-    memset(first_page_directory, 0, 4096);
+    clear_page(first_page_directory);
     for (uint32_t addr = 0xC0000000; addr < initially_mapped; addr += 4096) {
         // map whole kernel as present + write
         constexpr uint32_t prwr = (uint32_t)page_flag::present | (uint32_t)page_flag::write;
@@ -678,7 +773,12 @@ void memory::init_page_allocator() {
 
         // allocate new page table
         uint32_t *page_table = (uint32_t *)kmem_alloc_4k();
-        memset(page_table, 0, 4096);
+        clear_page(page_table);
         dir_entry = phys_t::from_kmem(page_table).value() | (uint32_t)page_flag::present | (uint32_t)page_flag::write;
     }
+
+    // and for the MMIO window, so page directories copied before a device is mapped see it too
+    uint32_t *mmio_page_table = (uint32_t *)kmem_alloc_4k();
+    clear_page(mmio_page_table);
+    first_page_directory[MMIO_WINDOW_START >> 22] = phys_t::from_kmem(mmio_page_table).value() | (uint32_t)page_flag::present | (uint32_t)page_flag::write;
 }
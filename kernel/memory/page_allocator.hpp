@@ -74,6 +74,15 @@ namespace memory {
 
     // used when creating a new process
     reg_t new_page_directory(void);
+    // frees a page directory which is not in use anymore (by any CPU), with the user pages it maps,
+    // and the page tables it doesn't share with the kernel's - do NOT call from interrupt context
+    void free_page_directory(reg_t page_directory);
+    // physical address of the page directory new ones are copied from, which only maps the kernel
+    reg_t kernel_page_directory(void);
+    // identity map the first 4MB in the kernel page directory, while booting other CPUs
+    void set_low_identity_mapping(bool enabled);
+    // map a page of device registers (uncached) into kernel memory, mappings are never removed
+    void *map_mmio_page(phys_t phys);
 
     // hmem has only one allocation size (4k), and is based on a simple linked list
     // do NOT call from interrupt context!
@@ -130,4 +139,6 @@ namespace memory {
 
     // called from a process context - virt should not be already mapped, it will override
     void map_user_page(void *virt, phys_t phys, bool writable);
+    // translate a user address in the current address space, fails if it is not mapped as a user page (or not writable, if asked)
+    bool user_virt_to_phys(const void *virt, bool writable, phys_t &phys);
 }
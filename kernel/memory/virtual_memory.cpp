@@ -1,8 +1,8 @@
 #include <kernel/memory/virtual_memory.hpp>
 
 memory::virtual_memory::~virtual_memory() {
-    // destroy all vm areas
-    kpanic("todo");
+    // destroy all vm areas - nothing creates them yet, user pages are mapped directly
+    kassert(m_areas.empty());
 }
 
 // static
@@ -0,0 +1,87 @@
+#include <kernel/scheduler/accounting.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/clock/init.hpp>
+#include <kernel/logging.hpp>
+
+using namespace scheduler;
+
+void scheduler::note_wakeup(task *t) {
+    uint64_t now = clock::now_ns();
+    t->accounting.runnable_since = now;
+    latency::note_wakeup(t, now);
+    // seen by whoever picks the task after it is unblocked
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+uint64_t scheduler::syscall_enter() {
+    return clock::now_ns();
+}
+
+void scheduler::syscall_exit(uint64_t entered) {
+    task_accounting &acct = get_current_task()->accounting;
+    acct.syscalls++;
+    acct.syscall_ns += clock::now_ns() - entered;
+}
+
+namespace {
+    struct stats_buffer {
+        task_stats *out;
+        uint max;
+        uint count;
+    };
+}
+
+uint scheduler::get_task_stats(task_stats *out, uint max) {
+    stats_buffer buffer {out, max, 0};
+    for_each_task([](task *t, void *arg) {
+        stats_buffer &b = *static_cast<stats_buffer *>(arg);
+        if (b.count == b.max)
+            return;
+        task_stats &s = b.out[b.count++];
+        s.pid = t->pid;
+        s.cpu = t->scheduling.cpu;
+        s.priority = t->scheduling.effective_priority;
+        s.running = __atomic_load_n(&t->scheduling.on_cpu, __ATOMIC_RELAXED) != 0;
+        s.blocked = t->blocking.is_blocked();
+        s.accounting = t->accounting;
+    }, &buffer);
+    return buffer.count;
+}
+
+static inline uint32_t ns_to_ms(uint64_t ns) {
+    return static_cast<uint32_t>(div64_32(ns, 1000000));
+}
+
+void scheduler::dump_task_stats() {
+    kassert_not_interrupt;
+    constexpr uint MAX_STATS = 4096 / sizeof(task_stats);
+    task_stats *stats = static_cast<task_stats *>(memory::kmem_alloc_4k());
+    uint count = get_task_stats(stats, MAX_STATS);
+
+    // the busiest first, by insertion sort - there are few tasks
+    uint32_t total_ticks = 0;
+    for (uint i = 0; i < count; i++) {
+        task_stats s = stats[i];
+        uint32_t ticks = s.accounting.user_ticks + s.accounting.kernel_ticks;
+        total_ticks += ticks;
+        uint j = i;
+        for (; j > 0 && stats[j - 1].accounting.user_ticks + stats[j - 1].accounting.kernel_ticks < ticks; j--)
+            stats[j] = stats[j - 1];
+        stats[j] = s;
+    }
+
+    LOCKED(serial_driver::write("[TOP] ", count, " tasks, ", total_ticks, " ticks accounted\n"));
+    for (uint i = 0; i < count; i++) {
+        const task_stats &s = stats[i];
+        const task_accounting &a = s.accounting;
+        uint32_t ticks = a.user_ticks + a.kernel_ticks;
+        uint32_t percent = total_ticks == 0 ? 0 : static_cast<uint32_t>(div64_32(static_cast<uint64_t>(ticks) * 100, total_ticks));
+        char state = s.running ? 'R' : s.blocked ? 'S' : 'W';
+        LOCKED(serial_driver::write("[TOP] pid ", s.pid, " cpu ", s.cpu, " prio ", s.priority, ' ', state,
+                " cpu% ", percent, " user ", a.user_ticks, " sys ", a.kernel_ticks,
+                " vcsw ", a.voluntary_switches, " ivcsw ", a.involuntary_switches, " wait_ms ", ns_to_ms(a.wait_ns),
+                " syscalls ", a.syscalls, " syscall_ms ", ns_to_ms(a.syscall_ns), '\n'));
+    }
+    memory::kmem_free_4k(stats);
+}
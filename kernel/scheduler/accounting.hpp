@@ -0,0 +1,43 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// per-task CPU time accounting: the timer tick samples where each CPU is, the scheduler counts switches and
+// the time runnable tasks wait for a CPU, and the system call entry counts calls and the time spent in them
+namespace scheduler {
+    struct task;
+
+    // the accounting subsystem of a task - only the CPU running the task writes the counters,
+    // except runnable_since, which a waker sets for a blocked task
+    struct task_accounting {
+        uint32_t user_ticks = 0;            // timer ticks which found the task in usermode
+        uint32_t kernel_ticks = 0;          // timer ticks which found the task in the kernel
+        uint32_t voluntary_switches = 0;    // switched out by yielding or blocking
+        uint32_t involuntary_switches = 0;  // switched out by the timer
+        uint32_t syscalls = 0;
+        uint64_t syscall_ns = 0;            // from entering to leaving system calls, including preemption
+        uint64_t wait_ns = 0;               // runnable, but waiting for a CPU
+        uint64_t runnable_since = 0;        // when the task last became runnable without running, 0 otherwise
+    };
+
+    // a snapshot of a task for statistics
+    struct task_stats {
+        uint32_t pid;
+        uint cpu;
+        int priority;     // effective priority
+        bool running;
+        bool blocked;
+        task_accounting accounting;
+    };
+
+    // called by a waker right before unblocking t
+    void note_wakeup(task *t);
+    // called at the entry and exit of a system call, by the calling task
+    uint64_t syscall_enter();
+    void syscall_exit(uint64_t entered);
+
+    // snapshot up to max linked tasks, including the idle tasks, returns the number of tasks written
+    // tasks migrating between run queues meanwhile may be missed, and the counters are not read atomically
+    uint get_task_stats(task_stats *out, uint max);
+    // write a table of all tasks to the serial port, the busiest first, do NOT call from interrupt context
+    void dump_task_stats();
+}
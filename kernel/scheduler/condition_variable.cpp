@@ -0,0 +1,15 @@
+#include <kernel/scheduler/condition_variable.hpp>
+
+void scheduler::concurrency::condition_variable::wait(mutex &mtx) {
+    // not applicable for interrupt context
+    kassert_not_interrupt;
+    // lock preemption, so that no other task can notify between releasing the mutex and blocking
+    scheduler::preempt_up();
+    m_queue.prepare_to_wait(true);
+    mtx.unlock();
+    // unlock preemption and yield
+    // we won't be resumed until we're notified
+    scheduler::preempt_down();
+    scheduler::yield();
+    mtx.lock();
+}
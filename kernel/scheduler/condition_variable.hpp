@@ -0,0 +1,32 @@
+#pragma once
+#include <kernel/scheduler/mutex.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+
+namespace scheduler {
+    namespace concurrency {
+        struct condition_variable {
+        private:
+            // all waiters are exclusive, so notify_one only wakes up one task
+            wait_queue m_queue;
+
+        public:
+            // compatible with static initialization
+            inline constexpr condition_variable() {}
+
+            // atomically release mtx and block, then lock mtx again before returning
+            // the caller must own mtx, and should re-check its condition after waking up
+            void wait(mutex &mtx);
+
+            template <class Pred>
+            inline void wait(mutex &mtx, Pred pred) {
+                while (!pred()) {
+                    wait(mtx);
+                }
+            }
+
+            // may be called from interrupt context
+            inline void notify_one() { m_queue.wake_one(); }
+            inline void notify_all() { m_queue.wake_all(); }
+        };
+    }
+}
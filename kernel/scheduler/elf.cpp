@@ -1,6 +1,7 @@
 #include <kernel/util.hpp>
 #include <kernel/scheduler/elf.hpp>
 #include <kernel/logging.hpp>
+#include <kernel/clock/time_page.hpp>
 
 typedef uint16_t Elf_Half;
 typedef uint32_t Elf_Off;
@@ -105,7 +106,7 @@ errno elf_loader::load_elf(fs::file_desc *file, void *&entry) {
                  reinterpret_cast<reg_t>(virt) < addr_end;
                  virt += 0x1000) {
 
-                TINY_INFO("map at ", formatting::hex{virt});
+                TINY_DEBUG("map at ", formatting::hex{virt});
                 // map page at [virt, virt + 4096)
                 // TODO make sure it's not overriding another page
                 memory::phys_t new_page = memory::hmem_alloc_page();
@@ -135,5 +136,17 @@ errno elf_loader::load_elf(fs::file_desc *file, void *&entry) {
         }
     }
 
+    // every user address space can read the clock, see initrd/time.h
+    clock::map_time_page();
     return errno::ok;
 }
+
+void *elf_loader::map_user_stack() {
+    for (reg_t i = 1; i <= USER_STACK_PAGES; i++) {
+        memory::phys_t page = memory::hmem_alloc_page();
+        char *virt = reinterpret_cast<char *>(USER_STACK_TOP - i * 0x1000);
+        memory::map_user_page(virt, page, true);
+        clear_page(virt);
+    }
+    return reinterpret_cast<void *>(USER_STACK_TOP);
+}
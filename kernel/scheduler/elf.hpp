@@ -4,4 +4,10 @@
 
 namespace elf_loader {
     errno load_elf(fs::file_desc *file, void *&entry);
+
+    // the user stack is right below kernel memory
+    constexpr reg_t USER_STACK_TOP = 0xC0000000;
+    constexpr reg_t USER_STACK_PAGES = 4;
+    // maps the user stack into the current address space, returns its top
+    void *map_user_stack();
 }
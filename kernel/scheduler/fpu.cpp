@@ -0,0 +1,138 @@
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/logging.hpp>
+
+using namespace scheduler;
+
+static constexpr reg_t CR0_MP = 1 << 1;   // WAIT/FWAIT trap with TS too
+static constexpr reg_t CR0_EM = 1 << 2;   // no FPU, every FPU instruction traps
+static constexpr reg_t CR0_TS = 1 << 3;   // task switched, the next FPU instruction traps
+static constexpr reg_t CR0_NE = 1 << 5;   // report FPU errors as exceptions, not through the PIC
+static constexpr reg_t CR4_OSFXSR = 1 << 9;
+static constexpr reg_t CR4_OSXMMEXCPT = 1 << 10;
+
+static bool available;  // global, set once by initialize
+static bool sse2;       // global, set once by initialize
+
+static inline reg_t read_cr0() {
+    reg_t cr0;
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void set_ts() {
+    reg_t cr0 = read_cr0();
+    if (!(cr0 & CR0_TS))
+        asm volatile("movl %0, %%cr0" :: "r"(cr0 | CR0_TS) : "memory");
+}
+
+static inline void clear_ts() {
+    asm volatile("clts" ::: "memory");
+}
+
+static inline void fxsave(void *area) {
+    asm volatile("fxsave (%0)" :: "r"(area) : "memory");
+}
+
+static inline void fxrstor(void *area) {
+    asm volatile("fxrstor (%0)" :: "r"(area) : "memory");
+}
+
+static inline void reset_state() {
+    uint32_t mxcsr = fpu::DEFAULT_MXCSR;
+    asm volatile("fninit; ldmxcsr %0" :: "m"(mxcsr) : "memory");
+}
+
+// the first FPU instruction since the current task was switched in
+static void device_not_available(interrupts::interrupt_args &args) {
+    if (!available)
+        kpanic("FPU instruction without FPU support at eip ", formatting::hex{args.eip});
+    if (interrupts::get_interrupt_context_depth() != 1)
+        kpanic("FPU used by an interrupt handler at eip ", formatting::hex{args.eip});
+
+    task *t = get_current_task();
+    kassert(t != nullptr);
+    uint cpu = this_cpu_read(index);
+    clear_ts();
+    if (this_cpu_read(fpu_owner) != t || t->fpu.cpu != cpu) {
+        if (t->fpu.used) {
+            fxrstor(t->fpu.area());
+        } else {
+            reset_state();
+            t->fpu.used = true;
+        }
+        this_cpu_write(fpu_owner, t);
+        t->fpu.cpu = cpu;
+    }
+}
+
+void fpu::init_cpu() {
+    reg_t cr0 = read_cr0();
+    if (!available) {
+        asm volatile("movl %0, %%cr0" :: "r"(cr0 | CR0_EM) : "memory");
+        return;
+    }
+    reg_t cr4;
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    asm volatile("movl %0, %%cr4" :: "r"(cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT) : "memory");
+    asm volatile("movl %0, %%cr0" :: "r"((cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE) : "memory");
+    reset_state();
+    this_cpu_write(fpu_owner, nullptr);
+    set_ts();
+}
+
+void fpu::initialize() {
+    auto features = cpu::cpuid(1);
+    uint32_t needed = cpu::FEATURE_EDX_FPU | cpu::FEATURE_EDX_FXSR | cpu::FEATURE_EDX_SSE;
+    available = (features.edx & needed) == needed;
+    sse2 = available && (features.edx & cpu::FEATURE_EDX_SSE2);
+    if (!available)
+        TINY_WARN("No FXSAVE or SSE, tasks may not use the FPU");
+    interrupts::register_handler(interrupts::DEVICE_NOT_AVAILABLE_VECTOR, device_not_available);
+    init_cpu();
+}
+
+bool fpu::is_available() {
+    return available;
+}
+
+bool fpu::has_sse2() {
+    return sse2;
+}
+
+void fpu::switch_tasks(task *prev, task *next) {
+    if (prev == next || !available)
+        return;
+    // TS is only clear if prev loaded its state during this timeslice - it may have changed it.
+    // The registers keep holding it, if prev comes back here next
+    if (!(read_cr0() & CR0_TS))
+        fxsave(prev->fpu.area());
+    if (this_cpu_read(fpu_owner) == next && next->fpu.cpu == this_cpu_read(index))
+        clear_ts();
+    else
+        set_ts();
+}
+
+void fpu::kernel_begin() {
+    kassert_not_interrupt;
+    kassert(available);
+    preempt_up();
+    // interrupt handlers do not touch the FPU, and nothing switches tasks until kernel_end
+    reg_t cr0 = read_cr0();
+    // the registers are clear to use without an owner only inside kernel_begin
+    kassert((cr0 & CR0_TS) || this_cpu_read(fpu_owner) != nullptr);
+    if (cr0 & CR0_TS) {
+        clear_ts();
+    } else {
+        fxsave(get_current_task()->fpu.area());
+    }
+    // the current task loads its state again after kernel_end
+    this_cpu_write(fpu_owner, nullptr);
+}
+
+void fpu::kernel_end() {
+    set_ts();
+    preempt_down();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// lazy FPU/SSE state switching: CR0.TS is set when a task is switched in whose state is not in the registers,
+// so its first FPU or SSE instruction traps (#NM) and loads the state with FXRSTOR. A task which used the FPU
+// during its timeslice is saved with FXSAVE when switched out - tasks which never use it never pay for it.
+// A CPU remembers whose state its registers hold, so a task coming back without anyone else using the FPU
+// there meanwhile does not even trap
+//
+// interrupt handlers may NOT use the FPU, and the kernel only between kernel_begin and kernel_end -
+// it is compiled with -mgeneral-regs-only so the compiler never does on its own
+namespace scheduler {
+    struct task;
+
+    namespace fpu {
+        constexpr uint NO_CPU = ~0u;
+        constexpr uint32_t DEFAULT_MXCSR = 0x1F80;  // all SIMD exceptions masked, round to nearest
+
+        // check for FXSAVE and SSE, configure the bootstrap processor and handle #NM
+        // without them, FPU instructions are fatal
+        void initialize();
+        // configure the calling CPU, called by application processors
+        void init_cpu();
+        bool is_available();
+        // SSE2 is usable between kernel_begin and kernel_end
+        bool has_sse2();
+
+        // the FPU belongs to the kernel in between, with preemption disabled - the state of the current task
+        // is saved first. Do NOT call from interrupt context, and do not nest
+        void kernel_begin();
+        void kernel_end();
+
+        // called with interrupts disabled, when next replaces prev on this CPU
+        void switch_tasks(task *prev, task *next);
+    }
+
+    // the FPU subsystem of a task
+    struct task_fpu {
+        // FXSAVE needs 16 byte alignment, which the task allocator does not give
+        uint8_t buffer[512 + 15];
+        bool used = false;         // has a state of its own, otherwise it starts from a clean FPU
+        uint cpu = fpu::NO_CPU;    // the CPU which loaded the state last, whose registers may still hold it
+
+        inline void *area() {
+            return reinterpret_cast<void *>((reinterpret_cast<uintptr_t>(buffer) + 15) & ~static_cast<uintptr_t>(15));
+        }
+    };
+}
@@ -1,5 +1,13 @@
 #include <kernel/scheduler/init.hpp>
+#include <kernel/scheduler/timer.hpp>
+#include <kernel/scheduler/reaper.hpp>
+#include <kernel/scheduler/accounting.hpp>
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/clock/init.hpp>
+#include <kernel/clock/time_page.hpp>
 #include <kernel/scheduler/task.hpp>
+#include <kernel/scheduler/mutex.hpp>
+#include <kernel/scheduler/rcu.hpp>
 #include <kernel/util/string.hpp>
 #include <kernel/memory/page_allocator.hpp>
 #include <kernel/util/asm_wrap.hpp>
@@ -7,27 +15,57 @@
 #include <kernel/memory/gdt.hpp>
 #include <kernel/logging.hpp>
 #include <kernel/interrupts/init.hpp>
+#include <kernel/interrupts/stats.hpp>
+#include <kernel/interrupts/profiler.hpp>
 
-scheduler::tss_entry scheduler::global_tss;
-static volatile uint32_t preempt_counter = 0;  // global
+static volatile uint32_t tick_counter = 0;     // global, timer interrupts since boot
 static memory::slab_allocator<scheduler::task> task_allocator;
+static spinlock task_allocator_lock;
 
-scheduler::task *volatile scheduler::current_task = 0;
+// the current task and the preemption counter are per-CPU, see smp/percpu.hpp
+static inline void set_current_task(scheduler::task *t) {
+    this_cpu_write(current_task, t);
+}
+
+namespace {
+    // the tasks of a single CPU - every task is linked to exactly one run queue, blocked or not,
+    // and only that CPU runs it. The idle task of the CPU is the list head, and never migrates
+    struct runqueue {
+        spinlock lock;
+        scheduler::task *idle;
+        uint32_t nr_tasks;      // linked tasks, without the idle task
+        uint32_t nr_runnable;   // runnable tasks (running or not) without the idle task, as of the last pick
+        uint32_t last_balance;  // ticks at the last rebalance
+    };
+}
+
+static runqueue runqueues[smp::MAX_CPUS];  // global, indexed by CPU index
+static volatile bool scheduler_initialized = false;  // global
 
-[[noreturn]] static void enter_task(char *stack) {
-    scheduler::global_tss.esp0 = reinterpret_cast<reg_t>(stack) + sizeof(interrupts::interrupt_args);
-    asm_enter_task(stack);
+// a CPU with runnable tasks to spare gives one away every so often, even if nobody is idle
+static constexpr uint32_t REBALANCE_TICKS = 50;
+
+static inline runqueue &this_rq() {
+    return runqueues[this_cpu_read(index)];
 }
 
-char stack_free_stack[4096];  // stack used to free the stack
+// prev_on_cpu is cleared after leaving the stack of the previous task, or nullptr to keep it
+[[noreturn]] static void enter_task(char *stack, uint32_t *prev_on_cpu) {
+    // entering the kernel from usermode starts at the top of the task's kernel stack
+    // nothing on the kernel stack is used while the task is in usermode (asm_enter_usermode does not return)
+    smp::this_cpu()->tss.esp0 = (reinterpret_cast<reg_t>(stack) & ~8191u) + 8192;  // see create_kernel_stack
+    asm_enter_task(stack, prev_on_cpu);
+}
 
-extern "C" __attribute__((cdecl)) void _sched_final_free(char *free_stack, char *switch_stack) {
-    memory::kmem_free_4k(free_stack);
-    scheduler::preempt_down();  // worst case scenario: this task is already freed at the point of switch
-    enter_task(switch_stack);
-    __builtin_unreachable();
+// enter the current task after prev was switched out, with interrupts disabled
+[[noreturn]] static void switch_from(scheduler::task *prev) {
+    scheduler::task *next = scheduler::get_current_task();
+    scheduler::fpu::switch_tasks(prev, next);
+    enter_task(next->stack_pointer, next == prev ? nullptr : &prev->scheduling.on_cpu);
 }
 
+static scheduler::task *pick_next(runqueue &rq, scheduler::task_scheduling *start);
+
 static void task_wrapper(void (*call)(void)) {
     using namespace scheduler;
     asm volatile("sti" ::: "memory");
@@ -35,7 +73,7 @@ static void task_wrapper(void (*call)(void)) {
 
     // initialize hmem mappings - top page table
     void *hmem_mappings_page_table = memory::kmem_alloc_4k();
-    memset(hmem_mappings_page_table, 0, 4096);
+    clear_page(hmem_mappings_page_table);
     uint32_t cr3;
     asm volatile("movl %%cr3, %0" : "=r"(cr3) :: "memory");
     uint32_t *page_dir = reinterpret_cast<uint32_t *>(memory::phys_t(cr3).to_virt());
@@ -43,24 +81,21 @@ static void task_wrapper(void (*call)(void)) {
         static_cast<uint32_t>(memory::page_flag::present) | static_cast<uint32_t>(memory::page_flag::write);
 
     call();
+    scheduler::exit();
+}
 
-    // finalization
-    preempt_up();  // during finalization, disable preemption
-    task *me = current_task;
-    current_task = task::from(me->scheduling.get_next());
+void scheduler::exit() {
+    kassert_not_interrupt;
+    // with interrupts disabled, this CPU won't switch away from this task anymore
+    interrupts::cli();
+    task *me = get_current_task();
+    runqueue &rq = this_rq();
+    // pick the next task without me in the list
     unlink_task(me);
-    task::release(me);
-    memory::kmem_free_4k(hmem_mappings_page_table);
-
-    // call _sched_final_free from another stack (stack_free_stack)
-    char *my_stack = reinterpret_cast<char *>(get_current_task_internal());
-    *reinterpret_cast<reg_t *>(stack_free_stack + sizeof(stack_free_stack) -     sizeof(reg_t)) = reinterpret_cast<reg_t>(current_task->stack_pointer);
-    *reinterpret_cast<reg_t *>(stack_free_stack + sizeof(stack_free_stack) - 2 * sizeof(reg_t)) = reinterpret_cast<reg_t>(my_stack);
-
-    char *new_sp = stack_free_stack + sizeof(stack_free_stack) - 2 * sizeof(reg_t);
-    asm volatile("":::"memory");
-    asm volatile("mov %0, %%esp \n\t cld \n\t call _sched_final_free" :: "g" (new_sp) : "memory");
-    __builtin_unreachable();
+    // the reaper frees the stack once enter_task has left it and cleared on_cpu
+    add_zombie(me);
+    pick_next(rq, &rq.idle->scheduling);
+    switch_from(me);
 }
 
 // Creates a task which can be entered to run task_wrapper with main as the argument
@@ -81,28 +116,36 @@ static char *create_kernel_stack(void (*main)(void), reg_t cr3) {
     return stack;
 }
 
-scheduler::task::task(uint32_t _pid, char *_stack_pointer) : pid(_pid), stack_pointer(_stack_pointer)
+scheduler::task::task(uint32_t _pid, char *_stack_pointer, reg_t _page_directory)
+    : pid(_pid), stack_pointer(_stack_pointer), kernel_stack(reinterpret_cast<char *>(reinterpret_cast<reg_t>(_stack_pointer) & ~8191u)),
+      page_directory(_page_directory)
 {}
 
 static pid_t max_pid;
 scheduler::task *scheduler::task::allocate(void (*run)(void)) {
     kassert_not_interrupt;
-    scoped_preemptlock lock;
+    reg_t page_directory = memory::new_page_directory();
+    char *stack = create_kernel_stack(run, page_directory);
+    scoped_spinlock lock {task_allocator_lock};
     pid_t pid = max_pid++;
     kassert(pid < 16384);  // implement it better! allow reuse of pids
-    task *t = task_allocator.allocate(pid, create_kernel_stack(run, memory::new_page_directory()));
+    task *t = task_allocator.allocate(pid, stack, page_directory);
     return t;
 }
 
 void scheduler::task::release(task *obj) {
     if (obj->release_ref()) {
+        scoped_spinlock lock {task_allocator_lock};
         task_allocator.free(obj);
     }
 }
 
 static void idle_task() {
     while (1) {
-        asm volatile("pause" ::: "memory");
+        // look for work to steal every now and then, without hammering the other run queues
+        for (int i = 0; i < 64; i++)
+            asm volatile("pause" ::: "memory");
+        scheduler::yield();
     }
 }
 
@@ -110,36 +153,220 @@ void scheduler::initialize() {
     asm volatile("cli" ::: "memory");
     max_pid = 0;
 
-    preempt_counter = 1;  // do not switch task yet
-    current_task = task_allocator.allocate(max_pid++, create_kernel_stack(idle_task, memory::new_page_directory()));
-    // TODO make idle thread lower priority so it only runs if it has to
-
-    memset(&global_tss, 0, sizeof(global_tss));
-    global_tss.ss0 = 0x10;
+    this_cpu_write(preempt_counter, 1);  // do not switch task yet
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        if (!smp::get_cpu(i).online)
+            continue;
+        reg_t page_directory = memory::new_page_directory();
+        task *idle = task_allocator.allocate(max_pid++, create_kernel_stack(idle_task, page_directory), page_directory);
+        idle->scheduling.base_priority = PRIORITY_IDLE;
+        idle->scheduling.effective_priority = PRIORITY_IDLE;
+        idle->scheduling.cpu = i;
+        idle->scheduling.affinity = 1u << i;
+        runqueues[i].idle = idle;
+    }
+    set_current_task(runqueues[0].idle);
+    start_reaper();
+    __atomic_store_n(&scheduler_initialized, true, __ATOMIC_RELEASE);
 }
 
 void scheduler::start() {
+    // application processors wait here until the bootstrap processor is done with initialize
+    while (!__atomic_load_n(&scheduler_initialized, __ATOMIC_ACQUIRE))
+        asm volatile("pause" ::: "memory");
+
     scoped_intlock lock;  // disable interrupts before enter_task
-    preempt_counter = 0;  // can switch tasks from now on
-    enter_task(current_task->stack_pointer);
+    task *idle = this_rq().idle;
+    kassert(idle != nullptr);
+    idle->scheduling.on_cpu = 1;
+    set_current_task(idle);
+    this_cpu_write(preempt_counter, 0);  // can switch tasks from now on
+    enter_task(idle->stack_pointer, nullptr);
     kpanic("enter_task has returned");
 }
 
 void scheduler::link_task(task *t) {
     t->take_ref();
-    current_task->scheduling.add_after_self(&t->scheduling);
+
+    // the least loaded online CPU the task may run on
+    uint32_t affinity = __atomic_load_n(&t->scheduling.affinity, __ATOMIC_RELAXED);
+    uint best = smp::cpu_count();
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        if (runqueues[i].idle == nullptr || !(affinity & (1u << i)))
+            continue;
+        if (best == smp::cpu_count() || runqueues[i].nr_runnable < runqueues[best].nr_runnable)
+            best = i;
+    }
+    kassert(best != smp::cpu_count());  // the affinity doesn't allow any CPU
+
+    runqueue &rq = runqueues[best];
+    scoped_spinlock lock {rq.lock};
+    t->scheduling.cpu = best;
+    // at the end of the round robin order
+    rq.idle->scheduling.get_prev()->add_after_self(&t->scheduling);
+    rq.nr_tasks++;
+    rq.nr_runnable++;  // until the next pick counts again
 }
 
 void scheduler::unlink_task(task *t) {
-    t->scheduling.unlink();
+    {
+        // a running task stays on its run queue, other tasks may be stolen by another CPU meanwhile
+        kassert(t->scheduling.on_cpu);
+        runqueue &rq = runqueues[t->scheduling.cpu];
+        scoped_spinlock lock {rq.lock};
+        t->scheduling.unlink();
+        rq.nr_tasks--;
+    }
     t->release_ref();
 }
 
+void scheduler::set_priority(task *t, int priority) {
+    kassert_not_interrupt;
+    kassert(PRIORITY_IDLE <= priority && priority <= PRIORITY_MAX);
+    // the effective priority may be boosted by mutexes the task holds, and it may boost others if it waits for a mutex
+    concurrency::mutex::set_base_priority(t, priority);
+}
+
+void scheduler::set_affinity(task *t, uint32_t mask) {
+    uint32_t online = 0;
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        if (runqueues[i].idle != nullptr)
+            online |= 1u << i;
+    }
+    kassert((mask & online) != 0);
+    __atomic_store_n(&t->scheduling.affinity, mask, __ATOMIC_RELAXED);
+}
+
+// the highest priority runnable task of this CPU, starting after start for round robin between equal priorities
+// the idle task is always runnable. Called with rq.lock held
+static scheduler::task *pick_local(runqueue &rq, uint cpu, scheduler::task_scheduling *start) {
+    using namespace scheduler;
+    task_scheduling *it = start;
+    task *best = nullptr;
+    uint32_t runnable = 0;
+    do {
+        it = it->get_next();
+        task *t = task::from(it);
+        if (t->blocking.is_blocked())
+            continue;
+        if (t != rq.idle)
+            runnable++;
+        if (!(t->scheduling.affinity & (1u << cpu)))
+            continue;  // waits for a CPU it may run on to take it
+        if (best == nullptr || t->scheduling.effective_priority > best->scheduling.effective_priority) {
+            best = t;
+        }
+    } while (it != start);
+
+    rq.nr_runnable = runnable;
+    kassert(best != nullptr);
+    return best;
+}
+
+// unlink a task which this CPU may take over from another CPU's run queue
+// with only_stranded, only take tasks which may not run on the victim's CPU anymore
+static scheduler::task *steal_from(uint victim_cpu, uint cpu, bool only_stranded) {
+    using namespace scheduler;
+    runqueue &victim = runqueues[victim_cpu];
+    if (!victim.lock.try_lock())
+        return nullptr;  // busy, maybe next time
+
+    task *found = nullptr;
+    for (task_scheduling *it = victim.idle->scheduling.get_next(); it != &victim.idle->scheduling; it = it->get_next()) {
+        task *t = task::from(it);
+        // a task with on_cpu set is running, or its stack is still in use
+        if (t->blocking.is_blocked() || __atomic_load_n(&t->scheduling.on_cpu, __ATOMIC_ACQUIRE))
+            continue;
+        uint32_t affinity = t->scheduling.affinity;
+        if (!(affinity & (1u << cpu)))
+            continue;
+        if (only_stranded && (affinity & (1u << victim_cpu)))
+            continue;
+        found = t;
+        break;
+    }
+
+    if (found != nullptr) {
+        found->scheduling.unlink();
+        victim.nr_tasks--;
+        if (victim.nr_runnable != 0)
+            victim.nr_runnable--;
+    }
+    victim.lock.unlock();
+    return found;
+}
+
+// look for a task this CPU should run instead of the others: while idle, anything runnable will do,
+// otherwise only tasks stranded on CPUs they may not run on, or one from a CPU with more work than this one
+static scheduler::task *balance(runqueue &rq, uint cpu, bool idle) {
+    runqueue *busiest = nullptr;
+    uint busiest_cpu = 0;
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        if (i == cpu || runqueues[i].idle == nullptr)
+            continue;
+        if (idle || runqueues[i].nr_runnable != 0) {
+            scheduler::task *t = steal_from(i, cpu, !idle);
+            if (t != nullptr)
+                return t;
+        }
+        if (busiest == nullptr || runqueues[i].nr_runnable > busiest->nr_runnable) {
+            busiest = &runqueues[i];
+            busiest_cpu = i;
+        }
+    }
+    if (!idle && busiest != nullptr && busiest->nr_runnable > rq.nr_runnable + 1)
+        return steal_from(busiest_cpu, cpu, false);
+    return nullptr;
+}
+
+// pick the next task to run on this CPU, and make it the current task
+// the round robin starts after start, which must stay on this run queue. Called with interrupts disabled
+static scheduler::task *pick_next(runqueue &rq, scheduler::task_scheduling *start) {
+    using namespace scheduler;
+    uint cpu = this_cpu_read(index);
+
+    rq.lock.lock();
+    task *best = pick_local(rq, cpu, start);
+    uint32_t now = ticks();
+    bool idle = best == rq.idle;
+    if (idle || now - rq.last_balance >= REBALANCE_TICKS) {
+        // never hold two run queue locks at once - while this one is unlocked, another CPU may steal from it
+        rq.last_balance = now;
+        rq.lock.unlock();
+        task *stolen = balance(rq, cpu, idle);
+        rq.lock.lock();
+        if (stolen != nullptr) {
+            stolen->scheduling.cpu = cpu;
+            rq.idle->scheduling.get_prev()->add_after_self(&stolen->scheduling);
+            rq.nr_tasks++;
+        }
+        best = pick_local(rq, cpu, start);
+    }
+
+    // the time it waited since it became runnable, unless it keeps running
+    uint64_t runnable_since = best->accounting.runnable_since;
+    uint64_t woken_at = best->latency.woken_at;
+    if (runnable_since != 0 || woken_at != 0) {
+        uint64_t now_ns = clock::now_ns();
+        if (runnable_since != 0) {
+            best->accounting.wait_ns += now_ns - runnable_since;
+            best->accounting.runnable_since = 0;
+        }
+        if (woken_at != 0)
+            latency::note_run(best, get_current_task(), now_ns);
+    }
+    best->scheduling.on_cpu = 1;
+    set_current_task(best);
+    smp::this_cpu()->context_switches++;
+    rq.lock.unlock();
+    return best;
+}
+
 void scheduler::pick_next_task()
 {
-    do {
-        current_task = task::from(current_task->scheduling.get_next());
-    } while (current_task->blocking.is_blocked());
+    task *current = get_current_task();
+    rcu::note_context_switch(current);
+    pick_next(this_rq(), &current->scheduling);
 }
 
 // called from interrupt context - so need to enable interrupts
@@ -147,48 +374,109 @@ void scheduler::timeslice_passed(interrupts::interrupt_args &resume_info) {
     kassert_is_interrupt;
     // no interrupts in this function
     scoped_intlock lock;
+    if (this_cpu_read(index) == 0) {
+        tick_counter = tick_counter + 1;
+        clock::update_time_page_ticks(tick_counter);
+        run_timers(tick_counter);
+    }
+    this_cpu_write(local_ticks, this_cpu_read(local_ticks) + 1);
+    interrupts::profiler::tick(resume_info);
 
-    if (current_task == 0) [[unlikely]]
+    task *current = get_current_task();
+    if (current == nullptr) [[unlikely]]
         return;  // not initialized yet
-    if (__atomic_load_n(&preempt_counter, __ATOMIC_ACQUIRE) != 0 || interrupts::get_interrupt_context_depth() > 1)
+    // sample where the task is, by the privilege level the tick interrupted
+    if (resume_info.cs & 3)
+        current->accounting.user_ticks++;
+    else
+        current->accounting.kernel_ticks++;
+    if (this_cpu_read(preempt_counter) != 0 || interrupts::get_interrupt_context_depth() > 1)
         return;  // preemption is locked
 
+    // the handler does not return to internal_interrupt_handler
+    interrupts::handler_switching_away();
     interrupts::reduce_interrupt_depth();
     // set stack pointer to point to interrupt info
-    current_task->stack_pointer = reinterpret_cast<char *>(&resume_info);
+    current->stack_pointer = reinterpret_cast<char *>(&resume_info);
+    // still runnable, it waits from now on if another task is picked
+    current->accounting.runnable_since = clock::now_ns();
+    current->latency.woken_at = 0;
     // enter the next stack pointer
     pick_next_task();
-    enter_task(current_task->stack_pointer);
+    if (get_current_task() != current)
+        current->accounting.involuntary_switches++;
+    switch_from(current);
+}
+
+void scheduler::for_each_task(void (*fn)(task *t, void *arg), void *arg) {
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        runqueue &rq = runqueues[i];
+        if (rq.idle == nullptr)
+            continue;
+        scoped_spinlock lock {rq.lock};
+        task_scheduling *it = &rq.idle->scheduling;
+        do {
+            fn(task::from(it), arg);
+            it = it->get_next();
+        } while (it != &rq.idle->scheduling);
+    }
+}
+
+uint32_t scheduler::ticks() {
+    return __atomic_load_n(&tick_counter, __ATOMIC_RELAXED);
 }
 
+bool scheduler::is_running(task *t) {
+    return __atomic_load_n(&t->scheduling.on_cpu, __ATOMIC_ACQUIRE) != 0;
+}
+
+uint scheduler::runqueue_load(uint cpu) {
+    kassert(cpu < smp::cpu_count());
+    return __atomic_load_n(&runqueues[cpu].nr_runnable, __ATOMIC_RELAXED);
+}
+
+bool scheduler::can_yield() {
+    return this_cpu_read(preempt_counter) == 0 && !interrupts::is_interrupt_context();
+}
+
+// a single instruction on the per-CPU counter is atomic with respect to interrupts on this CPU,
+// and no other CPU touches it
 void scheduler::preempt_down() {
-    uint32_t new_val = __atomic_sub_fetch(&preempt_counter, 1, __ATOMIC_ACQ_REL);
-    kassert(new_val != (uint32_t)-1);
+    uint32_t old_val = -1;
+    asm volatile("xaddl %0, %%gs:%c1" : "+r"(old_val) : "i"(__builtin_offsetof(smp::percpu, preempt_counter)) : "memory");
+    kassert(old_val != 0);
 }
 
 void scheduler::preempt_up() {
-    __atomic_add_fetch(&preempt_counter, 1, __ATOMIC_ACQ_REL);
+    asm volatile("incl %%gs:%c0" :: "i"(__builtin_offsetof(smp::percpu, preempt_counter)) : "memory");
 }
 
 extern "C" __attribute__((cdecl)) void do_yield(interrupts::interrupt_args *stack_arg) {
     using namespace scheduler;
 
     // set stack pointer to point to interrupt info
-    current_task->stack_pointer = reinterpret_cast<char *>(stack_arg);
+    task *current = get_current_task();
+    current->stack_pointer = reinterpret_cast<char *>(stack_arg);
+    // a blocked task starts waiting when it is woken up, see note_wakeup
+    if (!current->blocking.is_blocked()) {
+        current->accounting.runnable_since = clock::now_ns();
+        current->latency.woken_at = 0;  // woken up before it could block
+    }
     // enter the next stack pointer
     pick_next_task();
-    enter_task(current_task->stack_pointer);
+    if (get_current_task() != current)
+        current->accounting.voluntary_switches++;
+    switch_from(current);
 }
 
 void scheduler::yield() {
     kassert_not_interrupt;
-    kassert(preempt_counter == 0);
-    // disable interrupts while working on switching
-    interrupts::cli();
+    kassert(this_cpu_read(preempt_counter) == 0);
 
     asm volatile(
             ""
-            "pushf                  \n"  // eflags
+            "pushf                  \n"  // eflags - saved before cli, so interrupts are enabled when resumed
+            "cli                    \n"  // disable interrupts while working on switching
             "pushl %0               \n"  // cs
             "pushl $0x00            \n"  // placeholder for eip
             "pushl $0x00            \n"  // error_code
@@ -4,42 +4,34 @@
 #include <kernel/interrupts/init.hpp>
 #include <kernel/util/ds/refcount.hpp>
 #include <kernel/memory/virtual_memory.hpp>
+#include <kernel/smp/percpu.hpp>
 
 namespace scheduler {
-    struct __attribute__((packed)) tss_entry {
-        uint32_t prev_tss;
-        uint32_t esp0;  // The stack pointer to load when changing to kernel mode
-        uint32_t ss0;   // The stack segment to load when changing to kernel mode
-        // Everything below here is unused.
-        uint32_t esp1;  // esp and ss 1 and 2 would be used when switching to rings 1 or 2
-        uint32_t ss1;
-        uint32_t esp2;
-        uint32_t ss2;
-        uint32_t cr3;
-        uint32_t eip;
-        uint32_t eflags;
-        uint32_t eax;
-        uint32_t ecx;
-        uint32_t edx;
-        uint32_t ebx;
-        uint32_t esp;
-        uint32_t ebp;
-        uint32_t esi;
-        uint32_t edi;
-        uint32_t es;
-        uint32_t cs;
-        uint32_t ss;
-        uint32_t ds;
-        uint32_t fs;
-        uint32_t gs;
-        uint32_t ldt;
-        uint16_t trap;
-        uint16_t iomap_base;
-    };
+    // task priorities - the highest priority runnable task runs, tasks with the same priority share the CPU
+    constexpr int PRIORITY_IDLE = 0;  // only runs if nothing else can
+    constexpr int PRIORITY_DEFAULT = 16;
+    constexpr int PRIORITY_MAX = 31;
+
+    // CPU affinity masks have a bit per CPU index
+    constexpr uint32_t AFFINITY_ALL = 0xFFFFFFFF;
+    static_assert(smp::MAX_CPUS <= 32, "affinity mask too small");
 
     // the scheduling subsystem of a task
     struct task_scheduling final : public ds::intrusive_doubly_linked_node<task_scheduling> {
-        // currently, only need to be on a linked list
+        // priority set for the task
+        int base_priority = PRIORITY_DEFAULT;
+        // priority the task is scheduled by - higher than base_priority if it holds a mutex that a higher priority task waits for
+        int effective_priority = PRIORITY_DEFAULT;
+        // RCU read-side critical section nesting, see rcu.hpp
+        uint32_t rcu_nesting = 0;
+        // the RCU epoch this task was counted in when switched out during a read-side critical section, or -1
+        int rcu_blocked_epoch = -1;
+        // the CPU whose run queue the task is linked to
+        uint cpu = 0;
+        // the CPUs the task may run on
+        uint32_t affinity = AFFINITY_ALL;
+        // set while a CPU runs the task, or is still switching away from its stack
+        uint32_t on_cpu = 0;
     };
 
     // for pointers in this header file
@@ -59,19 +51,35 @@ namespace scheduler {
         return current;
     }
 
-    extern tss_entry global_tss;
-    extern task *volatile current_task;
+    // the task running on this CPU, nullptr before the scheduler starts
+    inline task *get_current_task() {
+        return this_cpu_read(current_task);
+    }
 
-    // initialize scheduling
+    // initialize scheduling, with a run queue for every CPU which is online
     void initialize();
-    // enter current task when ready
+    // enter the idle task of the calling CPU, called by every CPU
+    // application processors may call it before the bootstrap processor initialized the scheduler
     void start();
-    // add the task to the scheduler
+    // add the task to the scheduler, on the least loaded CPU its affinity allows
     void link_task(task *t);
-    // remove the task from the scheduler
+    // remove the running task from the scheduler, when it exits
     void unlink_task(task *t);
+    // end the running task, releasing the scheduler's reference to it
+    // do NOT call from interrupt context
+    [[noreturn]] void exit();
+    // set the base priority of a task, do NOT call from interrupt context
+    void set_priority(task *t, int priority);
+    // restrict the CPUs a task may run on - a task on a CPU it may not use anymore migrates at the next rebalance
+    void set_affinity(task *t, uint32_t mask);
 
     void timeslice_passed(interrupts::interrupt_args &resume_info);  // called from interrupt context
+    // number of timer interrupts since boot on the bootstrap processor, roughly 1000 per second
+    uint32_t ticks();
+    // is the task currently running on a CPU?
+    bool is_running(task *t);
+    // can the current task call yield right now?
+    bool can_yield();
 
     // for preemption locking
     void preempt_up();
@@ -81,7 +89,13 @@ namespace scheduler {
     // preemption should be disabled, and should not be called in interrupt context
     void yield();
 
-    // scheduling algorithm - pick the next task to run, and switch the current task to it
+    // scheduling algorithm - pick the next task to run on this CPU, and switch the current task to it
     // called internally and under a full interrupt lock
     void pick_next_task();
+
+    // number of runnable tasks on a CPU's run queue as of its last scheduling decision, for tests and statistics
+    uint runqueue_load(uint cpu);
+    // call fn for every linked task, including the idle tasks, under its run queue lock - keep it short
+    // tasks migrating between run queues meanwhile may be missed
+    void for_each_task(void (*fn)(task *t, void *arg), void *arg);
 }
@@ -0,0 +1,140 @@
+#include <kernel/scheduler/latency.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/logging.hpp>
+
+using namespace scheduler;
+
+static bool tracing;                           // global
+static uint32_t generation;                    // global, the tracing session, changed by enable
+static spinlock latency_lock;                  // global, guards the two below
+static latency::histogram global;              // global
+static latency::worst_trace worst_seen;        // global
+
+static inline uint bucket_of(uint64_t ns) {
+    if (ns >> 32)
+        return latency::BUCKETS - 1;
+    uint32_t low = static_cast<uint32_t>(ns);
+    return low == 0 ? 0 : 31 - __builtin_clz(low);
+}
+
+void latency::histogram::add(uint64_t ns) {
+    buckets[bucket_of(ns)]++;
+    count++;
+    if (ns > max_ns)
+        max_ns = ns;
+}
+
+void latency::enable() {
+    scoped_spinlock lock {latency_lock};
+    global = histogram();
+    worst_seen = worst_trace();
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&tracing, true, __ATOMIC_RELEASE);
+}
+
+void latency::disable() {
+    __atomic_store_n(&tracing, false, __ATOMIC_RELEASE);
+}
+
+bool latency::is_enabled() {
+    return __atomic_load_n(&tracing, __ATOMIC_ACQUIRE);
+}
+
+void latency::note_wakeup(task *t, uint64_t now_ns) {
+    if (is_enabled())
+        t->latency.woken_at = now_ns;
+}
+
+void latency::note_run(task *next, task *prev, uint64_t now_ns) {
+    uint64_t woken_at = next->latency.woken_at;
+    next->latency.woken_at = 0;
+    if (!is_enabled() || next == prev)
+        return;  // a task woken before it could block never stopped running
+    uint64_t ns = now_ns - woken_at;
+
+    // only the CPU which picked the task touches its histogram
+    uint32_t current_generation = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+    if (next->latency.generation != current_generation) {
+        next->latency.generation = current_generation;
+        next->latency.wakeups = histogram();
+    }
+    next->latency.wakeups.add(ns);
+
+    scoped_spinlock lock {latency_lock};
+    global.add(ns);
+    if (ns > worst_seen.latency_ns) {
+        worst_seen.latency_ns = ns;
+        worst_seen.pid = next->pid;
+        worst_seen.running_pid = prev->pid;
+        worst_seen.cpu = this_cpu_read(index);
+        worst_seen.tick = ticks();
+    }
+}
+
+latency::histogram latency::global_histogram() {
+    scoped_spinlock lock {latency_lock};
+    return global;
+}
+
+latency::worst_trace latency::worst() {
+    scoped_spinlock lock {latency_lock};
+    return worst_seen;
+}
+
+static inline uint32_t ns_to_us(uint64_t ns) {
+    return static_cast<uint32_t>(div64_32(ns, 1000));
+}
+
+static void dump_buckets(const latency::histogram &h) {
+    for (uint i = 0; i < latency::BUCKETS; i++) {
+        if (h.buckets[i] == 0)
+            continue;
+        const char *prefix = i == latency::BUCKETS - 1 ? "[LAT]   >= 2^" : "[LAT]   2^";
+        LOCKED(serial_driver::write(prefix, i, "ns: ", h.buckets[i], '\n'));
+    }
+}
+
+namespace {
+    struct task_histogram {
+        uint32_t pid;
+        latency::histogram wakeups;
+    };
+
+    struct histogram_buffer {
+        task_histogram *out;
+        uint max;
+        uint count;
+        uint32_t generation;
+    };
+}
+
+void latency::dump() {
+    kassert_not_interrupt;
+    histogram h = global_histogram();
+    worst_trace w = worst();
+    LOCKED(serial_driver::write("[LAT] all tasks: ", h.count, " wakeups, max ", ns_to_us(h.max_ns), "us\n"));
+    dump_buckets(h);
+    if (w.latency_ns != 0) {
+        LOCKED(serial_driver::write("[LAT] worst: pid ", w.pid, " waited ", ns_to_us(w.latency_ns), "us on cpu ", w.cpu,
+                " while pid ", w.running_pid, " ran, until tick ", w.tick, '\n'));
+    }
+
+    // copy the histograms of this session out of the run queue locks, before writing them slowly
+    histogram_buffer buffer {static_cast<task_histogram *>(memory::kmem_alloc_4k()), 4096 / sizeof(task_histogram), 0,
+                             __atomic_load_n(&generation, __ATOMIC_RELAXED)};
+    for_each_task([](task *t, void *arg) {
+        histogram_buffer &b = *static_cast<histogram_buffer *>(arg);
+        if (b.count == b.max || t->latency.generation != b.generation || t->latency.wakeups.count == 0)
+            return;
+        b.out[b.count].pid = t->pid;
+        b.out[b.count].wakeups = t->latency.wakeups;
+        b.count++;
+    }, &buffer);
+    for (uint i = 0; i < buffer.count; i++) {
+        const histogram &t = buffer.out[i].wakeups;
+        LOCKED(serial_driver::write("[LAT] pid ", buffer.out[i].pid, ": ", t.count, " wakeups, max ", ns_to_us(t.max_ns), "us\n"));
+        dump_buckets(t);
+    }
+    memory::kmem_free_4k(buffer.out);
+}
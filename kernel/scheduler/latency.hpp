@@ -0,0 +1,54 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// wakeup latency tracing: while enabled, a woken task is timestamped when it is unblocked and again when a CPU
+// picks it, and the difference goes to log2 histograms of the task and of the whole system.
+// The worst wakeup seen is kept with the task which ran instead
+namespace scheduler {
+    struct task;
+
+    namespace latency {
+        // bucket i counts latencies in [2^i, 2^(i+1)) ns, the first also counts 0 and the last everything above
+        constexpr uint BUCKETS = 32;
+
+        struct histogram {
+            uint32_t buckets[BUCKETS] = {};
+            uint32_t count = 0;
+            uint64_t max_ns = 0;
+
+            void add(uint64_t ns);
+        };
+
+        struct worst_trace {
+            uint64_t latency_ns;
+            uint32_t pid;          // the task that waited
+            uint32_t running_pid;  // the task the CPU switched away from to run it
+            uint cpu;
+            uint32_t tick;         // scheduler::ticks when it finally ran
+        };
+
+        // start tracing, resetting the histograms of the system and the worst trace
+        // the histograms of tasks are reset by their next wakeup after this
+        void enable();
+        void disable();
+        bool is_enabled();
+
+        // called by a waker right before unblocking t
+        void note_wakeup(task *t, uint64_t now_ns);
+        // called by pick_next under the run queue lock, when next replaces prev on this CPU
+        void note_run(task *next, task *prev, uint64_t now_ns);
+
+        histogram global_histogram();
+        worst_trace worst();
+        // write the global histogram, the worst trace and the histograms of all tasks which were woken to the serial port
+        // do NOT call from interrupt context
+        void dump();
+    }
+
+    // the latency subsystem of a task
+    struct task_latency {
+        uint64_t woken_at = 0;   // when the task was woken, 0 if it is not waiting to run after a wakeup
+        uint32_t generation = 0; // the tracing session the histogram belongs to
+        latency::histogram wakeups;
+    };
+}
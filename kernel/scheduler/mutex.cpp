@@ -1,45 +1,198 @@
 #include <kernel/scheduler/mutex.hpp>
 #include <kernel/util/lock.hpp>
+#include <kernel/logging.hpp>
+
+// guards the state of all mutexes, and the priorities and held mutexes of all tasks -
+// priority inheritance follows chains through several mutexes and tasks, which may be running on other CPUs
+static spinlock pi_lock;  // global
+
+// spin until the mutex is free, as long as its owner is running (so it'll probably be free soon)
+// returns true if the mutex was free at some point, false if it's time to block
+bool scheduler::concurrency::mutex::spin_while_owner_running() {
+    for (uint32_t i = 0; i < ADAPTIVE_SPIN_LIMIT; i++) {
+        scheduler::task *owner = __atomic_load_n(&m_owner, __ATOMIC_ACQUIRE);
+        if (owner == nullptr) {
+            return true;
+        }
+        if (!scheduler::is_running(owner)) {
+            return false;  // the owner is waiting for something itself, no point in spinning
+        }
+        asm volatile("pause" ::: "memory");
+    }
+    return false;
+}
+
+void scheduler::concurrency::mutex::take_ownership(scheduler::task *t) {
+    __atomic_store_n(&m_owner, t, __ATOMIC_RELEASE);
+    t->blocking.held_mutexes.add_after_self(&m_held_node);
+}
+
+void scheduler::concurrency::mutex::enqueue_waiter(scheduler::task *t) {
+    int priority = t->scheduling.effective_priority;
+    bool list_head = true;
+    for (task_blocking &waiter : m_list) {
+        if (list_head) {
+            // the iteration starts from m_list itself
+            list_head = false;
+            continue;
+        }
+        if (task::from(&waiter)->scheduling.effective_priority < priority) {
+            t->blocking.block_before(&waiter);
+            return;
+        }
+    }
+    t->blocking.block_on(&m_list, true);
+}
+
+// the priority a task should have: its own, or that of the highest priority task waiting for a mutex it holds
+int scheduler::concurrency::mutex::inherited_priority(scheduler::task *t) {
+    int priority = t->scheduling.base_priority;
+    auto &held = t->blocking.held_mutexes;
+    for (held_mutex_node *node = held.get_next(); node != &held; node = node->get_next()) {
+        mutex *m = container_of(node, mutex, m_held_node);
+        if (!m->m_list.lonely()) {
+            // the first waiter has the highest priority
+            int waiter_priority = task::from(m->m_list.get_next())->scheduling.effective_priority;
+            if (waiter_priority > priority) {
+                priority = waiter_priority;
+            }
+        }
+    }
+    return priority;
+}
+
+void scheduler::concurrency::mutex::set_base_priority(scheduler::task *t, int priority) {
+    scoped_spinlock lock {pi_lock};
+    t->scheduling.base_priority = priority;
+    priority_changed(t);
+}
+
+void scheduler::concurrency::mutex::priority_changed(scheduler::task *t) {
+    for (uint32_t depth = 0; depth < PRIORITY_CHAIN_LIMIT; depth++) {
+        int priority = inherited_priority(t);
+        if (priority == t->scheduling.effective_priority) {
+            return;
+        }
+        t->scheduling.effective_priority = priority;
+
+        mutex *m = t->blocking.waiting_on;
+        if (m == nullptr) {
+            return;
+        }
+        // keep the waiters of m sorted, then the owner of m may need a new priority too
+        t->blocking.unblock();
+        m->enqueue_waiter(t);
+        t = m->m_owner;
+        kassert(t != nullptr);
+    }
+}
 
 void scheduler::concurrency::mutex::lock() {
     // not applicable for interrupt context
     kassert_not_interrupt;
-    // lock preemption
-    scheduler::preempt_up();
-    // not to be called by the owner
-    kassert(m_owner != scheduler::current_task);
-
-    if (m_owner == nullptr) {
-        // uncontended case
-        m_owner = scheduler::current_task;
-        // unlock preemption
-        scheduler::preempt_down();
-    } else {
-        // contended case - start blocking, then enable preemption and yield to the scheduler
-        scheduler::current_task->blocking.block_on(&m_list);
-        // unlock preemption and yield
-        // we won't be resumed until we're unblocked
-        scheduler::preempt_down();
-        scheduler::yield();
-        kassert(m_owner == scheduler::current_task);
+    if (scheduler::get_current_task() == nullptr) [[unlikely]] {
+        return;  // early boot - there is nobody to exclude
     }
+    scheduler::task *me = scheduler::get_current_task();
+    uint32_t wait_start;
+    {
+        scoped_spinlock lock {pi_lock};
+        // not to be called by the owner
+        kassert(m_owner != me);
+        m_stats.acquisitions++;
+
+        if (m_owner == nullptr) {
+            // uncontended case
+            take_ownership(me);
+            return;
+        }
+
+        m_stats.contended_acquisitions++;
+        wait_start = scheduler::ticks();
+    }
+
+    if (m_adaptive) {
+        // spin without the lock, then check again
+        bool free = spin_while_owner_running();
+        scoped_spinlock lock {pi_lock};
+        if (free && m_owner == nullptr) {
+            take_ownership(me);
+            m_stats.spin_acquisitions++;
+            m_stats.total_wait_ticks += scheduler::ticks() - wait_start;
+            return;
+        }
+    }
+
+    {
+        scoped_spinlock lock {pi_lock};
+        if (m_owner == nullptr) {
+            // released in the meantime
+            take_ownership(me);
+            m_stats.total_wait_ticks += scheduler::ticks() - wait_start;
+            return;
+        }
+        // contended case - start blocking, and lend our priority to the owner (and whoever it waits for)
+        enqueue_waiter(me);
+        me->blocking.waiting_on = this;
+        priority_changed(m_owner);
+    }
+    // we won't be resumed until we're unblocked - if the owner already handed the mutex over, yield returns soon
+    scheduler::yield();
+    kassert(m_owner == me);
+    scoped_spinlock lock {pi_lock};
+    m_stats.total_wait_ticks += scheduler::ticks() - wait_start;
 }
 
 void scheduler::concurrency::mutex::unlock() {
     // not applicable for interrupt context
     kassert_not_interrupt;
-    // lock preemption
-    scoped_preemptlock internal_lock;
-    // only called by owner
-    kassert(m_owner == scheduler::current_task);
-
-    if (m_list.lonely()) {
-        // uncontended case
-        m_owner = nullptr;
-    } else {
-        // contended case
-        task_blocking *waiter_blocking_subsystem = m_list.get_next();
-        waiter_blocking_subsystem->unblock();
-        m_owner = task::from(waiter_blocking_subsystem);
+    if (scheduler::get_current_task() == nullptr) [[unlikely]] {
+        return;  // early boot
+    }
+    bool higher_priority_waiter = false;
+    {
+        scoped_spinlock lock {pi_lock};
+        // only called by owner
+        scheduler::task *me = scheduler::get_current_task();
+        kassert(m_owner == me);
+        m_held_node.unlink();
+
+        if (m_list.lonely()) {
+            // uncontended case
+            __atomic_store_n(&m_owner, nullptr, __ATOMIC_RELEASE);
+        } else {
+            // contended case - hand off directly to the first (highest priority) waiter
+            task_blocking *waiter_blocking_subsystem = m_list.get_next();
+            scheduler::task *waiter = task::from(waiter_blocking_subsystem);
+            waiter->blocking.waiting_on = nullptr;
+            take_ownership(waiter);
+            // the remaining waiters now boost the new owner
+            scheduler::note_wakeup(waiter);
+            waiter_blocking_subsystem->unblock();
+            priority_changed(waiter);
+        }
+
+        // drop any priority we inherited through this mutex
+        priority_changed(me);
+        if (m_owner != nullptr) {
+            higher_priority_waiter = m_owner->scheduling.effective_priority > me->scheduling.effective_priority;
+        }
+    }
+
+    // let the waiter run now instead of at the next timer tick
+    if (higher_priority_waiter && scheduler::can_yield()) {
+        scheduler::yield();
+    }
+}
+
+void scheduler::concurrency::mutex::dump_stats(const char *name) {
+    mutex_stats s;
+    {
+        scoped_spinlock lock {pi_lock};
+        s = m_stats;
     }
+    uint32_t avg_wait = s.contended_acquisitions == 0 ? 0 : s.total_wait_ticks / s.contended_acquisitions;
+    TINY_INFO("mutex ", name, (m_adaptive ? " (adaptive)" : ""), ": acquisitions ", s.acquisitions,
+              " contended ", s.contended_acquisitions, " spin acquired ", s.spin_acquisitions,
+              " wait ticks ", s.total_wait_ticks, " avg wait ticks ", avg_wait);
 }
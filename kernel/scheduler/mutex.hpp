@@ -3,18 +3,51 @@
 
 namespace scheduler {
     namespace concurrency {
+        // contention statistics of a single mutex
+        struct mutex_stats {
+            uint32_t acquisitions;            // total lock() calls
+            uint32_t contended_acquisitions;  // lock() calls which found the mutex owned
+            uint32_t spin_acquisitions;       // contended lock() calls which got the mutex while spinning, without blocking
+            uint32_t total_wait_ticks;        // ticks spent waiting in contended lock() calls
+        };
+
         struct mutex {
         private:
             scheduler::task *m_owner;
             // tasks which are waiting for the mutex are linked to each other
             ds::intrusive_doubly_linked_node<scheduler::task_blocking> m_list;
+            // linked to the other mutexes held by the owner, for priority inheritance
+            held_mutex_node m_held_node;
+            // adaptive mutexes spin for a while before blocking, if the owner is running
+            bool m_adaptive;
+            mutex_stats m_stats;
+
+            // how many times to check the owner before blocking - should be in the order of a context switch
+            static constexpr uint32_t ADAPTIVE_SPIN_LIMIT = 1000;
+            // how many mutexes to follow when propagating priority through nested mutexes
+            static constexpr uint32_t PRIORITY_CHAIN_LIMIT = 64;
+
+            bool spin_while_owner_running();
+            void take_ownership(scheduler::task *t);
+            // waiters are sorted by effective priority, and FIFO within the same priority
+            void enqueue_waiter(scheduler::task *t);
+            static int inherited_priority(scheduler::task *t);
+            // recalculate the effective priority of a task, and propagate it to the owners of the mutexes it waits for
+            static void priority_changed(scheduler::task *t);
 
         public:
             // compatible with static initialization to 0
-            inline constexpr mutex() : m_owner {nullptr} {}
+            inline constexpr explicit mutex(bool adaptive = false) : m_owner {nullptr}, m_adaptive {adaptive}, m_stats {} {}
             inline ~mutex() { kassert(m_owner == nullptr); }
             void lock();
             void unlock();
+
+            // set the base priority of a task, and propagate the change through the mutexes it waits for
+            static void set_base_priority(scheduler::task *t, int priority);
+
+            inline const mutex_stats &stats() { return m_stats; }
+            // write the statistics to serial
+            void dump_stats(const char *name);
         };
     }
 }
@@ -0,0 +1,82 @@
+#include <kernel/scheduler/rcu.hpp>
+#include <kernel/scheduler/mutex.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/util/lock.hpp>
+
+// readers switched out during a read-side critical section, by the epoch they were counted in
+// a grace period flips the epoch, then waits for the count of the previous epoch to drop to 0
+static uint32_t blocked_readers[2];                       // global
+static int current_epoch;                                 // global
+static spinlock rcu_lock;                                 // global, guards the above, taken inside run queue locks
+static scheduler::concurrency::wait_queue gp_wait_queue;  // global
+static scheduler::concurrency::mutex gp_mutex;            // global, one grace period at a time
+
+void scheduler::rcu::note_context_switch(task *t) {
+    if (t->scheduling.rcu_nesting != 0 && t->scheduling.rcu_blocked_epoch < 0) {
+        rcu_lock.lock();
+        t->scheduling.rcu_blocked_epoch = current_epoch;
+        blocked_readers[current_epoch]++;
+        rcu_lock.unlock();
+    }
+}
+
+void scheduler::rcu::read_unlock_slow(task *t) {
+    bool last;
+    {
+        scoped_spinlock lock {rcu_lock};
+        int epoch = t->scheduling.rcu_blocked_epoch;
+        t->scheduling.rcu_blocked_epoch = -1;
+        kassert(blocked_readers[epoch] > 0);
+        // the last reader a grace period waits for
+        last = --blocked_readers[epoch] == 0 && epoch != current_epoch;
+    }
+    if (last) {
+        gp_wait_queue.wake_all();
+    }
+}
+
+static int flip_epoch() {
+    scoped_spinlock lock {rcu_lock};
+    int old_epoch = current_epoch;
+    current_epoch = 1 - current_epoch;
+    return old_epoch;
+}
+
+static void wait_for_readers(int epoch) {
+    gp_wait_queue.wait_until([epoch] { return __atomic_load_n(&blocked_readers[epoch], __ATOMIC_RELAXED) == 0; });
+}
+
+// wait until every online CPU picked a task at least once - a context switch is a quiescent state for the task
+// switched out, or counts it as a blocked reader
+static void wait_for_context_switches() {
+    uint32_t seen[smp::MAX_CPUS];
+    uint count = smp::cpu_count();
+    for (uint i = 0; i < count; i++) {
+        seen[i] = __atomic_load_n(&smp::get_cpu(i).context_switches, __ATOMIC_RELAXED);
+    }
+    for (uint i = 0; i < count; i++) {
+        smp::percpu &cpu = smp::get_cpu(i);
+        if (!cpu.online)
+            continue;
+        // yielding switches this CPU, and lets the idle tasks of the others run
+        while (__atomic_load_n(&cpu.context_switches, __ATOMIC_RELAXED) == seen[i]) {
+            scheduler::yield();
+        }
+    }
+}
+
+void scheduler::rcu::synchronize() {
+    kassert_not_interrupt;
+    kassert(get_current_task()->scheduling.rcu_nesting == 0);
+    scoped_mutex lock { gp_mutex };
+
+    // readers which are switched out are counted in the epoch at that time, but a reader running on another CPU
+    // during the first flip may only be switched out after it, and be counted in the new epoch. Once every CPU has
+    // switched, such readers are either done or counted - so the second flip waits for them
+    int old_epoch = flip_epoch();
+    wait_for_context_switches();
+    wait_for_readers(old_epoch);
+
+    old_epoch = flip_epoch();
+    wait_for_readers(old_epoch);
+}
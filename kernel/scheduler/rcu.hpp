@@ -0,0 +1,50 @@
+#pragma once
+#include <kernel/scheduler/task.hpp>
+
+// read-copy-update: readers don't lock at all, writers publish new versions of data,
+// and wait for a grace period (all readers which may still see the old version are done) before freeing it
+//
+// readers may be preempted. A context switch is a quiescent state for the task switched out,
+// unless it is inside a read-side critical section - then it is counted as a blocked reader,
+// and the grace period waits for it to call read_unlock
+namespace scheduler::rcu {
+    // read-side critical section, may be nested. Do NOT block inside it (yielding/preemption is fine)
+    inline void read_lock() {
+        task *t = get_current_task();
+        if (t != nullptr) [[likely]] {  // otherwise early boot, there are no context switches
+            t->scheduling.rcu_nesting++;
+        }
+        asm volatile("" ::: "memory");
+    }
+
+    void read_unlock_slow(task *t);
+    inline void read_unlock() {
+        asm volatile("" ::: "memory");
+        task *t = get_current_task();
+        if (t == nullptr) [[unlikely]] return;
+        kassert(t->scheduling.rcu_nesting > 0);
+        if (--t->scheduling.rcu_nesting == 0 && t->scheduling.rcu_blocked_epoch >= 0) [[unlikely]] {
+            // was switched out during this critical section, a grace period may be waiting for us
+            read_unlock_slow(t);
+        }
+    }
+
+    // wait until all read-side critical sections that started before this call are done
+    // do NOT call from interrupt context or from a read-side critical section
+    void synchronize();
+
+    // called by the scheduler for the task being switched out, with interrupts disabled
+    void note_context_switch(task *t);
+
+    // read a pointer published by assign_pointer
+    template <class T>
+    inline T *dereference(T *const &p) {
+        return __atomic_load_n(&p, __ATOMIC_ACQUIRE);
+    }
+
+    // publish a pointer - everything written to *value before is visible to readers that see it
+    template <class T>
+    inline void assign_pointer(T *&p, T *value) {
+        __atomic_store_n(&p, value, __ATOMIC_RELEASE);
+    }
+}
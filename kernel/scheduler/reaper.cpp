@@ -0,0 +1,64 @@
+#include <kernel/scheduler/reaper.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/util/spinlock.hpp>
+
+using namespace scheduler;
+
+// exited tasks, linked through their (now unused) scheduling node
+static ds::intrusive_doubly_linked_node<task_scheduling> zombies;  // global
+static spinlock zombie_lock;                                       // global, guards zombies
+static concurrency::wait_queue reaper_queue;
+static uint32_t reaped;                                            // global
+
+static void reap(task *t) {
+    // the CPU it exited on may still be leaving its stack and page directory
+    while (__atomic_load_n(&t->scheduling.on_cpu, __ATOMIC_ACQUIRE))
+        asm volatile("pause" ::: "memory");
+
+    memory::kmem_free_8k(t->kernel_stack);
+    memory::free_page_directory(t->page_directory);
+    t->kernel_stack = nullptr;
+    t->page_directory = 0;
+    task::release(t);
+    __atomic_add_fetch(&reaped, 1, __ATOMIC_RELAXED);
+}
+
+static void reaper_task() {
+    while (true) {
+        reaper_queue.wait_until([] { return !zombies.lonely(); });
+
+        // take the whole batch at once, exiting tasks don't wait for the lock while it's being freed
+        ds::intrusive_doubly_linked_node<task_scheduling> batch;
+        {
+            scoped_spinlock lock {zombie_lock};
+            while (!zombies.lonely()) {
+                task_scheduling *z = zombies.get_next();
+                z->unlink();
+                batch.get_prev()->add_after_self(z);
+            }
+        }
+        while (!batch.lonely()) {
+            task_scheduling *z = batch.get_next();
+            z->unlink();
+            reap(task::from(z));
+        }
+    }
+}
+
+void scheduler::start_reaper() {
+    link_task(task::allocate(reaper_task));
+}
+
+void scheduler::add_zombie(task *t) {
+    {
+        scoped_spinlock lock {zombie_lock};
+        zombies.get_prev()->add_after_self(&t->scheduling);
+    }
+    reaper_queue.wake_one();
+}
+
+uint32_t scheduler::tasks_reaped() {
+    return __atomic_load_n(&reaped, __ATOMIC_RELAXED);
+}
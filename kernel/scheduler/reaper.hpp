@@ -0,0 +1,16 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// exiting tasks become zombies, which the reaper task frees in batches: their kernel stack, their page directory
+// with everything it maps in userspace and its hmem mapping table - and then it drops the scheduler's reference
+namespace scheduler {
+    struct task;
+
+    // create the reaper task, called by initialize
+    void start_reaper();
+    // called by exit, with interrupts disabled and the task unlinked from its run queue
+    void add_zombie(task *t);
+
+    // number of tasks reaped so far, for tests and statistics
+    uint32_t tasks_reaped();
+}
@@ -0,0 +1,64 @@
+#include <kernel/scheduler/rwlock.hpp>
+
+using scheduler::concurrency::rwlock;
+
+// the state is only changed under m_lock - within wait_until's predicate, the check and the change are atomic
+// waking up happens after releasing m_lock, since the predicates take it under the wait queue's lock
+
+void rwlock::read_lock() {
+    kassert_not_interrupt;
+    m_read_queue.wait_until([this] {
+        scoped_spinlock lock {m_lock};
+        if (m_writer != nullptr || m_waiting_writers != 0) {
+            return false;
+        }
+        m_readers++;
+        return true;
+    });
+}
+
+void rwlock::read_unlock() {
+    kassert_not_interrupt;
+    bool last;
+    {
+        scoped_spinlock lock {m_lock};
+        kassert(m_readers > 0);
+        last = --m_readers == 0;
+    }
+    if (last) {
+        m_write_queue.wake_one();
+    }
+}
+
+void rwlock::write_lock() {
+    kassert_not_interrupt;
+    {
+        scoped_spinlock lock {m_lock};
+        m_waiting_writers++;
+    }
+    m_write_queue.wait_until([this] {
+        scoped_spinlock lock {m_lock};
+        if (m_writer != nullptr || m_readers != 0) {
+            return false;
+        }
+        m_writer = scheduler::get_current_task();
+        m_waiting_writers--;
+        return true;
+    }, true);
+}
+
+void rwlock::write_unlock() {
+    kassert_not_interrupt;
+    bool writers_waiting;
+    {
+        scoped_spinlock lock {m_lock};
+        kassert(m_writer == scheduler::get_current_task());
+        m_writer = nullptr;
+        writers_waiting = m_waiting_writers != 0;
+    }
+    if (writers_waiting) {
+        m_write_queue.wake_one();
+    } else {
+        m_read_queue.wake_all();
+    }
+}
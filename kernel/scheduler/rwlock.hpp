@@ -0,0 +1,61 @@
+#pragma once
+#include <kernel/scheduler/wait_queue.hpp>
+
+namespace scheduler {
+    namespace concurrency {
+        // many readers or one writer, blocking
+        // writers are preferred - new readers wait while a writer is waiting, so writers don't starve
+        struct rwlock {
+        private:
+            uint32_t m_readers;          // readers currently holding the lock
+            uint32_t m_waiting_writers;  // writers blocked in write_lock
+            scheduler::task *m_writer;   // writer currently holding the lock
+            spinlock m_lock;             // guards the above, taken inside the wait queues' locks
+            wait_queue m_read_queue;
+            wait_queue m_write_queue;
+
+        public:
+            // compatible with static initialization to 0
+            inline constexpr rwlock() : m_readers {0}, m_waiting_writers {0}, m_writer {nullptr} {}
+            inline ~rwlock() { kassert(m_readers == 0 && m_writer == nullptr); }
+
+            // not applicable for interrupt context
+            void read_lock();
+            void read_unlock();
+            void write_lock();
+            void write_unlock();
+        };
+    }
+}
+
+struct scoped_read_lock {
+    inline scoped_read_lock(scheduler::concurrency::rwlock &lock) : m_lock {&lock} {
+        m_lock->read_lock();
+    }
+    inline ~scoped_read_lock() {
+        m_lock->read_unlock();
+    }
+
+    scoped_read_lock(scoped_read_lock&& other) = delete;
+    scoped_read_lock &operator=(scoped_read_lock&& other) = delete;
+    scoped_read_lock(const scoped_read_lock &other) = delete;
+    scoped_read_lock &operator=(const scoped_read_lock &other) = delete;
+private:
+    scheduler::concurrency::rwlock *m_lock;
+};
+
+struct scoped_write_lock {
+    inline scoped_write_lock(scheduler::concurrency::rwlock &lock) : m_lock {&lock} {
+        m_lock->write_lock();
+    }
+    inline ~scoped_write_lock() {
+        m_lock->write_unlock();
+    }
+
+    scoped_write_lock(scoped_write_lock&& other) = delete;
+    scoped_write_lock &operator=(scoped_write_lock&& other) = delete;
+    scoped_write_lock(const scoped_write_lock &other) = delete;
+    scoped_write_lock &operator=(const scoped_write_lock &other) = delete;
+private:
+    scheduler::concurrency::rwlock *m_lock;
+};
@@ -1,18 +1,28 @@
 #pragma once
 #include <kernel/scheduler/init.hpp>
 #include <kernel/scheduler/task_blocking.hpp>
+#include <kernel/scheduler/accounting.hpp>
+#include <kernel/scheduler/latency.hpp>
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/fs/fd_table.hpp>
 
 namespace scheduler {
     struct task final : ds::intrusive_refcount {
     public:
         uint32_t pid;
         char *stack_pointer;  // should have an interrupts::interrupt_args at the top
+        char *kernel_stack;   // the 8K the stack is in, freed by the reaper
+        reg_t page_directory; // physical address, freed by the reaper
         memory::virtual_memory vm;
+        fs::fd_table files;
 
     public:
         // subsystems
         task_scheduling scheduling;
         task_blocking blocking;
+        task_accounting accounting;
+        task_latency latency;
+        task_fpu fpu;
 
         // access from subsystems
         inline static task *from(task_scheduling *x) { return container_of(x, task, scheduling); }
@@ -29,6 +39,6 @@ namespace scheduler {
 
     public:
         // please only construct using allocate
-        task(uint32_t _pid, char *_stack_pointer);
+        task(uint32_t _pid, char *_stack_pointer, reg_t _page_directory);
     };
 }
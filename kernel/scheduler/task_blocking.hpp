@@ -3,19 +3,53 @@
 #include <kernel/scheduler/init.hpp>
 
 namespace scheduler {
+    namespace concurrency {
+        struct mutex;
+        // a mutex is linked to the other mutexes held by its owner
+        struct held_mutex_node final : public ds::intrusive_doubly_linked_node<held_mutex_node> {};
+    }
+
     // blocked tasks are part of a linked list
     struct task_blocking final : private ds::intrusive_doubly_linked_node<task_blocking> {
         // needed for casting within the link
         friend ds::intrusive_doubly_linked_node<task_blocking>;
+    private:
+        // exclusive waiters are woken up one at a time, see wait_queue
+        bool m_exclusive = false;
+
+    public:
+        // for priority inheritance: the mutex this task is blocked on, if any
+        concurrency::mutex *waiting_on = nullptr;
+        // for priority inheritance: the mutexes owned by this task
+        ds::intrusive_doubly_linked_node<concurrency::held_mutex_node> held_mutexes;
+
     public:
         // am i a member of a larger list blocking for something?
         inline bool is_blocked() {
             return !lonely();
         }
 
+        inline bool is_exclusive() {
+            return m_exclusive;
+        }
+
         // add myself to a blocking list
-        inline void block_on(ds::intrusive_doubly_linked_node<task_blocking> *list) {
-            list->get_prev()->add_after_self(this);
+        // exclusive waiters go to the end of the list (FIFO), non-exclusive waiters go before all of them,
+        // so waking up can stop at the first exclusive waiter
+        inline void block_on(ds::intrusive_doubly_linked_node<task_blocking> *list, bool exclusive = false) {
+            m_exclusive = exclusive;
+            if (exclusive) {
+                list->get_prev()->add_after_self(this);
+            } else {
+                list->add_after_self(this);
+            }
+        }
+
+        // add myself to a blocking list, right before another blocked task
+        inline void block_before(task_blocking *other) {
+            kassert(other->is_blocked());
+            m_exclusive = true;
+            other->get_prev()->add_after_self(this);
         }
 
         inline void unblock() {
@@ -0,0 +1,49 @@
+#include <kernel/scheduler/timer.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/util/spinlock.hpp>
+
+using scheduler::timer;
+
+static ds::intrusive_doubly_linked_node<timer> wheel[scheduler::TIMER_WHEEL_SLOTS];  // global
+static spinlock timer_lock;  // global, guards the wheel and the timers in it
+
+bool scheduler::add_timer(timer &t, uint32_t delay) {
+    scoped_spinlock lock {timer_lock};
+    if (t.armed)
+        return false;
+    // at least delay full ticks - the current one has partly passed already
+    t.expires = ticks() + delay + 1;
+    t.armed = true;
+    wheel[t.expires % TIMER_WHEEL_SLOTS].add_after_self(&t);
+    return true;
+}
+
+bool scheduler::del_timer(timer &t) {
+    scoped_spinlock lock {timer_lock};
+    if (!t.armed)
+        return false;
+    t.unlink();
+    t.armed = false;
+    return true;
+}
+
+// looks for one expired timer at a time, and calls it without the lock - so it may re-arm itself,
+// and there is never a timer which is neither in the wheel nor disarmed
+static timer *take_expired(uint32_t now) {
+    scoped_spinlock lock {timer_lock};
+    auto &slot = wheel[now % scheduler::TIMER_WHEEL_SLOTS];
+    for (timer *t = slot.get_next(); t != &slot; t = t->get_next()) {
+        if (static_cast<int32_t>(now - t->expires) >= 0) {
+            t->unlink();
+            t->armed = false;
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+void scheduler::run_timers(uint32_t now) {
+    kassert_is_interrupt;
+    while (timer *t = take_expired(now))
+        t->func(t);
+}
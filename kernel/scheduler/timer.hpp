@@ -0,0 +1,28 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/util/ds/list.hpp>
+
+// one-shot timers with tick resolution, in a hashed timer wheel: a timer waits in the slot of its expiry tick
+// modulo the wheel size, so every tick only looks at one slot - timers further away than a turn of the wheel
+// are passed over until their turn comes
+namespace scheduler {
+    constexpr uint32_t TIMER_WHEEL_SLOTS = 256;
+
+    struct timer final : ds::intrusive_doubly_linked_node<timer> {
+        // called from the timer interrupt on the bootstrap processor, with interrupts disabled - keep it short
+        void (*func)(timer *t);
+        uint32_t expires;  // in scheduler::ticks
+        bool armed;
+
+        inline constexpr timer(void (*f)(timer *)) : func(f), expires(0), armed(false) {}
+    };
+
+    // run func after at least delay ticks, may be called from interrupt context
+    // returns false (and changes nothing) if the timer is already armed
+    bool add_timer(timer &t, uint32_t delay);
+    // disarm the timer, returns false if it was not armed - func may still be running on another CPU then
+    bool del_timer(timer &t);
+
+    // called by the timer interrupt on the bootstrap processor, for every tick
+    void run_timers(uint32_t now);
+}
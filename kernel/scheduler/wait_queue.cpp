@@ -0,0 +1,78 @@
+#include <kernel/scheduler/wait_queue.hpp>
+
+using scheduler::concurrency::wait_queue;
+
+void wait_queue::prepare_to_wait_locked(bool exclusive) {
+    kassert(!scheduler::get_current_task()->blocking.is_blocked());
+    scheduler::get_current_task()->blocking.block_on(&m_list, exclusive);
+}
+
+void wait_queue::prepare_to_wait(bool exclusive) {
+    kassert_not_interrupt;
+    scoped_spinlock lock {m_lock};
+    prepare_to_wait_locked(exclusive);
+}
+
+void wait_queue::finish_wait() {
+    scoped_spinlock lock {m_lock};
+    if (scheduler::get_current_task()->blocking.is_blocked()) {
+        scheduler::get_current_task()->blocking.unblock();
+    }
+}
+
+void wait_queue::wait(bool exclusive) {
+    prepare_to_wait(exclusive);
+    // we won't be resumed until we're woken up
+    scheduler::yield();
+}
+
+uint wait_queue::wake(uint nr_exclusive) {
+    scoped_spinlock lock {m_lock};
+    uint woken = 0;
+
+    while (!m_list.lonely()) {
+        task_blocking *waiter = m_list.get_next();
+        bool exclusive = waiter->is_exclusive();
+        if (exclusive && nr_exclusive == 0) {
+            break;
+        }
+
+        scheduler::note_wakeup(scheduler::task::from(waiter));
+        waiter->unblock();
+        woken++;
+        if (exclusive) {
+            nr_exclusive--;
+        }
+    }
+
+    return woken;
+}
+
+uint wait_queue::wake_all() {
+    scoped_spinlock lock {m_lock};
+    uint woken = 0;
+
+    while (!m_list.lonely()) {
+        task_blocking *waiter = m_list.get_next();
+        scheduler::note_wakeup(scheduler::task::from(waiter));
+        waiter->unblock();
+        woken++;
+    }
+
+    return woken;
+}
+
+bool wait_queue::has_waiters() {
+    scoped_spinlock lock {m_lock};
+    return !m_list.lonely();
+}
+
+uint wait_queue::num_waiters_for_tests() {
+    scoped_spinlock lock {m_lock};
+    uint count = 0;
+    for (task_blocking &waiter : m_list) {
+        kunused(waiter);
+        count++;
+    }
+    return count - 1;  // the list head itself is iterated too
+}
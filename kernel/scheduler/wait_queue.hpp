@@ -0,0 +1,58 @@
+#pragma once
+#include <kernel/scheduler/task.hpp>
+#include <kernel/util/lock.hpp>
+
+namespace scheduler {
+    namespace concurrency {
+        // a list of tasks waiting for some event
+        // waking up is allowed from interrupt context, waiting is not
+        struct wait_queue {
+        private:
+            // tasks which are waiting are linked to each other - non-exclusive first, then exclusive in FIFO order
+            ds::intrusive_doubly_linked_node<scheduler::task_blocking> m_list;
+            spinlock m_lock;
+
+            void prepare_to_wait_locked(bool exclusive);
+
+        public:
+            // compatible with static initialization
+            inline constexpr wait_queue() {}
+            inline ~wait_queue() { kassert(m_list.lonely()); }
+
+            // add the current task to the queue without yielding - the caller must yield (or finish_wait) afterwards
+            // exclusive waiters are woken up one at a time, to avoid waking up a whole herd for one event
+            void prepare_to_wait(bool exclusive = false);
+            // remove the current task from the queue, if it was not woken up yet
+            void finish_wait();
+
+            // block the current task until it is woken up
+            void wait(bool exclusive = false);
+
+            // block the current task until pred() is true
+            // pred is checked under the queue's lock, so a wake up from another CPU or an interrupt handler can't be lost
+            // in between - the waker must make pred() true before calling wake
+            template <class Pred>
+            inline void wait_until(Pred pred, bool exclusive = false) {
+                kassert_not_interrupt;
+                while (true) {
+                    {
+                        scoped_spinlock lock {m_lock};
+                        if (pred()) return;
+                        prepare_to_wait_locked(exclusive);
+                    }
+                    scheduler::yield();
+                }
+            }
+
+            // wake up all non-exclusive waiters, and at most nr_exclusive exclusive waiters
+            // returns the number of tasks woken up
+            uint wake(uint nr_exclusive);
+            inline uint wake_one() { return wake(1); }
+            // wake up everybody, exclusive or not
+            uint wake_all();
+
+            bool has_waiters();
+            uint num_waiters_for_tests();
+        };
+    }
+}
@@ -0,0 +1,184 @@
+#include <kernel/scheduler/workqueue.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/util/spinlock.hpp>
+
+using namespace scheduler;
+using concurrency::wait_queue;
+
+static ds::intrusive_doubly_linked_node<work_item> queue;  // global, work waiting for a worker
+static work_item *running[MAX_WORKERS];                    // global, what each worker runs
+static uint workers;                                       // global, started or starting
+static uint busy_workers;                                  // global, running work
+static uint started_workers;                               // global, to hand out worker ids
+static spinlock wq_lock;                                   // global, guards the above and the work items' state
+
+// workers wait for work here, exclusively - one queued item wakes one worker
+static wait_queue work_wait;
+// flush_work and flush_workqueue wait here, woken up whenever work finishes or is cancelled
+static wait_queue flush_wait;
+
+// nothing is woken up under wq_lock - the wait queue predicates read its data without it
+static void enqueue_locked(work_item &w) {
+    w.state = work_state::queued;
+    queue.get_prev()->add_after_self(&w);
+}
+
+// count one more worker if everybody is busy (maybe blocked), the caller starts it without the lock
+static bool grow_locked() {
+    if (busy_workers == workers && workers < MAX_WORKERS) {
+        workers++;
+        return true;
+    }
+    return false;
+}
+
+static void worker_main();
+
+static void start_worker() {
+    link_task(task::allocate(worker_main));
+}
+
+static bool is_work_running(work_item *w) {
+    for (uint i = 0; i < MAX_WORKERS; i++)
+        if (__atomic_load_n(&running[i], __ATOMIC_ACQUIRE) == w)
+            return true;
+    return false;
+}
+
+static void worker_main() {
+    uint id = __atomic_fetch_add(&started_workers, 1, __ATOMIC_RELAXED);
+    kassert(id < MAX_WORKERS);
+
+    while (true) {
+        work_wait.wait_until([] { return !queue.lonely(); }, true);
+
+        work_item *w;
+        bool grow = false, more = false;
+        {
+            scoped_spinlock lock {wq_lock};
+            if (queue.lonely())
+                continue;  // another worker was faster
+            w = queue.get_next();
+            w->unlink();
+            w->state = work_state::idle;
+            __atomic_store_n(&running[id], w, __ATOMIC_RELEASE);
+            busy_workers++;
+
+            more = !queue.lonely();
+            // there's more to do
+            grow = more && grow_locked();
+        }
+        if (grow)
+            start_worker();
+        else if (more)
+            work_wait.wake_one();  // maybe an idle worker
+
+        w->func(w);
+
+        {
+            scoped_spinlock lock {wq_lock};
+            __atomic_store_n(&running[id], nullptr, __ATOMIC_RELEASE);
+            busy_workers--;
+        }
+        flush_wait.wake_all();
+    }
+}
+
+void scheduler::__delayed_work_timer(timer *t) {
+    delayed_work *dw = container_of(t, delayed_work, delay_timer);
+    {
+        scoped_spinlock lock {wq_lock};
+        // cancelled meanwhile, or cancelled and delayed again
+        if (dw->work.state != work_state::delayed || t->armed)
+            return;
+        enqueue_locked(dw->work);
+    }
+    work_wait.wake_one();
+}
+
+void scheduler::init_workqueue() {
+    kassert_not_interrupt;
+    {
+        scoped_spinlock lock {wq_lock};
+        kassert(workers == 0);
+        workers = 1;
+    }
+    start_worker();
+}
+
+bool scheduler::queue_work(work_item &w) {
+    // tasks can't be started from interrupt context, the next worker to take an item grows the pool then
+    bool may_grow = !interrupts::is_interrupt_context();
+    bool grow;
+    {
+        scoped_spinlock lock {wq_lock};
+        if (w.state != work_state::idle)
+            return false;
+        enqueue_locked(w);
+        grow = may_grow && grow_locked();
+    }
+    if (grow)
+        start_worker();
+    else
+        work_wait.wake_one();
+    return true;
+}
+
+bool scheduler::queue_delayed_work(delayed_work &dw, uint32_t delay) {
+    if (delay == 0)
+        return queue_work(dw.work);
+
+    scoped_spinlock lock {wq_lock};
+    if (dw.work.state != work_state::idle)
+        return false;
+    dw.work.state = work_state::delayed;
+    bool armed = add_timer(dw.delay_timer, delay);
+    kassert(armed);  // only armed while delayed
+    return true;
+}
+
+bool scheduler::cancel_work(work_item &w) {
+    {
+        scoped_spinlock lock {wq_lock};
+        if (w.state != work_state::queued)
+            return false;
+        w.unlink();
+        w.state = work_state::idle;
+    }
+    flush_wait.wake_all();
+    return true;
+}
+
+bool scheduler::cancel_delayed_work(delayed_work &dw) {
+    {
+        scoped_spinlock lock {wq_lock};
+        if (dw.work.state == work_state::idle)
+            return false;
+        if (dw.work.state == work_state::delayed)
+            del_timer(dw.delay_timer);  // if it is expiring right now, it sees the state and does nothing
+        else
+            dw.work.unlink();
+        dw.work.state = work_state::idle;
+    }
+    flush_wait.wake_all();
+    return true;
+}
+
+void scheduler::flush_work(work_item &w) {
+    kassert_not_interrupt;
+    flush_wait.wait_until([&w] {
+        return __atomic_load_n(&w.state, __ATOMIC_ACQUIRE) != work_state::queued && !is_work_running(&w);
+    });
+}
+
+void scheduler::flush_workqueue() {
+    kassert_not_interrupt;
+    flush_wait.wait_until([] {
+        return queue.lonely() && __atomic_load_n(&busy_workers, __ATOMIC_ACQUIRE) == 0;
+    });
+}
+
+uint scheduler::nr_workers() {
+    return __atomic_load_n(&workers, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/util/ds/list.hpp>
+#include <kernel/scheduler/timer.hpp>
+
+// asynchronous kernel work, run by a pool of worker tasks
+// the pool starts with one worker, and another one is added (up to MAX_WORKERS) when a task queues an item, or a
+// worker takes one while more are waiting, and no worker is idle - so a work item which blocks doesn't hold up the
+// rest. Items queued from interrupt context wait for the next worker which finishes or takes an item then
+//
+// work items run in task context and may block, in the order they were queued - but with more than one worker
+// they may overlap, and an item queued again while it runs may run again at the same time
+namespace scheduler {
+    constexpr uint MAX_WORKERS = 8;
+
+    enum class work_state : uint8_t {
+        idle,     // not pending, may be running
+        delayed,  // waiting for its timer
+        queued,   // waiting for a worker
+    };
+
+    struct work_item final : ds::intrusive_doubly_linked_node<work_item> {
+        void (*func)(work_item *w);  // may free the item, it isn't touched after func is called
+        work_state state;            // guarded by the work queue's lock
+
+        inline constexpr work_item(void (*f)(work_item *)) : func(f), state(work_state::idle) {}
+    };
+
+    void __delayed_work_timer(timer *t);
+
+    // a work item which is queued when its timer expires
+    struct delayed_work {
+        work_item work;
+        timer delay_timer;
+
+        inline constexpr delayed_work(void (*f)(work_item *)) : work(f), delay_timer(__delayed_work_timer) {}
+        // the delayed_work of its work item, in func
+        inline static delayed_work *from(work_item *w) { return container_of(w, delayed_work, work); }
+    };
+
+    // start the first worker, after the scheduler is initialized
+    void init_workqueue();
+
+    // queue work to run as soon as a worker is free, may be called from interrupt context
+    // returns false (and changes nothing) if it is already pending
+    bool queue_work(work_item &w);
+    // queue work after at least delay ticks, may be called from interrupt context
+    bool queue_delayed_work(delayed_work &dw, uint32_t delay);
+
+    // remove pending work, returns false if it wasn't pending - it may still be running then
+    bool cancel_work(work_item &w);
+    bool cancel_delayed_work(delayed_work &dw);
+
+    // wait until the work item is neither pending nor running (delayed work which is still waiting for its
+    // timer is not waited for), do NOT call from interrupt context
+    void flush_work(work_item &w);
+    // wait until no work is queued or running, do NOT call from interrupt context
+    void flush_workqueue();
+
+    // number of worker tasks, for tests and statistics
+    uint nr_workers();
+}
@@ -1,9 +1,16 @@
 #include <kernel/serial.hpp>
+#include <kernel/logging.hpp>
 #include <kernel/util/asm_wrap.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/devices/console.hpp>
+
+spinlock log_lock;
 
 // The I/O ports
 static constexpr unsigned short SERIAL_COM1_BASE = 0x3F8;  // COM1 base port
 static inline constexpr unsigned short SERIAL_DATA_PORT(unsigned short base)          { return base; }
+static inline constexpr unsigned short SERIAL_INTERRUPT_ENABLE_PORT(unsigned short base) { return base + 1; }
+static inline constexpr unsigned short SERIAL_INTERRUPT_ID_PORT(unsigned short base)  { return base + 2; }
 static inline constexpr unsigned short SERIAL_FIFO_COMMAND_PORT(unsigned short base)  { return base + 2; }
 static inline constexpr unsigned short SERIAL_LINE_COMMAND_PORT(unsigned short base)  { return base + 3; }
 static inline constexpr unsigned short SERIAL_MODEM_COMMAND_PORT(unsigned short base) { return base + 4; }
@@ -17,6 +24,14 @@ static inline constexpr unsigned short SERIAL_LINE_STATUS_PORT(unsigned short ba
  */
 static constexpr unsigned char SERIAL_LINE_ENABLE_DLAB = 0x80;
 
+static constexpr unsigned char SERIAL_FIFO_ENABLE_CLEAR = 0xC7;   // enable and clear both FIFOs, 14 byte receive trigger
+static constexpr unsigned char SERIAL_MODEM_DTR_RTS_OUT2 = 0x0B;  // OUT2 connects the UART's interrupt line to the PIC
+static constexpr unsigned char SERIAL_INTERRUPT_DATA_AVAILABLE = 0x01;
+static constexpr unsigned char SERIAL_INTERRUPT_THR_EMPTY = 0x02;
+static constexpr unsigned char SERIAL_LINE_DATA_READY = 0x01;
+static constexpr unsigned char SERIAL_ID_FIFO_ENABLED = 0xC0;     // both bits set by a 16550A with working FIFOs
+static constexpr uint SERIAL_FIFO_SIZE = 16;
+
 /** serial_configure_baud_rate:
  *  Sets the speed of the data being sent. The default speed of a serial
  *  port is 115200 bits/s. The argument is a divisor of that number, hence
@@ -50,18 +65,183 @@ static void serial_configure_line(unsigned short com) {
     asm_outb(SERIAL_LINE_COMMAND_PORT(com), 0x03);
 }
 
+static bool serial_is_data_ready(unsigned short com) {
+    return (asm_inb(SERIAL_LINE_STATUS_PORT(com)) & SERIAL_LINE_DATA_READY) != 0;
+}
+
 static bool serial_is_transmit_fifo_empty(unsigned short com) {
     return (asm_inb(SERIAL_LINE_STATUS_PORT(com)) & 0x20) != 0;
 }
 
+// transmit ring, lock-free for the writers: a writer claims a slot by advancing reserved, and fills it with the
+// character and FILLED. The transmitter empties slots in order, from tail
+static constexpr uint32_t TX_RING_SIZE = 8192;
+static constexpr uint16_t FILLED = 0x100;
+static uint16_t tx_ring[TX_RING_SIZE];  // global, 0 for an empty slot
+static uint32_t tx_reserved;            // global, the next slot to claim
+static uint32_t tx_tail;                // global, the next slot to transmit
+
+static spinlock transmitter;          // global, taken only with try_lock, by whoever feeds the FIFO
+static uint fifo_size = 1;            // global, set once by initialize
+static bool interrupt_driven;         // global, set once by enable_interrupts
+
+static bool try_enqueue(char c) {
+    uint32_t slot = __atomic_load_n(&tx_reserved, __ATOMIC_RELAXED);
+    do {
+        if (slot - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE) >= TX_RING_SIZE)
+            return false;
+    } while (!__atomic_compare_exchange_n(&tx_reserved, &slot, slot + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_store_n(&tx_ring[slot % TX_RING_SIZE], FILLED | static_cast<unsigned char>(c), __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool tx_ring_has_data() {
+    uint32_t tail = __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&tx_ring[tail % TX_RING_SIZE], __ATOMIC_ACQUIRE) != 0;
+}
+
+// refill the FIFO if it is empty - its next THR empty interrupt continues from there
+static void transmit() {
+    while (true) {
+        // whoever holds transmitter checks for new data again after unlocking
+        if (!transmitter.try_lock())
+            return;
+        if (serial_is_transmit_fifo_empty(SERIAL_COM1_BASE)) {
+            uint32_t tail = tx_tail;
+            for (uint i = 0; i < fifo_size; i++, tail++) {
+                uint16_t &slot = tx_ring[tail % TX_RING_SIZE];
+                uint16_t value = __atomic_load_n(&slot, __ATOMIC_ACQUIRE);
+                if (value == 0)
+                    break;  // empty, or claimed but not filled yet
+                asm_outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), static_cast<unsigned char>(value));
+                // empty the slot before a writer may claim it again
+                __atomic_store_n(&slot, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&tx_tail, tail + 1, __ATOMIC_RELEASE);
+            }
+        }
+        transmitter.unlock();
+        if (!tx_ring_has_data() || !serial_is_transmit_fifo_empty(SERIAL_COM1_BASE))
+            return;
+    }
+}
+
+// received characters waiting to be read, ring buffer
+static constexpr size_t RX_RING_SIZE = 1024;
+static char rx_ring[RX_RING_SIZE];                         // global
+static size_t rx_head;                                     // global, next index to read
+static size_t rx_count;                                    // global
+static uint32_t rx_dropped;                                // global
+static scheduler::concurrency::wait_queue rx_wait_queue;  // global, readers of /dev/ttyS0
+static spinlock rx_lock;                                   // global, guards the above
+
 void serial::initialize() {
     serial_configure_baud_rate(SERIAL_COM1_BASE, 1);
     serial_configure_line(SERIAL_COM1_BASE);
+    asm_outb(SERIAL_FIFO_COMMAND_PORT(SERIAL_COM1_BASE), SERIAL_FIFO_ENABLE_CLEAR);
+    asm_outb(SERIAL_MODEM_COMMAND_PORT(SERIAL_COM1_BASE), SERIAL_MODEM_DTR_RTS_OUT2);
+    if ((asm_inb(SERIAL_INTERRUPT_ID_PORT(SERIAL_COM1_BASE)) & SERIAL_ID_FIFO_ENABLED) == SERIAL_ID_FIFO_ENABLED)
+        fifo_size = SERIAL_FIFO_SIZE;
+}
+
+void serial::enable_interrupts() {
+    kassert(!interrupt_driven);
+    __atomic_store_n(&interrupt_driven, true, __ATOMIC_RELEASE);
+    asm_outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE),
+             SERIAL_INTERRUPT_DATA_AVAILABLE | SERIAL_INTERRUPT_THR_EMPTY);
+    transmit();
+}
+
+void serial::on_interrupt() {
+    // reading the interrupt id acknowledges THR empty, refilling would too
+    asm_inb(SERIAL_INTERRUPT_ID_PORT(SERIAL_COM1_BASE));
+    // emptying the receive FIFO acknowledges data available, and its timeout
+    while (serial_is_data_ready(SERIAL_COM1_BASE))
+        receive(static_cast<char>(asm_inb(SERIAL_DATA_PORT(SERIAL_COM1_BASE))));
+    transmit();
+}
+
+void serial::receive(char c) {
+    // terminals send \r for enter and DEL for backspace, the shell expects what the keyboard sends
+    if (c == '\r')
+        c = '\n';
+    else if (c == 0x7f)
+        c = '\b';
+    {
+        scoped_spinlock lock {rx_lock};
+        if (rx_count == RX_RING_SIZE) {
+            rx_dropped++;
+            return;
+        }
+        rx_ring[(rx_head + rx_count) % RX_RING_SIZE] = c;
+        rx_count++;
+        rx_wait_queue.wake_one();
+    }
+    devices::console::wake();
+    // the other end of the line doesn't echo, like the keyboard's echo on the screen
+    if (c == '\b') {
+        put('\b');
+        put(' ');
+    }
+    put(c);
+}
+
+bool serial::has_input() {
+    return __atomic_load_n(&rx_count, __ATOMIC_RELAXED) != 0;
+}
+
+size_t serial::try_read(char *buf, size_t count) {
+    scoped_spinlock lock {rx_lock};
+    size_t i = 0;
+    while (i < count && rx_count != 0) {
+        buf[i++] = rx_ring[rx_head];
+        rx_head = (rx_head + 1) % RX_RING_SIZE;
+        rx_count--;
+    }
+    if (rx_count != 0) {
+        // leftovers for another reader
+        rx_wait_queue.wake_one();
+    }
+    return i;
+}
+
+size_t serial::read(char *buf, size_t count) {
+    kassert_not_interrupt;
+    if (count == 0) return 0;
+
+    while (true) {
+        // readers are exclusive waiters - one received character shouldn't wake up all of them
+        rx_wait_queue.wait_until([] { return rx_count != 0; }, true);
+        size_t done = try_read(buf, count);
+        if (done != 0)
+            return done;
+        // another reader was faster
+    }
+}
+
+uint32_t serial::dropped() {
+    scoped_spinlock lock {rx_lock};
+    return rx_dropped;
 }
 
 void serial::put(char c) {
-    while (!serial_is_transmit_fifo_empty(SERIAL_COM1_BASE))
+    while (!try_enqueue(c)) {
+        // full - wait for the transmitter, which may be this CPU with interrupts disabled
+        transmit();
         asm volatile("pause" ::: "memory");
+    }
+    if (__atomic_load_n(&interrupt_driven, __ATOMIC_ACQUIRE))
+        transmit();
+    else
+        flush();
+}
+
+void serial::flush() {
+    while (tx_ring_has_data()) {
+        transmit();
+        asm volatile("pause" ::: "memory");
+    }
+}
 
-    asm_outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), c);
+uint32_t serial::pending() {
+    return __atomic_load_n(&tx_reserved, __ATOMIC_RELAXED) - __atomic_load_n(&tx_tail, __ATOMIC_RELAXED);
 }
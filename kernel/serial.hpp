@@ -2,10 +2,34 @@
 #include <kernel/util.hpp>
 #include <kernel/formatting.hpp>
 
+// COM1 - put only queues the character in a transmit ring, which the UART's THR empty interrupt drains once
+// enable_interrupts was called. Until then put transmits it right away, polling.
+// Received characters go to a receive ring, for /dev/ttyS0 and the console, see devices/console.hpp
 namespace serial {
     void initialize();
+    // call once COM1's IRQ (4) is unmasked
+    void enable_interrupts();
+    // called by the IRQ handler
+    void on_interrupt();
+
+    // waits only while the ring is full
     void put(char c);
+    // transmit everything queued, polling - before halting or with the interrupt blocked
+    void flush();
+    // characters queued but not transmitted yet
+    uint32_t pending();
     inline void set_color(formatting::color_pair) {}
+
+    // a character received on the line, called by the IRQ handler - echoes it, and translates \r to \n
+    void receive(char c);
+    // read up to count received characters
+    // blocks until at least one character is available, do NOT call from interrupt context
+    size_t read(char *buf, size_t count);
+    // the same without blocking, may return 0
+    size_t try_read(char *buf, size_t count);
+    bool has_input();
+    // received characters dropped because nobody read them
+    uint32_t dropped();
 }
 
 using serial_driver = formatting::log_driver<serial::put, serial::set_color>;
@@ -0,0 +1,324 @@
+#include <kernel/smp/init.hpp>
+#include <kernel/interrupts/apic.hpp>
+#include <kernel/interrupts/ioapic.hpp>
+#include <kernel/interrupts/pic.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/syscalls/init.hpp>
+#include <kernel/util/string.hpp>
+#include <kernel/util/lock.hpp>
+#include <kernel/logging.hpp>
+
+using memory::phys_t;
+
+// Intel MultiProcessor Specification 1.4 tables
+struct __attribute__((packed)) mp_floating_pointer {
+    char signature[4];  // "_MP_"
+    uint32_t config_table;
+    uint8_t length;     // in 16 byte units
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t default_config;
+    uint8_t features[4];
+};
+
+struct __attribute__((packed)) mp_config_table {
+    char signature[4];  // "PCMP"
+    uint16_t base_length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t extended_length;
+    uint8_t extended_checksum;
+    uint8_t reserved;
+};
+
+enum class mp_entry_type : uint8_t {
+    processor = 0,      // 20 bytes, all others are 8
+    bus = 1,
+    ioapic = 2,
+    io_interrupt = 3,
+    local_interrupt = 4,
+};
+
+struct __attribute__((packed)) mp_processor_entry {
+    mp_entry_type type;
+    uint8_t lapic_id;
+    uint8_t lapic_version;
+    uint8_t flags;      // bit 0 - enabled, bit 1 - bootstrap processor
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+};
+
+struct __attribute__((packed)) mp_bus_entry {
+    mp_entry_type type;
+    uint8_t id;
+    char bus_type[6];   // "ISA   ", "PCI   "...
+};
+
+struct __attribute__((packed)) mp_ioapic_entry {
+    mp_entry_type type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;      // bit 0 - enabled
+    uint32_t address;
+};
+
+struct __attribute__((packed)) mp_io_interrupt_entry {
+    mp_entry_type type;
+    uint8_t interrupt_type;  // 0 - vectored by the APIC
+    uint16_t flags;          // polarity and trigger mode
+    uint8_t source_bus;
+    uint8_t source_irq;
+    uint8_t dest_ioapic;     // 0xFF - all of them
+    uint8_t dest_pin;
+};
+
+static_assert(sizeof(mp_processor_entry) == 20);
+static_assert(sizeof(mp_bus_entry) == 8);
+static_assert(sizeof(mp_ioapic_entry) == 8);
+static_assert(sizeof(mp_io_interrupt_entry) == 8);
+
+// keyboard and COM1 IRQs, at the same vectors as through the PIC
+static constexpr uint KEYBOARD_IRQ = 1;
+static constexpr uint KEYBOARD_VECTOR = 0x21;
+static constexpr uint SERIAL_IRQ = 4;
+static constexpr uint SERIAL_VECTOR = 0x24;
+
+// at ap_trampoline_params in smp/trampoline.s
+struct trampoline_params {
+    reg_t cr3;
+    reg_t stack;
+    smp::percpu *cpu;
+};
+
+extern "C" {
+    extern char ap_trampoline_start;
+    extern char ap_trampoline_params;
+    extern char ap_trampoline_end;
+}
+
+static constexpr phys_t AP_TRAMPOLINE_ADDR = phys_t(0x8000);  // must match smp/trampoline.s
+static smp::topology machine;
+static uint num_online = 1;
+
+static bool checksum_ok(const void *start, size_t length) {
+    const uint8_t *p = static_cast<const uint8_t *>(start);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++)
+        sum += p[i];
+    return sum == 0;
+}
+
+// all of these are in the first megabyte, which is mapped at 0xC0000000
+static mp_floating_pointer *search_floating_pointer(uint32_t phys_start, uint32_t length) {
+    for (uint32_t addr = phys_start; addr + sizeof(mp_floating_pointer) <= phys_start + length; addr += 16) {
+        auto *fp = reinterpret_cast<mp_floating_pointer *>(phys_t(addr).to_virt());
+        if (memcmp(fp->signature, "_MP_", 4) == 0 && checksum_ok(fp, fp->length * 16))
+            return fp;
+    }
+    return nullptr;
+}
+
+static mp_floating_pointer *find_floating_pointer() {
+    // first KB of the EBDA, last KB of base memory, or the BIOS ROM
+    uint32_t ebda = static_cast<uint32_t>(*reinterpret_cast<uint16_t *>(phys_t(0x40E).to_virt())) << 4;
+    mp_floating_pointer *fp = nullptr;
+    if (ebda != 0)
+        fp = search_floating_pointer(ebda, 1024);
+    if (fp == nullptr)
+        fp = search_floating_pointer(0x9FC00, 1024);
+    if (fp == nullptr)
+        fp = search_floating_pointer(0xF0000, 0x10000);
+    return fp;
+}
+
+// fills in machine and the CPU list, returns false if the system should stay uniprocessor
+static bool read_mp_tables() {
+    mp_floating_pointer *fp = find_floating_pointer();
+    if (fp == nullptr) {
+        TINY_INFO("No MP floating pointer structure");
+        return false;
+    }
+    if (fp->default_config != 0 || fp->config_table == 0 || fp->config_table >= 0x100000) {
+        TINY_WARN("Unsupported MP configuration ", fp->default_config, " at ", formatting::hex{fp->config_table});
+        return false;
+    }
+
+    auto *table = reinterpret_cast<mp_config_table *>(phys_t(fp->config_table).to_virt());
+    if (memcmp(table->signature, "PCMP", 4) != 0 || !checksum_ok(table, table->base_length)) {
+        TINY_WARN("Bad MP configuration table");
+        return false;
+    }
+    machine.lapic_phys = phys_t(table->lapic_address);
+    // ISA IRQs are identity mapped unless the table says otherwise
+    for (uint irq = 0; irq < 16; irq++) {
+        machine.isa_irq_pin[irq] = irq;
+        machine.isa_irq_flags[irq] = 0;
+    }
+    uint isa_bus = 0x100;  // none
+
+    char *entry = reinterpret_cast<char *>(table + 1);
+    for (uint i = 0; i < table->entry_count; i++) {
+        mp_entry_type type = *reinterpret_cast<mp_entry_type *>(entry);
+        if (type == mp_entry_type::processor) {
+            auto *cpu = reinterpret_cast<mp_processor_entry *>(entry);
+            if ((cpu->flags & 1) == 0) {
+                // disabled
+            } else if (cpu->flags & 2) {
+                smp::get_cpu(0).apic_id = cpu->lapic_id;
+            } else if (smp::add_cpu(cpu->lapic_id) == nullptr) {
+                TINY_WARN("Too many CPUs, ignoring APIC id ", (uint)cpu->lapic_id);
+            }
+            entry += sizeof(mp_processor_entry);
+        } else {
+            // entries are sorted by type, so buses and IOAPICs come before the interrupts routed through them
+            if (type == mp_entry_type::bus) {
+                auto *bus = reinterpret_cast<mp_bus_entry *>(entry);
+                if (memcmp(bus->bus_type, "ISA", 3) == 0)
+                    isa_bus = bus->id;
+            } else if (type == mp_entry_type::ioapic) {
+                auto *ioapic = reinterpret_cast<mp_ioapic_entry *>(entry);
+                if ((ioapic->flags & 1) && machine.ioapic_phys.value() == 0) {
+                    machine.ioapic_phys = phys_t(ioapic->address);
+                    machine.ioapic_id = ioapic->id;
+                }
+            } else if (type == mp_entry_type::io_interrupt) {
+                auto *irq = reinterpret_cast<mp_io_interrupt_entry *>(entry);
+                if (irq->interrupt_type == 0 && irq->source_bus == isa_bus && irq->source_irq < 16 &&
+                        (irq->dest_ioapic == machine.ioapic_id || irq->dest_ioapic == 0xFF)) {
+                    machine.isa_irq_pin[irq->source_irq] = irq->dest_pin;
+                    machine.isa_irq_flags[irq->source_irq] = irq->flags;
+                }
+            }
+            entry += 8;
+        }
+    }
+    return true;
+}
+
+static void wait_ticks(uint32_t n) {
+    // the timer interrupt counts ticks even before the scheduler runs
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() - start < n)
+        asm volatile("pause" ::: "memory");
+}
+
+static bool wait_online(smp::percpu &cpu, uint32_t n) {
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() - start < n) {
+        if (__atomic_load_n(&cpu.online, __ATOMIC_ACQUIRE))
+            return true;
+        asm volatile("pause" ::: "memory");
+    }
+    return __atomic_load_n(&cpu.online, __ATOMIC_ACQUIRE);
+}
+
+static bool boot_ap(smp::percpu &cpu, trampoline_params *params) {
+    params->cr3 = memory::kernel_page_directory();
+    params->stack = reinterpret_cast<reg_t>(memory::kmem_alloc_8k()) + 8192;
+    params->cpu = &cpu;
+    asm volatile("" ::: "memory");
+
+    // INIT, then up to two STARTUPs, as in the MP specification
+    interrupts::apic::send_init(cpu.apic_id);
+    wait_ticks(10);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        interrupts::apic::send_startup(cpu.apic_id, AP_TRAMPOLINE_ADDR);
+        if (wait_online(cpu, attempt == 0 ? 2 : 100))
+            return true;
+    }
+    // the stack is leaked on purpose - the CPU might still wake up and use it
+    return false;
+}
+
+static void boot_aps() {
+    // copy the trampoline below 1MB
+    char *trampoline = reinterpret_cast<char *>(AP_TRAMPOLINE_ADDR.to_virt());
+    size_t trampoline_size = &ap_trampoline_end - &ap_trampoline_start;
+    kassert(trampoline_size <= 4096);
+    memcpy(trampoline, &ap_trampoline_start, trampoline_size);
+    auto *params = reinterpret_cast<trampoline_params *>(trampoline + (&ap_trampoline_params - &ap_trampoline_start));
+
+    memory::set_low_identity_mapping(true);
+    for (uint i = 1; i < smp::cpu_count(); i++) {
+        smp::percpu &cpu = smp::get_cpu(i);
+        if (boot_ap(cpu, params)) {
+            num_online++;
+        } else {
+            TINY_WARN("CPU ", i, " with APIC id ", (uint)cpu.apic_id, " did not start");
+        }
+    }
+    memory::set_low_identity_mapping(false);
+}
+
+// the PIT and the PIC did their job during boot, the APICs take over
+static void switch_to_apics() {
+    scoped_intlock lock;
+    if (machine.ioapic_phys.value() != 0) {
+        interrupts::ioapic::initialize(machine.ioapic_phys);
+        interrupts::ioapic::route_isa_irq(KEYBOARD_IRQ, KEYBOARD_VECTOR, smp::get_cpu(0).apic_id);
+        interrupts::ioapic::route_isa_irq(SERIAL_IRQ, SERIAL_VECTOR, smp::get_cpu(0).apic_id);
+        interrupts::pic_disable();
+    } else {
+        // keep the PIC for the keyboard and COM1
+        interrupts::pic_disable_timer();
+    }
+    interrupts::apic::start_timer();
+}
+
+void smp::initialize() {
+    kassert(scheduler::get_current_task() == nullptr);
+    if (!read_mp_tables())
+        return;
+
+    interrupts::apic::map(machine.lapic_phys);
+    interrupts::apic::enable();
+    get_cpu(0).apic_id = interrupts::apic::id();
+    // while the PIT still ticks - application processors start their timers right away
+    interrupts::apic::calibrate_timer();
+
+    if (cpu_count() > 1)
+        boot_aps();
+    // booting the application processors waits for PIT ticks, so switch afterwards
+    switch_to_apics();
+
+    TINY_INFO("SMP: ", num_online, " of ", cpu_count(), " CPUs online",
+              interrupts::ioapic::is_initialized() ? ", IRQs through the IOAPIC" : ", IRQs through the PIC");
+}
+
+const smp::topology &smp::get_topology() {
+    return machine;
+}
+
+bool smp::is_smp() {
+    return num_online > 1;
+}
+
+uint smp::online_count() {
+    return __atomic_load_n(&num_online, __ATOMIC_ACQUIRE);
+}
+
+// entry point of application processors, from smp/trampoline.s
+extern "C" [[noreturn]] void ap_main(smp::percpu *cpu) {
+    memory::init_cpu_gdt(*cpu);
+    interrupts::load_idt();
+    syscalls::init_cpu();
+    scheduler::fpu::init_cpu();
+    interrupts::apic::enable();
+    kassert(interrupts::apic::id() == cpu->apic_id);
+    interrupts::apic::start_timer();
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+
+    // run tasks as soon as the bootstrap processor has initialized the scheduler
+    scheduler::start();
+    kpanic("scheduler::start returned");
+    __builtin_unreachable();
+}
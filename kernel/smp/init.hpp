@@ -0,0 +1,26 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/smp/percpu.hpp>
+
+namespace smp {
+    // what the firmware told us about the machine
+    struct topology {
+        memory::phys_t lapic_phys;
+        memory::phys_t ioapic_phys;  // 0 if not found
+        uint8_t ioapic_id;
+        // the IOAPIC input and MP specification interrupt flags of each ISA IRQ
+        uint8_t isa_irq_pin[16];
+        uint16_t isa_irq_flags[16];
+    };
+
+    // discover the CPUs from the MP tables, and start the application processors
+    // every CPU gets its local APIC timer, and device IRQs go through the IOAPIC if there is one
+    // call on the bootstrap processor, after interrupts::start and before the scheduler is initialized
+    // without MP tables the system stays uniprocessor, with the 8259 PIC and the PIT
+    void initialize();
+    const topology &get_topology();
+    bool is_smp();
+    // number of CPUs which are running
+    uint online_count();
+}
@@ -0,0 +1,25 @@
+#include <kernel/smp/percpu.hpp>
+
+// the bootstrap processor's entry is set up by memory::init_gdt, smp::initialize adds the others
+static smp::percpu cpus[smp::MAX_CPUS];
+static uint num_cpus = 1;
+
+uint smp::cpu_count() {
+    return __atomic_load_n(&num_cpus, __ATOMIC_ACQUIRE);
+}
+
+smp::percpu &smp::get_cpu(uint index) {
+    kassert(index < cpu_count());
+    return cpus[index];
+}
+
+smp::percpu *smp::add_cpu(uint8_t apic_id) {
+    if (num_cpus == MAX_CPUS)
+        return nullptr;
+    percpu &cpu = cpus[num_cpus];
+    cpu.index = num_cpus;
+    cpu.apic_id = apic_id;
+    cpu.online = false;
+    __atomic_store_n(&num_cpus, num_cpus + 1, __ATOMIC_RELEASE);
+    return &cpu;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/memory/gdt.hpp>
+
+namespace scheduler {
+    struct task;
+}
+
+// data owned by a single CPU
+// in the kernel, gs is the per-CPU segment (memory::percpu_ds) - every CPU has its own GDT,
+// in which that segment's base is the CPU's own percpu struct
+namespace smp {
+    constexpr uint MAX_CPUS = 8;
+
+    struct percpu {
+        percpu *self;     // must be first, so this_cpu() is a single load
+        uint index;       // 0 is the bootstrap processor
+        uint8_t apic_id;
+        bool online;      // running kernel code, set by the CPU itself
+
+        scheduler::task *current_task;
+        uint32_t preempt_counter;
+        uint32_t context_switches;  // times the scheduler picked a task, see rcu::synchronize
+        int interrupt_context_depth;
+        uint32_t local_ticks;       // timer interrupts on this CPU
+        scheduler::task *fpu_owner; // whose FPU state the registers hold, see scheduler/fpu.hpp
+        uint64_t timer_deadline;    // TSC value of the next local timer interrupt, in TSC deadline mode
+
+        memory::tss_entry tss;
+        uint64_t gdt[memory::GDT_ENTRIES] __attribute__((aligned(8)));
+    };
+
+    inline percpu *this_cpu() {
+        percpu *cpu;
+        asm volatile("movl %%gs:0, %0" : "=r"(cpu));
+        return cpu;
+    }
+
+    // number of CPUs which were found, online or not
+    uint cpu_count();
+    percpu &get_cpu(uint index);
+    // called while discovering CPUs, returns nullptr if there are too many
+    percpu *add_cpu(uint8_t apic_id);
+}
+
+// access a 32 bit field of the current CPU's percpu struct with a single instruction
+// unlike this_cpu()->field, this can't be split by a migration to another CPU
+#define this_cpu_read(field) ({                                                         \
+    static_assert(sizeof(smp::percpu::field) == 4);                                     \
+    decltype(smp::percpu::field) __val;                                                 \
+    asm volatile("movl %%gs:%c1, %0" : "=r"(__val) : "i"(__builtin_offsetof(smp::percpu, field))); \
+    __val;                                                                              \
+})
+
+#define this_cpu_write(field, value) do {                                               \
+    static_assert(sizeof(smp::percpu::field) == 4);                                     \
+    decltype(smp::percpu::field) __val = (value);                                       \
+    asm volatile("movl %0, %%gs:%c1" :: "r"(__val), "i"(__builtin_offsetof(smp::percpu, field)) : "memory"); \
+} while (0)
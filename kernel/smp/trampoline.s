@@ -0,0 +1,64 @@
+; application processor startup code
+; copied below 1MB by smp::initialize and started by a startup IPI - it begins in real mode,
+; enters protected mode with paging on the kernel page directory, and calls ap_main on its own stack
+
+AP_TRAMPOLINE_ADDR equ 0x8000   ; must match smp/init.cpp
+%define TRAMPOLINE(x) (AP_TRAMPOLINE_ADDR + (x) - ap_trampoline_start)
+
+section .text
+global ap_trampoline_start
+global ap_trampoline_params
+global ap_trampoline_end
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TRAMPOLINE(ap_trampoline_gdtr)]
+    mov eax, cr0
+    or  eax, 1          ; set PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(ap_trampoline_protected)
+
+bits 32
+ap_trampoline_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; the kernel page directory identity maps the first 4MB while APs are booting
+    mov eax, [TRAMPOLINE(ap_trampoline_params)]
+    mov cr3, eax
+    mov eax, cr0
+    or  eax, 0x80000000 ; set PG
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE(ap_trampoline_params) + 4]
+    push dword [TRAMPOLINE(ap_trampoline_params) + 8]
+    extern ap_main
+    mov eax, ap_main    ; absolute jump into the higher half
+    call eax
+.loop:
+    hlt
+    jmp .loop
+
+align 8
+ap_trampoline_gdt:
+    dq 0                        ; null descriptor
+    dq 0x00CF9A000000FFFF       ; flat code
+    dq 0x00CF92000000FFFF       ; flat data
+ap_trampoline_gdtr:
+    dw ap_trampoline_gdtr - ap_trampoline_gdt - 1
+    dd TRAMPOLINE(ap_trampoline_gdt)
+
+align 4
+ap_trampoline_params:           ; struct ap_trampoline_params in smp/init.cpp
+    dd 0                        ; cr3
+    dd 0                        ; stack
+    dd 0                        ; cpu
+ap_trampoline_end:
@@ -0,0 +1,136 @@
+#include <kernel/syscalls/files.hpp>
+#include <kernel/syscalls/uaccess.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/devices/console.hpp>
+#include <kernel/fs/vfs.hpp>
+#include <kernel/util/lock.hpp>
+#include <kernel/tty.hpp>
+#include <kernel/serial.hpp>
+#include <kernel/logging.hpp>
+
+// data goes through a page of kernel memory, so the file systems never touch user pointers
+static constexpr size_t CHUNK_SIZE = 4096;
+
+static fs::fd_table &my_files() {
+    return scheduler::get_current_task()->files;
+}
+
+ssize_t syscalls::read(int fd, char __user *buf, size_t count) {
+    fs::file_desc *f = nullptr;
+    if (fd != STDIN_FD) {
+        f = my_files().get(fd);
+        if (f == nullptr || !(f->f_mode & fs::FMODE_READ))
+            return static_cast<ssize_t>(errno::bad_fd);
+    }
+    if (!access_ok(buf, count, true))
+        return static_cast<ssize_t>(errno::fault);
+    if (count > CHUNK_SIZE)
+        count = CHUNK_SIZE;
+    if (count == 0)
+        return 0;
+
+    char *chunk = static_cast<char *>(memory::kmem_alloc_4k());
+    ssize_t ret;
+    if (f == nullptr)
+        ret = static_cast<ssize_t>(devices::console::read(chunk, count));
+    else
+        ret = f->read(chunk, count);
+    if (ret > 0) {
+        errno e = copy_to_user(buf, chunk, ret);
+        if (e != errno::ok)
+            ret = static_cast<ssize_t>(e);
+    }
+    memory::kmem_free_4k(chunk);
+    return ret;
+}
+
+ssize_t syscalls::write(int fd, const char __user *buf, size_t count) {
+    fs::file_desc *f = nullptr;
+    if (fd != STDOUT_FD && fd != STDERR_FD) {
+        f = my_files().get(fd);
+        if (f == nullptr || !(f->f_mode & fs::FMODE_WRITE))
+            return static_cast<ssize_t>(errno::bad_fd);
+    }
+    if (static_cast<ssize_t>(count) < 0)
+        return static_cast<ssize_t>(errno::invalid);
+
+    char *chunk = static_cast<char *>(memory::kmem_alloc_4k());
+    size_t done = 0;
+    ssize_t ret = 0;
+    while (done < count) {
+        size_t len = count - done < CHUNK_SIZE ? count - done : CHUNK_SIZE;
+        errno e = copy_from_user(chunk, buf + done, len);
+        if (e != errno::ok) {
+            ret = static_cast<ssize_t>(e);
+            break;
+        }
+        if (f == nullptr) {
+            {
+                scoped_preemptlock lock;
+                tty_driver::write(string_buf{chunk, len});
+            }
+#ifndef TINY_TEST
+            // the console is on the serial line too, for headless machines - test builds' tty is the serial line
+            {
+                scoped_spinlock lock {log_lock};
+                serial_driver::write(string_buf{chunk, len});
+            }
+#endif
+        } else {
+            ret = f->write(chunk, len);
+            if (ret < 0)
+                break;
+            len = ret;
+        }
+        done += len;
+        if (len == 0)
+            break;
+    }
+    memory::kmem_free_4k(chunk);
+    // report what was written before an error, like a short write
+    return done > 0 ? static_cast<ssize_t>(done) : ret;
+}
+
+ssize_t syscalls::open(const char __user *path, uint32_t flags) {
+    if (flags & ~O_ACCMODE)
+        return static_cast<ssize_t>(errno::invalid);
+    uint16_t mode;
+    switch (flags & O_ACCMODE) {
+        case O_RDONLY: mode = fs::FMODE_READ; break;
+        case O_WRONLY: mode = fs::FMODE_WRITE; break;
+        case O_RDWR:   mode = fs::FMODE_READ | fs::FMODE_WRITE; break;
+        default:       return static_cast<ssize_t>(errno::invalid);
+    }
+
+    static_assert(fs::PATH_NAME_MAX <= 4096);
+    char *kpath = static_cast<char *>(memory::kmem_alloc_4k());
+    ssize_t ret = strncpy_from_user(kpath, path, fs::PATH_NAME_MAX);
+    if (ret == static_cast<ssize_t>(fs::PATH_NAME_MAX)) {
+        ret = static_cast<ssize_t>(errno::path_too_long);
+    } else if (ret >= 0 && kpath[0] != '/') {
+        ret = static_cast<ssize_t>(errno::no_entry);
+    } else if (ret >= 0) {
+        fs::inode *node;
+        errno e = fs::traverse(string_buf{kpath, static_cast<size_t>(ret)}, node);
+        if (e == errno::ok) {
+            fs::file_desc *f;
+            e = node->open(f);
+            fs::inode::release(node);  // the open file has its own reference
+            if (e == errno::ok) {
+                f->f_mode = mode;
+                ret = my_files().install(f);
+                if (ret < 0)
+                    fs::file_desc::release(f);
+            }
+        }
+        if (e != errno::ok)
+            ret = static_cast<ssize_t>(e);
+    }
+    memory::kmem_free_4k(kpath);
+    return ret;
+}
+
+errno syscalls::close(int fd) {
+    return my_files().close(fd);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// file system calls, on the file descriptors of the calling task
+// descriptors 0, 1 and 2 are always open and are the console: reading 0 reads the keyboard or the serial port,
+// writing 1 or 2 writes to the screen (and the serial port) - everything else is a file opened with open
+namespace syscalls {
+    constexpr int STDIN_FD = 0;
+    constexpr int STDOUT_FD = 1;
+    constexpr int STDERR_FD = 2;
+
+    // open flags, only the access mode is supported
+    constexpr uint32_t O_ACCMODE = 3;
+    constexpr uint32_t O_RDONLY = 0;
+    constexpr uint32_t O_WRONLY = 1;
+    constexpr uint32_t O_RDWR = 2;
+
+    // read blocks until at least one byte is available, and may return less than count
+    ssize_t read(int fd, char __user *buf, size_t count);
+    ssize_t write(int fd, const char __user *buf, size_t count);
+    // path must be absolute - there's no working directory
+    ssize_t open(const char __user *path, uint32_t flags);
+    errno close(int fd);
+}
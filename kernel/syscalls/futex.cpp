@@ -0,0 +1,91 @@
+#include <kernel/syscalls/futex.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/util/ds/list.hpp>
+
+namespace {
+    // lives on the stack of the waiting task
+    struct futex_waiter final : public ds::intrusive_doubly_linked_node<futex_waiter> {
+        memory::phys_t key;
+        bool woken = false;
+        scheduler::concurrency::wait_queue queue;
+    };
+
+    struct futex_bucket {
+        ds::intrusive_doubly_linked_node<futex_waiter> waiters;
+        spinlock lock;
+    };
+}
+
+// the waiters of a bucket are only accessed under its lock
+static futex_bucket buckets[syscalls::FUTEX_HASH_BUCKETS];
+
+static futex_bucket &get_bucket(memory::phys_t key) {
+    uint32_t h = key.value() >> 2;
+    h ^= h >> 6;
+    h ^= h >> 12;
+    return buckets[h % syscalls::FUTEX_HASH_BUCKETS];
+}
+
+static bool get_key(uint32_t __user *uaddr, memory::phys_t &key) {
+    if (reinterpret_cast<uint32_t>(uaddr) & 3)
+        return false;
+    return memory::user_virt_to_phys(uaddr, true, key);
+}
+
+errno syscalls::futex_wait(uint32_t __user *uaddr, uint32_t val) {
+    kassert_not_interrupt;
+    futex_waiter waiter;
+    if (!get_key(uaddr, waiter.key))
+        return errno::fault;
+    futex_bucket &bucket = get_bucket(waiter.key);
+    {
+        // the check and enqueue are atomic with respect to futex_wake, so a wake up can't be lost
+        // the page can't fault, we just checked it's mapped
+        scoped_spinlock lock {bucket.lock};
+        if (__atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val)
+            return errno::again;
+        bucket.waiters.add_after_self(&waiter);
+    }
+
+    waiter.queue.wait_until([&waiter] { return waiter.woken; });
+    // futex_wake has already unlinked us, but may still be waking up our queue - wait for it to let go of the bucket
+    // before the waiter goes out of scope
+    scoped_spinlock lock {bucket.lock};
+    return errno::ok;
+}
+
+ssize_t syscalls::futex_wake(uint32_t __user *uaddr, uint32_t nr_wake) {
+    kassert_not_interrupt;
+    memory::phys_t key;
+    if (!get_key(uaddr, key))
+        return static_cast<ssize_t>(errno::fault);
+
+    futex_bucket &bucket = get_bucket(key);
+    scoped_spinlock lock {bucket.lock};
+    ssize_t woken = 0;
+    // new waiters are added at the head, so walking backwards wakes up the oldest first
+    futex_waiter *waiter = bucket.waiters.get_prev();
+    while (waiter != &bucket.waiters && static_cast<uint32_t>(woken) < nr_wake) {
+        futex_waiter *prev = waiter->get_prev();
+        if (waiter->key == key) {
+            waiter->unlink();
+            waiter->woken = true;
+            waiter->queue.wake_all();
+            woken++;
+        }
+        waiter = prev;
+    }
+    return woken;
+}
+
+ssize_t syscalls::futex(uint32_t __user *uaddr, uint32_t op, uint32_t val) {
+    switch (static_cast<futex_op>(op)) {
+        case futex_op::wait:
+            return static_cast<ssize_t>(futex_wait(uaddr, val));
+        case futex_op::wake:
+            return futex_wake(uaddr, val);
+        default:
+            return static_cast<ssize_t>(errno::no_syscall);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// fast userspace mutexes: userspace does the uncontended cases with atomic instructions on a plain 32 bit word,
+// and only asks the kernel to sleep (or to wake sleepers) when there is contention
+//
+// waiters are keyed by the physical address of the word, so tasks sharing the page may share the futex
+// even if it is mapped at different addresses
+namespace syscalls {
+    enum class futex_op : uint32_t {
+        wait = 0,  // FUTEX_WAIT: sleep if *uaddr == val, else return errno::again
+        wake = 1,  // FUTEX_WAKE: wake up to val tasks waiting on uaddr, return the number woken up
+    };
+
+    constexpr uint FUTEX_HASH_BUCKETS = 64;
+
+    // uaddr is a user address, and must be 4 byte aligned
+    errno futex_wait(uint32_t __user *uaddr, uint32_t val);
+    ssize_t futex_wake(uint32_t __user *uaddr, uint32_t nr_wake);
+
+    // the system call itself
+    ssize_t futex(uint32_t __user *uaddr, uint32_t op, uint32_t val);
+}
@@ -0,0 +1,99 @@
+#include <kernel/syscalls/init.hpp>
+#include <kernel/syscalls/futex.hpp>
+#include <kernel/syscalls/files.hpp>
+#include <kernel/syscalls/process.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/memory/gdt.hpp>
+#include <kernel/smp/percpu.hpp>
+#include <kernel/util/cpu.hpp>
+
+static constexpr uint32_t MSR_SYSENTER_CS = 0x174;
+static constexpr uint32_t MSR_SYSENTER_ESP = 0x175;
+static constexpr uint32_t MSR_SYSENTER_EIP = 0x176;
+
+extern "C" void sysenter_entry();
+
+// a system call takes its arguments from the saved registers, and returns the result or a negative errno
+using syscall_fn = ssize_t (*)(const interrupts::interrupt_args &args);
+
+static ssize_t sys_exit(const interrupts::interrupt_args &args) {
+    syscalls::exit(static_cast<int>(args.ebx));
+}
+
+static ssize_t sys_read(const interrupts::interrupt_args &args) {
+    return syscalls::read(static_cast<int>(args.ebx), reinterpret_cast<char __user *>(args.ecx), args.edx);
+}
+
+static ssize_t sys_write(const interrupts::interrupt_args &args) {
+    return syscalls::write(static_cast<int>(args.ebx), reinterpret_cast<const char __user *>(args.ecx), args.edx);
+}
+
+static ssize_t sys_open(const interrupts::interrupt_args &args) {
+    return syscalls::open(reinterpret_cast<const char __user *>(args.ebx), args.ecx);
+}
+
+static ssize_t sys_close(const interrupts::interrupt_args &args) {
+    return static_cast<ssize_t>(syscalls::close(static_cast<int>(args.ebx)));
+}
+
+static ssize_t sys_yield(const interrupts::interrupt_args &) {
+    syscalls::yield();
+    return 0;
+}
+
+static ssize_t sys_futex(const interrupts::interrupt_args &args) {
+    return syscalls::futex(reinterpret_cast<uint32_t __user *>(args.ebx), args.ecx, args.edx);
+}
+
+// indexed by system call number, nullptr for unknown ones
+static syscall_fn syscall_table[syscalls::NR_SYSCALLS];
+
+static void add_syscall(syscalls::number num, syscall_fn fn) {
+    reg_t idx = static_cast<reg_t>(num);
+    kassert(idx < syscalls::NR_SYSCALLS && syscall_table[idx] == nullptr);
+    syscall_table[idx] = fn;
+}
+
+static void syscall_handler(interrupts::interrupt_args &args) {
+    uint64_t entered = scheduler::syscall_enter();
+    syscall_fn fn = args.eax < syscalls::NR_SYSCALLS ? syscall_table[args.eax] : nullptr;
+    ssize_t ret = fn != nullptr ? fn(args) : static_cast<ssize_t>(errno::no_syscall);
+    args.eax = static_cast<reg_t>(ret);
+    scheduler::syscall_exit(entered);
+}
+
+// called from sysenter_entry with interrupts disabled
+extern "C" void sysenter_handler(interrupts::interrupt_args *args) {
+    interrupts::sti();
+    syscall_handler(*args);
+}
+
+void syscalls::init_cpu() {
+    auto features = cpu::cpuid(1);
+    if (!(features.edx & cpu::FEATURE_EDX_SEP))
+        return;
+    // the first Pentium Pros report SEP without implementing it
+    uint32_t family = (features.eax >> 8) & 0xf, model = (features.eax >> 4) & 0xf, stepping = features.eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3)
+        return;
+
+    // ss is implied as the selector after cs, and the user selectors as cs + 16 and cs + 24
+    cpu::wrmsr(MSR_SYSENTER_CS, memory::kernel_cs);
+    // the stack is found through the TSS, esp0 changes with every task switch
+    cpu::wrmsr(MSR_SYSENTER_ESP, reinterpret_cast<uint32_t>(&smp::this_cpu()->tss));
+    cpu::wrmsr(MSR_SYSENTER_EIP, reinterpret_cast<uint32_t>(&sysenter_entry));
+}
+
+void syscalls::initialize() {
+    add_syscall(number::exit, sys_exit);
+    add_syscall(number::read, sys_read);
+    add_syscall(number::write, sys_write);
+    add_syscall(number::open, sys_open);
+    add_syscall(number::close, sys_close);
+    add_syscall(number::yield, sys_yield);
+    add_syscall(number::futex, sys_futex);
+
+    interrupts::register_handler(interrupts::SYSCALL_VECTOR, syscall_handler);
+    init_cpu();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// system calls are entered with int 0x80:
+// eax is the system call number, ebx, ecx, edx, esi, edi are the arguments
+// the result (or a negative errno) is returned in eax
+//
+// or, where the CPU supports it, with sysenter, which is several times cheaper:
+// eax is the system call number, ebx, ecx, edx, esi are the arguments
+// edi is the address to return to and ebp the user stack pointer, since sysenter saves neither
+// the result is returned in eax, ecx and edx are clobbered
+// system calls with five arguments have to use int 0x80
+//
+// system calls run in task context, with interrupts enabled - they may block
+namespace syscalls {
+    // numbers follow the i386 linux ABI, for no particular reason other than familiarity
+    enum class number : reg_t {
+        exit = 1,
+        read = 3,
+        write = 4,
+        open = 5,
+        close = 6,
+        yield = 158,  // sched_yield
+        futex = 240,
+    };
+
+    // size of the dispatch table, numbers above it are unknown
+    constexpr reg_t NR_SYSCALLS = 256;
+
+    void initialize();
+    // sets up sysenter on the calling CPU, each has its own MSRs
+    void init_cpu();
+}
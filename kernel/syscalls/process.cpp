@@ -0,0 +1,15 @@
+#include <kernel/syscalls/process.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/logging.hpp>
+
+void syscalls::exit(int status) {
+    scheduler::task *me = scheduler::get_current_task();
+    // closing may block, which exiting can't
+    me->files.close_all();
+    TINY_INFO("task ", me->pid, " exited with status ", status);
+    scheduler::exit();
+}
+
+void syscalls::yield() {
+    scheduler::yield();
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// system calls about the calling task itself
+namespace syscalls {
+    // close all files and end the task - the status is only logged, nothing waits for tasks yet
+    [[noreturn]] void exit(int status);
+    // let other runnable tasks run first
+    void yield();
+}
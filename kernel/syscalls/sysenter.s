@@ -0,0 +1,60 @@
+; sysenter_entry - fast system call entry, see kernel/syscalls/init.hpp for the register convention
+; builds the same interrupt_args frame int 0x80 would, so system calls see no difference
+; IA32_SYSENTER_ESP points at this CPU's TSS, whose esp0 is the top of the current task's kernel stack
+extern sysenter_handler
+
+global sysenter_entry
+sysenter_entry:
+    mov esp, [esp + 4]       ; tss.esp0
+
+    ; what the CPU pushes when interrupted in usermode
+    push dword 0x20 | 3      ; ss
+    push ebp                 ; esp
+    pushfd                   ; eflags - sysenter cleared IF, but usermode runs with it set
+    or dword [esp], 0x200
+    push dword 0x18 | 3      ; cs
+    push edi                 ; eip
+    push dword 0             ; error_code
+    push dword 0x80          ; interrupt_number
+
+    ; the rest of interrupt_args, as in common_interrupt_handler
+    push eax
+    push ebx
+    push ecx
+    push edx
+    push esi
+    push edi
+    push ebp
+    mov eax, cr3
+    push eax
+
+    mov ax, 0x30
+    mov gs, ax
+
+    push esp
+    cld
+    xor ebp, ebp
+    call sysenter_handler
+
+    ; no interrupts until sysexit, they would leave the kernel gs behind
+    cli
+
+    ; skip the parameter and cr3 - a system call can't change the address space, so no TLB flush
+    add esp, 8
+
+    pop ebp
+    pop edi
+    pop esi
+    pop edx
+    pop ecx
+    pop ebx
+    mov ax, 0x20 | 3         ; usermode doesn't get to keep the per-CPU selector
+    mov gs, ax
+    pop eax
+    add esp, 8               ; interrupt_number and error_code
+
+    ; sysexit returns to edx with the stack at ecx
+    mov edx, [esp]           ; eip
+    mov ecx, [esp + 12]      ; esp
+    sti                      ; takes effect after sysexit
+    sysexit
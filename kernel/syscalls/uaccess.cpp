@@ -0,0 +1,46 @@
+#include <kernel/syscalls/uaccess.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/util/string.hpp>
+
+bool syscalls::access_ok(const void __user *ptr, size_t count, bool writable) {
+    reg_t start = reinterpret_cast<reg_t>(ptr);
+    if (count == 0)
+        return true;
+    if (start >= USER_END || count > USER_END - start)
+        return false;
+
+    for (reg_t page = start & ~0xFFFu; page < start + count; page += 4096) {
+        memory::phys_t phys;
+        if (!memory::user_virt_to_phys(reinterpret_cast<const void *>(page), writable, phys))
+            return false;
+    }
+    return true;
+}
+
+errno syscalls::copy_from_user(void *to, const void __user *from, size_t count) {
+    if (!access_ok(from, count, false))
+        return errno::fault;
+    memcpy(to, from, count);
+    return errno::ok;
+}
+
+errno syscalls::copy_to_user(void __user *to, const void *from, size_t count) {
+    if (!access_ok(to, count, true))
+        return errno::fault;
+    memcpy(to, from, count);
+    return errno::ok;
+}
+
+ssize_t syscalls::strncpy_from_user(char *to, const char __user *from, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        // check each page once, when the string enters it
+        if (i == 0 || (reinterpret_cast<reg_t>(from + i) & 0xFFF) == 0) {
+            if (!access_ok(from + i, 1, false))
+                return static_cast<ssize_t>(errno::fault);
+        }
+        to[i] = from[i];
+        if (to[i] == '\0')
+            return i;
+    }
+    return size;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// copying between kernel and user memory, for system calls
+// every page of a user range is checked to be a mapped user page first, so bad pointers give errno::fault
+// instead of a page fault in the kernel - address spaces are not shared, so checked pages stay mapped
+namespace syscalls {
+    // first address which is not user memory
+    constexpr reg_t USER_END = 0xC0000000;
+
+    // is [ptr, ptr + count) mapped user memory, and writable if asked?
+    bool access_ok(const void __user *ptr, size_t count, bool writable);
+
+    errno copy_from_user(void *to, const void __user *from, size_t count);
+    errno copy_to_user(void __user *to, const void *from, size_t count);
+    // copy a null terminated string of at most size bytes including the null byte
+    // returns its length, or size if it is too long (and then to is not null terminated)
+    ssize_t strncpy_from_user(char *to, const char __user *from, size_t size);
+}
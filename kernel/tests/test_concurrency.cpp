@@ -0,0 +1,1145 @@
+#include <kernel/tty.hpp>
+#include <kernel/serial.hpp>
+#include <kernel/logging.hpp>
+#include <kernel/memory/multiboot.hpp>
+#include <kernel/memory/gdt.hpp>
+#include <kernel/memory/page_allocator.hpp>
+#include <kernel/interrupts/init.hpp>
+#include <kernel/interrupts/pic.hpp>
+#include <kernel/scheduler/init.hpp>
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/scheduler/task.hpp>
+#include <kernel/scheduler/mutex.hpp>
+#include <kernel/scheduler/wait_queue.hpp>
+#include <kernel/scheduler/condition_variable.hpp>
+#include <kernel/scheduler/rwlock.hpp>
+#include <kernel/scheduler/rcu.hpp>
+#include <kernel/scheduler/workqueue.hpp>
+#include <kernel/scheduler/reaper.hpp>
+#include <kernel/scheduler/accounting.hpp>
+#include <kernel/scheduler/latency.hpp>
+#include <kernel/syscalls/futex.hpp>
+#include <kernel/syscalls/uaccess.hpp>
+#include <kernel/smp/init.hpp>
+#include <kernel/interrupts/apic.hpp>
+#include <kernel/interrupts/deferred.hpp>
+#include <kernel/interrupts/stats.hpp>
+#include <kernel/interrupts/profiler.hpp>
+#include <kernel/clock/init.hpp>
+#include <kernel/fs/vfs.hpp>
+#include <kernel/fs/procfs.hpp>
+#include <kernel/scheduler/elf.hpp>
+#include <kernel/devices/console.hpp>
+#include <kernel/clock/time_page.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/util/simd.hpp>
+
+using namespace scheduler::concurrency;
+
+// bounded buffer, protected by buf_lock
+static constexpr int PRODUCED_COUNT = 100;
+static mutex buf_lock;
+static condition_variable buf_not_empty;
+static condition_variable buf_not_full;
+static int buf[4];
+static size_t buf_head, buf_count;
+
+static int consumed_sum;
+static bool consumer_done;
+static wait_queue done_queue;
+
+static void producer_task() {
+    for (int i = 1; i <= PRODUCED_COUNT; i++) {
+        scoped_mutex lock { buf_lock };
+        buf_not_full.wait(buf_lock, [] { return buf_count < 4; });
+        buf[(buf_head + buf_count) % 4] = i;
+        buf_count++;
+        buf_not_empty.notify_one();
+    }
+}
+
+static void consumer_task() {
+    for (int i = 1; i <= PRODUCED_COUNT; i++) {
+        scoped_mutex lock { buf_lock };
+        buf_not_empty.wait(buf_lock, [] { return buf_count > 0; });
+        consumed_sum += buf[buf_head];
+        buf_head = (buf_head + 1) % 4;
+        buf_count--;
+        buf_not_full.notify_one();
+    }
+
+    consumer_done = true;
+    done_queue.wake_all();
+}
+
+static void test_condition_variable() {
+    scheduler::link_task(scheduler::task::allocate(consumer_task));
+    scheduler::link_task(scheduler::task::allocate(producer_task));
+    done_queue.wait_until([] { return consumer_done; });
+    kassert(consumed_sum == PRODUCED_COUNT * (PRODUCED_COUNT + 1) / 2);
+    // every iteration locks at least once, and again after every condition variable wait
+    kassert(buf_lock.stats().acquisitions >= 2 * PRODUCED_COUNT);
+    buf_lock.dump_stats("buf_lock");
+    TINY_INFO("Pass test_condition_variable");
+}
+
+// the owner of an adaptive mutex runs on another CPU and lets go right after the waiter found it owned,
+// so the waiter gets it while spinning, without blocking
+static mutex adaptive_lock {true};
+static bool adaptive_held;
+static bool adaptive_holder_done;
+
+static void adaptive_holder_task() {
+    uint32_t contended = adaptive_lock.stats().contended_acquisitions;
+    adaptive_lock.lock();
+    __atomic_store_n(&adaptive_held, true, __ATOMIC_SEQ_CST);
+    // running all the while, so the waiter keeps spinning
+    while (__atomic_load_n(&adaptive_lock.stats().contended_acquisitions, __ATOMIC_SEQ_CST) == contended)
+        asm volatile("pause" ::: "memory");
+    adaptive_lock.unlock();
+    __atomic_store_n(&adaptive_holder_done, true, __ATOMIC_SEQ_CST);
+}
+
+static void test_adaptive_mutex() {
+    if (smp::online_count() == 1) {
+        TINY_INFO("Skip test_adaptive_mutex, uniprocessor");
+        return;
+    }
+    scheduler::task *me = scheduler::get_current_task();
+    scheduler::set_affinity(me, 1u << 0);
+    mutex_stats before = adaptive_lock.stats();
+
+    scheduler::task *holder = scheduler::task::allocate(adaptive_holder_task);
+    scheduler::set_affinity(holder, 1u << 1);
+    scheduler::link_task(holder);
+    while (!__atomic_load_n(&adaptive_held, __ATOMIC_SEQ_CST))
+        asm volatile("pause" ::: "memory");
+    uint32_t switches = me->accounting.voluntary_switches;
+    adaptive_lock.lock();
+    kassert(me->accounting.voluntary_switches == switches);
+    adaptive_lock.unlock();
+
+    mutex_stats after = adaptive_lock.stats();
+    kassert(after.acquisitions == before.acquisitions + 2);
+    kassert(after.contended_acquisitions == before.contended_acquisitions + 1);
+    kassert(after.spin_acquisitions == before.spin_acquisitions + 1);
+    while (!__atomic_load_n(&adaptive_holder_done, __ATOMIC_SEQ_CST)) scheduler::yield();
+    scheduler::set_affinity(me, scheduler::AFFINITY_ALL);
+    adaptive_lock.dump_stats("adaptive_lock");
+    TINY_INFO("Pass test_adaptive_mutex");
+}
+
+// exclusive waiters
+static constexpr uint HERD_SIZE = 3;
+static wait_queue herd_queue;
+static uint herd_tokens;
+static uint herd_woken;
+
+static void herd_task() {
+    herd_queue.wait_until([] { return herd_tokens != 0; }, true);
+    __atomic_sub_fetch(&herd_tokens, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&herd_woken, 1, __ATOMIC_SEQ_CST);
+    done_queue.wake_all();
+}
+
+static void test_exclusive_wakeup() {
+    for (uint i = 0; i < HERD_SIZE; i++) {
+        scheduler::link_task(scheduler::task::allocate(herd_task));
+    }
+    // let all of them block
+    while (herd_queue.num_waiters_for_tests() != HERD_SIZE) {
+        scheduler::yield();
+    }
+
+    for (uint i = 1; i <= HERD_SIZE; i++) {
+        __atomic_add_fetch(&herd_tokens, 1, __ATOMIC_SEQ_CST);
+        kassert(herd_queue.wake_one() == 1);
+        kassert(herd_queue.num_waiters_for_tests() == HERD_SIZE - i);
+        done_queue.wait_until([i] { return __atomic_load_n(&herd_woken, __ATOMIC_SEQ_CST) == i; });
+    }
+
+    kassert(herd_queue.wake_all() == 0);
+    TINY_INFO("Pass test_exclusive_wakeup");
+}
+
+// priority inheritance through a chain of mutexes:
+// low holds a, medium holds b and waits for a, high waits for b
+static constexpr int LOW_PRIORITY = 4;
+static constexpr int MEDIUM_PRIORITY = 10;
+static constexpr int HIGH_PRIORITY = 20;
+static mutex pi_a;
+static mutex pi_b;
+static wait_queue pi_release_queue;
+static bool pi_low_locked, pi_medium_locked, pi_release;
+static int pi_low_priority_after;
+static uint pi_done;
+
+static void pi_low_task() {
+    pi_a.lock();
+    pi_low_locked = true;
+    pi_release_queue.wait_until([] { return pi_release; });
+    pi_a.unlock();
+    pi_low_priority_after = scheduler::get_current_task()->scheduling.effective_priority;
+    __atomic_add_fetch(&pi_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static void pi_medium_task() {
+    scoped_mutex lock_b { pi_b };
+    pi_medium_locked = true;
+    scoped_mutex lock_a { pi_a };
+    __atomic_add_fetch(&pi_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static void pi_high_task() {
+    scoped_mutex lock_b { pi_b };
+    __atomic_add_fetch(&pi_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static scheduler::task *spawn(void (*run)(void), int priority) {
+    scheduler::task *t = scheduler::task::allocate(run);
+    scheduler::set_priority(t, priority);
+    scheduler::link_task(t);
+    return t;
+}
+
+static void test_priority_inheritance() {
+    // run below everybody, so yielding lets the other tasks run until they block
+    scheduler::set_priority(scheduler::get_current_task(), scheduler::PRIORITY_IDLE + 1);
+
+    scheduler::task *low = spawn(pi_low_task, LOW_PRIORITY);
+    while (!pi_low_locked) scheduler::yield();
+    kassert(low->scheduling.effective_priority == LOW_PRIORITY);
+
+    scheduler::task *medium = spawn(pi_medium_task, MEDIUM_PRIORITY);
+    while (low->scheduling.effective_priority != MEDIUM_PRIORITY) scheduler::yield();
+    kassert(pi_medium_locked);
+
+    spawn(pi_high_task, HIGH_PRIORITY);
+    while (low->scheduling.effective_priority != HIGH_PRIORITY) scheduler::yield();
+    kassert(medium->scheduling.effective_priority == HIGH_PRIORITY);
+    kassert(medium->scheduling.base_priority == MEDIUM_PRIORITY);
+
+    {
+        scoped_intlock lock;
+        pi_release = true;
+        pi_release_queue.wake_all();
+    }
+    while (pi_done != 3) scheduler::yield();
+    kassert(pi_low_priority_after == LOW_PRIORITY);
+
+    scheduler::set_priority(scheduler::get_current_task(), scheduler::PRIORITY_DEFAULT);
+    TINY_INFO("Pass test_priority_inheritance");
+}
+
+// readers share the lock, the writer waits for them
+static rwlock rw;
+static wait_queue rw_release_queue;
+static bool rw_release, rw_writer_done;
+static uint rw_readers_in;
+
+static void rw_reader_task() {
+    scoped_read_lock lock { rw };
+    __atomic_add_fetch(&rw_readers_in, 1, __ATOMIC_SEQ_CST);
+    rw_release_queue.wait_until([] { return rw_release; });
+}
+
+static void rw_writer_task() {
+    scoped_write_lock lock { rw };
+    rw_writer_done = true;
+}
+
+static void test_rwlock() {
+    scheduler::link_task(scheduler::task::allocate(rw_reader_task));
+    scheduler::link_task(scheduler::task::allocate(rw_reader_task));
+    while (rw_readers_in != 2) scheduler::yield();
+
+    scheduler::link_task(scheduler::task::allocate(rw_writer_task));
+    for (int i = 0; i < 100; i++) scheduler::yield();
+    kassert(!rw_writer_done);
+
+    {
+        scoped_intlock lock;
+        rw_release = true;
+        rw_release_queue.wake_all();
+    }
+    while (!rw_writer_done) scheduler::yield();
+    TINY_INFO("Pass test_rwlock");
+}
+
+// a grace period waits for a reader that was switched out inside its critical section
+static bool rcu_reader_in, rcu_reader_release, rcu_reader_done, rcu_synced, rcu_synced_after_reader;
+
+static void rcu_reader_task() {
+    scheduler::rcu::read_lock();
+    rcu_reader_in = true;
+    while (!rcu_reader_release) scheduler::yield();
+    rcu_reader_done = true;
+    scheduler::rcu::read_unlock();
+}
+
+static void rcu_sync_task() {
+    scheduler::rcu::synchronize();
+    rcu_synced_after_reader = rcu_reader_done;
+    rcu_synced = true;
+}
+
+static void test_rcu() {
+    scheduler::link_task(scheduler::task::allocate(rcu_reader_task));
+    while (!rcu_reader_in) scheduler::yield();
+
+    scheduler::link_task(scheduler::task::allocate(rcu_sync_task));
+    for (int i = 0; i < 100; i++) scheduler::yield();
+    kassert(!rcu_synced);
+
+    rcu_reader_release = true;
+    while (!rcu_synced) scheduler::yield();
+    kassert(rcu_synced_after_reader);
+
+    // nobody is reading, so this doesn't wait
+    scheduler::rcu::synchronize();
+    TINY_INFO("Pass test_rcu");
+}
+
+// two address spaces map the same physical page, and share a futex on it
+static uint32_t *const futex_word = reinterpret_cast<uint32_t *>(0x40000000);
+static memory::phys_t futex_page;
+static bool futex_waiter_in, futex_waiter_done;
+static errno futex_waiter_result;
+
+static void futex_waiter_task() {
+    memory::map_user_page(futex_word, futex_page, true);
+    futex_waiter_in = true;
+    futex_waiter_result = syscalls::futex_wait(futex_word, 0);
+    futex_waiter_done = true;
+}
+
+static void test_futex() {
+    futex_page = memory::hmem_alloc_page();
+    memory::map_user_page(futex_word, futex_page, true);
+    *futex_word = 0;
+
+    kassert(syscalls::futex_wait(futex_word, 1) == errno::again);
+    kassert(syscalls::futex_wait(futex_word + 1024, 0) == errno::fault);  // not mapped
+    kassert(syscalls::futex_wait(reinterpret_cast<uint32_t *>(0x40000002), 0) == errno::fault);  // not aligned
+    kassert(syscalls::futex_wake(futex_word, 1) == 0);
+
+    scheduler::link_task(scheduler::task::allocate(futex_waiter_task));
+    while (!futex_waiter_in) scheduler::yield();
+    for (int i = 0; i < 100; i++) scheduler::yield();
+    kassert(!futex_waiter_done);
+
+    *futex_word = 1;
+    kassert(syscalls::futex_wake(futex_word, 1) == 1);
+    while (!futex_waiter_done) scheduler::yield();
+    kassert(futex_waiter_result == errno::ok);
+    TINY_INFO("Pass test_futex");
+}
+
+// the page after it is mapped, the one after that is not
+static char *const uaccess_page = reinterpret_cast<char *>(0x40001000);
+
+static void test_uaccess() {
+    memory::map_user_page(uaccess_page, memory::hmem_alloc_page(), true);
+    char *end = uaccess_page + 4096;
+
+    kassert(syscalls::access_ok(uaccess_page, 4096, true));
+    kassert(!syscalls::access_ok(end - 1, 2, false));  // runs into the unmapped page
+    kassert(!syscalls::access_ok(reinterpret_cast<void *>(0xC0000000), 1, false));  // kernel memory
+    kassert(!syscalls::access_ok(reinterpret_cast<void *>(0xBFFFFFFF), 0xFFFFFFFF, false));  // wraps around
+
+    const char msg[] = "hello";
+    kassert(syscalls::copy_to_user(end - sizeof(msg), msg, sizeof(msg)) == errno::ok);
+    kassert(syscalls::copy_to_user(end - 1, msg, sizeof(msg)) == errno::fault);
+    char back[sizeof(msg)];
+    kassert(syscalls::copy_from_user(back, end - sizeof(msg), sizeof(msg)) == errno::ok);
+    kassert(memcmp(back, msg, sizeof(msg)) == 0);
+
+    kassert(syscalls::strncpy_from_user(back, end - sizeof(msg), sizeof(back)) == 5);
+    kassert(syscalls::strncpy_from_user(back, end - sizeof(msg), 3) == 3);  // too long
+    end[-1] = 'x';  // not terminated before the unmapped page
+    kassert(syscalls::strncpy_from_user(back, end - 1, sizeof(back)) == static_cast<ssize_t>(errno::fault));
+    TINY_INFO("Pass test_uaccess");
+}
+
+// IRQ 14 is masked, so only the test raises its vector
+static constexpr uint DEFERRED_TEST_VECTOR = 46;
+static uint deferred_runs;
+static bool deferred_interrupts_enabled, deferred_in_interrupt;
+static void deferred_func();
+static interrupts::deferred_work deferred_item {deferred_func};
+
+static void deferred_func() {
+    reg_t eflags;
+    asm volatile("pushf; pop %0" : "=r"(eflags));
+    deferred_interrupts_enabled = (eflags & 0x200) != 0;
+    deferred_in_interrupt = interrupts::is_interrupt_context();
+    deferred_runs++;
+}
+
+static void deferred_test_handler(interrupts::interrupt_args &) {
+    interrupts::defer(deferred_item);
+    interrupts::defer(deferred_item);  // already queued
+    kassert(deferred_runs == 0);  // not before the handler returns
+}
+
+static void test_deferred_work() {
+    interrupts::register_handler(DEFERRED_TEST_VECTOR, deferred_test_handler);
+    {
+        scoped_preemptlock lock;
+        asm volatile("int %0" :: "i"(DEFERRED_TEST_VECTOR) : "memory");
+        kassert(deferred_runs == 1);
+    }
+    kassert(deferred_interrupts_enabled && deferred_in_interrupt);
+    TINY_INFO("Pass test_deferred_work");
+}
+
+static uint work_runs;
+static bool work_in_interrupt;
+static wait_queue work_block_queue;
+static bool work_block_release, work_blocked;
+static uint32_t delayed_ran_at;
+
+static void counting_work(scheduler::work_item *) {
+    work_in_interrupt = interrupts::is_interrupt_context();
+    __atomic_add_fetch(&work_runs, 1, __ATOMIC_SEQ_CST);
+}
+
+static void blocking_work(scheduler::work_item *) {
+    work_blocked = true;
+    work_block_queue.wait_until([] { return work_block_release; });
+}
+
+static void delayed_func(scheduler::work_item *) {
+    delayed_ran_at = scheduler::ticks();
+}
+
+static scheduler::work_item simple_work {counting_work};
+static scheduler::work_item block_work {blocking_work};
+static scheduler::delayed_work timed_work {delayed_func};
+static scheduler::delayed_work cancelled_work {counting_work};
+
+static void test_workqueue() {
+    kassert(scheduler::queue_work(simple_work));
+    scheduler::flush_work(simple_work);
+    kassert(work_runs == 1 && !work_in_interrupt);
+
+    // a blocked item doesn't hold up the rest, another worker takes over
+    kassert(scheduler::queue_work(block_work));
+    while (!work_blocked) scheduler::yield();
+    kassert(scheduler::queue_work(simple_work));
+    scheduler::flush_work(simple_work);
+    kassert(work_runs >= 2);
+    kassert(scheduler::nr_workers() >= 2);
+    work_block_release = true;
+    work_block_queue.wake_all();
+    scheduler::flush_workqueue();
+
+    // delayed work waits for its ticks, cancelled work doesn't run
+    uint runs = work_runs;
+    uint32_t start = scheduler::ticks();
+    kassert(scheduler::queue_delayed_work(timed_work, 5));
+    kassert(scheduler::queue_delayed_work(cancelled_work, 5));
+    kassert(!scheduler::queue_delayed_work(timed_work, 5));
+    kassert(scheduler::cancel_delayed_work(cancelled_work));
+    kassert(!scheduler::cancel_delayed_work(cancelled_work));
+    while (delayed_ran_at == 0) scheduler::yield();
+    kassert(delayed_ran_at - start >= 5);
+
+    // further away than a turn of the wheel, passed over the first time its slot comes around
+    kassert(scheduler::queue_delayed_work(cancelled_work, scheduler::TIMER_WHEEL_SLOTS + 10));
+    start = scheduler::ticks();
+    while (scheduler::ticks() - start < scheduler::TIMER_WHEEL_SLOTS + 1) scheduler::yield();
+    kassert(work_runs == runs);
+    kassert(scheduler::cancel_delayed_work(cancelled_work));
+    TINY_INFO("Pass test_workqueue with ", scheduler::nr_workers(), " workers");
+}
+
+// many more tasks than kmem could hold if exiting leaked their stacks and page directories,
+// exiting on all CPUs at once
+static constexpr uint CHURN_TASKS = 2000;
+static constexpr uint CHURN_BATCH = 16;
+static uint churn_exited;
+
+static void churn_task() {
+    // touch the hmem mapping table, which the reaper has to free too
+    memory::phys_t page = memory::hmem_alloc_page();
+    memory::hmem_free_page(page);
+    __atomic_add_fetch(&churn_exited, 1, __ATOMIC_SEQ_CST);
+}
+
+static void test_reaper() {
+    uint32_t reaped_before = scheduler::tasks_reaped();
+    for (uint i = 0; i < CHURN_TASKS; i += CHURN_BATCH) {
+        for (uint j = 0; j < CHURN_BATCH; j++) {
+            // the task holds its own reference, the reaper drops it
+            scheduler::link_task(scheduler::task::allocate(churn_task));
+        }
+        while (__atomic_load_n(&churn_exited, __ATOMIC_SEQ_CST) != i + CHURN_BATCH) scheduler::yield();
+    }
+    while (scheduler::tasks_reaped() - reaped_before < CHURN_TASKS) scheduler::yield();
+    TINY_INFO("Pass test_reaper");
+}
+
+// two busy tasks share the bootstrap processor, so each of them is preempted while the other one runs
+static constexpr uint32_t ACCOUNTING_TICKS = 20;
+static bool accounting_release;
+static bool accounting_done;
+
+static void accounting_task() {
+    while (!__atomic_load_n(&accounting_release, __ATOMIC_SEQ_CST))
+        asm volatile("pause" ::: "memory");
+    __atomic_store_n(&accounting_done, true, __ATOMIC_SEQ_CST);
+}
+
+static void test_accounting() {
+    scheduler::task *me = scheduler::get_current_task();
+    scheduler::set_affinity(me, 1u << 0);
+    while (smp::this_cpu()->index != 0) scheduler::yield();
+    scheduler::task_accounting before = me->accounting;
+
+    scheduler::task *t = scheduler::task::allocate(accounting_task);
+    scheduler::set_affinity(t, 1u << 0);
+    t->take_ref();  // its accounting is read after it exited
+    scheduler::link_task(t);
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() - start < ACCOUNTING_TICKS)
+        asm volatile("pause" ::: "memory");
+    __atomic_store_n(&accounting_release, true, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&accounting_done, __ATOMIC_SEQ_CST)) scheduler::yield();
+
+    scheduler::task_accounting after = me->accounting;
+    kassert(after.kernel_ticks > before.kernel_ticks);
+    kassert(after.user_ticks == before.user_ticks);
+    kassert(after.involuntary_switches > before.involuntary_switches);
+    kassert(after.wait_ns > before.wait_ns);
+    kassert(t->accounting.kernel_ticks > 0);
+    kassert(t->accounting.involuntary_switches > 0);
+
+    // room for every task, so the snapshot is complete
+    scheduler::task_stats *stats = static_cast<scheduler::task_stats *>(memory::kmem_alloc_4k());
+    uint max = 4096 / sizeof(scheduler::task_stats);
+    uint count = scheduler::get_task_stats(stats, max);
+    kassert(count < max);
+    bool found = false;
+    for (uint i = 0; i < count; i++) {
+        if (stats[i].pid == me->pid) {
+            found = true;
+            kassert(stats[i].running);
+            kassert(stats[i].accounting.kernel_ticks >= after.kernel_ticks);
+        }
+    }
+    kassert(found);
+    memory::kmem_free_4k(stats);
+    scheduler::task::release(t);
+    scheduler::set_affinity(me, scheduler::AFFINITY_ALL);
+    scheduler::dump_task_stats();
+    TINY_INFO("Pass test_accounting");
+}
+
+// a task blocked on a wait queue is woken over and over, every wakeup lands in its histogram
+static constexpr uint32_t LATENCY_WAKEUPS = 50;
+static wait_queue latency_queue;
+static wait_queue latency_done_queue;
+static uint32_t latency_tokens;
+static uint32_t latency_consumed;
+
+static void latency_task() {
+    for (uint32_t i = 0; i < LATENCY_WAKEUPS; i++) {
+        latency_queue.wait_until([] { return __atomic_load_n(&latency_tokens, __ATOMIC_SEQ_CST) != 0; });
+        __atomic_sub_fetch(&latency_tokens, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&latency_consumed, 1, __ATOMIC_SEQ_CST);
+        latency_done_queue.wake_all();
+    }
+}
+
+static void test_latency_tracing() {
+    scheduler::latency::enable();
+    scheduler::task *t = scheduler::task::allocate(latency_task);
+    t->take_ref();  // its histogram is read after it exited
+    scheduler::link_task(t);
+    for (uint32_t i = 0; i < LATENCY_WAKEUPS; i++) {
+        // switched out while blocked, so the wakeup is a real one
+        while (latency_queue.num_waiters_for_tests() != 1 || scheduler::is_running(t)) scheduler::yield();
+        __atomic_add_fetch(&latency_tokens, 1, __ATOMIC_SEQ_CST);
+        kassert(latency_queue.wake_all() == 1);
+        latency_done_queue.wait_until([i] { return __atomic_load_n(&latency_consumed, __ATOMIC_SEQ_CST) == i + 1; });
+    }
+    scheduler::latency::disable();
+
+    kassert(t->latency.wakeups.count == LATENCY_WAKEUPS);
+    uint32_t sum = 0;
+    for (uint i = 0; i < scheduler::latency::BUCKETS; i++)
+        sum += t->latency.wakeups.buckets[i];
+    kassert(sum == LATENCY_WAKEUPS);
+    scheduler::latency::histogram global = scheduler::latency::global_histogram();
+    kassert(global.count >= LATENCY_WAKEUPS);
+    kassert(global.max_ns >= t->latency.wakeups.max_ns);
+    scheduler::latency::worst_trace worst = scheduler::latency::worst();
+    kassert(worst.latency_ns == global.max_ns);
+    kassert(worst.latency_ns == 0 || worst.pid != worst.running_pid);  // 0 with a tick resolution clock
+    scheduler::latency::dump();
+    scheduler::task::release(t);
+    TINY_INFO("Pass test_latency_tracing, worst wakeup ", static_cast<uint32_t>(div64_32(worst.latency_ns, 1000)), "us");
+}
+
+// tasks keep a value on the x87 stack across yields, preemption and kernel use of the FPU
+static constexpr uint FPU_TASKS = 4;
+static constexpr uint FPU_ROUNDS = 100;
+static uint fpu_next_value;
+static uint fpu_done;
+static bool fpu_corrupted;
+
+static void fpu_task() {
+    uint32_t mine = __atomic_add_fetch(&fpu_next_value, 1000, __ATOMIC_SEQ_CST);
+    asm volatile("fildl %0" :: "m"(mine));
+    for (uint i = 0; i < FPU_ROUNDS; i++) {
+        if (i % 10 == 0) {
+            // clobbers the registers, the state of the task is saved and loaded again afterwards
+            scheduler::fpu::kernel_begin();
+            asm volatile("fninit" ::: "memory");
+            scheduler::fpu::kernel_end();
+        }
+        for (int j = 0; j < 1000; j++)
+            asm volatile("pause" ::: "memory");
+        scheduler::yield();
+    }
+    uint32_t back;
+    asm volatile("fistpl %0" : "=m"(back));
+    if (back != mine)
+        __atomic_store_n(&fpu_corrupted, true, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&fpu_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static void test_lazy_fpu() {
+    if (!scheduler::fpu::is_available()) {
+        TINY_INFO("Skip test_lazy_fpu, no FXSAVE");
+        return;
+    }
+    scheduler::task *tasks[FPU_TASKS];
+    for (uint i = 0; i < FPU_TASKS; i++) {
+        tasks[i] = scheduler::task::allocate(fpu_task);
+        tasks[i]->take_ref();  // their FPU state is checked after they exited
+        scheduler::link_task(tasks[i]);
+    }
+    while (__atomic_load_n(&fpu_done, __ATOMIC_SEQ_CST) != FPU_TASKS) scheduler::yield();
+    kassert(!fpu_corrupted);
+    for (uint i = 0; i < FPU_TASKS; i++) {
+        kassert(tasks[i]->fpu.used);
+        scheduler::task::release(tasks[i]);
+    }
+    // never touched the FPU, so it never paid for it
+    kassert(!scheduler::get_current_task()->fpu.used);
+    TINY_INFO("Pass test_lazy_fpu");
+}
+
+// the string functions against byte loops, at every alignment and around the sizes where they switch strategy
+static constexpr size_t STRING_BUF = 16384 + 64;
+
+// the compiler may not turn these into calls to the functions they check
+static void byte_copy(unsigned char *dst, const unsigned char *src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = src[i];
+        asm volatile("" ::: "memory");
+    }
+}
+
+static void fill_pattern(unsigned char *buf, size_t size, uint32_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = static_cast<unsigned char>(seed >> 16);
+    }
+}
+
+static void test_string_functions() {
+    unsigned char *src = static_cast<unsigned char *>(memory::kmem_alloc_32k());
+    unsigned char *dst = static_cast<unsigned char *>(memory::kmem_alloc_32k());
+    unsigned char *expected = static_cast<unsigned char *>(memory::kmem_alloc_32k());
+    const size_t sizes[] = {0, 1, 3, 4, 15, 16, 17, 63, 64, 100, 1023, 1024, 1025, 4096, 5000};
+    for (size_t size : sizes) {
+        for (uint align = 0; align < 16; align += 3) {
+            fill_pattern(src, STRING_BUF, size + align);
+            fill_pattern(dst, STRING_BUF, 7);
+            byte_copy(expected, dst, STRING_BUF);
+            byte_copy(expected + align + 1, src + align, size);
+            memcpy(dst + align + 1, src + align, size);
+            kassert(memcmp(dst, expected, STRING_BUF) == 0);
+
+            fill_pattern(dst, STRING_BUF, 7);
+            simd::memcpy(dst + align + 1, src + align, size);
+            kassert(memcmp(dst, expected, STRING_BUF) == 0);
+
+            // overlapping moves in both directions
+            byte_copy(expected, src, STRING_BUF);
+            for (size_t i = size; i != 0; i--)
+                expected[align + i - 1 + 5] = expected[align + i - 1];
+            memmove(src + align + 5, src + align, size);
+            kassert(memcmp(src, expected, STRING_BUF) == 0);
+            byte_copy(expected + align, src + align + 5, size);
+            memmove(src + align, src + align + 5, size);
+            kassert(memcmp(src, expected, STRING_BUF) == 0);
+
+            byte_copy(expected, dst, STRING_BUF);
+            for (size_t i = 0; i < size; i++)
+                expected[align + i] = 0xA5;
+            memset(dst + align, 0xA5, size);
+            kassert(memcmp(dst, expected, STRING_BUF) == 0);
+            fill_pattern(dst + align, size, 3);
+            simd::memset(dst + align, 0xA5, size);
+            kassert(memcmp(dst, expected, STRING_BUF) == 0);
+
+            // the first difference decides, wherever it is in a word
+            if (size != 0) {
+                dst[align + size - 1] ^= 1;
+                kassert(memcmp(dst + align, expected + align, size) == (dst[align + size - 1] < expected[align + size - 1] ? -1 : 1));
+                kassert(memcmp(dst, expected, align + size - 1) == 0);
+                dst[align + size - 1] ^= 1;
+            }
+        }
+    }
+
+    void *page = memory::kmem_alloc_4k();
+    fill_pattern(src, 4096, 11);
+    copy_page(page, src);
+    kassert(memcmp(page, src, 4096) == 0);
+    clear_page(page);
+    for (uint i = 0; i < 4096; i++)
+        kassert(static_cast<unsigned char *>(page)[i] == 0);
+    memory::kmem_free_4k(page);
+    memory::kmem_free_32k(expected);
+    memory::kmem_free_32k(dst);
+    memory::kmem_free_32k(src);
+    TINY_INFO("Pass test_string_functions");
+}
+
+// throughput of the byte loops the string functions replaced, the string instructions, and SSE2, by size
+static constexpr uint STRING_BENCH_BYTES = 256 * 1024;  // copied per measurement
+
+static uint32_t mb_per_second(uint64_t cycles) {
+    if (cycles == 0 || clock::tsc_khz() == 0)
+        return 0;
+    // bytes per cycle * cycles per second, in MB
+    return static_cast<uint32_t>(div64_32(static_cast<uint64_t>(STRING_BENCH_BYTES) * clock::tsc_khz(), static_cast<uint32_t>(div64_32(cycles, 1000))));
+}
+
+template <class F>
+static uint64_t measure(size_t size, F copy) {
+    uint iterations = STRING_BENCH_BYTES / size;
+    uint64_t start = cpu::rdtsc();
+    for (uint i = 0; i < iterations; i++)
+        copy();
+    return cpu::rdtsc() - start;
+}
+
+static void bench_string_functions() {
+    if (!clock::uses_tsc()) {
+        TINY_INFO("Skip bench_string_functions, no TSC");
+        return;
+    }
+    unsigned char *src = static_cast<unsigned char *>(memory::kmem_alloc_32k());
+    unsigned char *dst = static_cast<unsigned char *>(memory::kmem_alloc_32k());
+    const size_t sizes[] = {16, 64, 256, 1024, 4096, 16384};
+    for (size_t size : sizes) {
+        uint64_t bytes = measure(size, [=] { byte_copy(dst, src, size); });
+        uint64_t rep = measure(size, [=] { memcpy(dst, src, size); });
+        uint64_t sse2 = measure(size, [=] { simd::memcpy(dst, src, size); });
+        uint64_t set = measure(size, [=] { memset(dst, 0, size); });
+        uint64_t set_sse2 = measure(size, [=] { simd::memset(dst, 0, size); });
+        TINY_INFO("memcpy ", static_cast<uint>(size), " bytes: byte loop ", mb_per_second(bytes), " MB/s, rep movs ", mb_per_second(rep),
+                  " MB/s, SSE2 ", mb_per_second(sse2), " MB/s; memset: rep stos ", mb_per_second(set), " MB/s, SSE2 ", mb_per_second(set_sse2), " MB/s");
+    }
+    memory::kmem_free_32k(dst);
+    memory::kmem_free_32k(src);
+}
+
+// handlers are counted per vector, and a long section with interrupts disabled is blamed on its site
+static constexpr uint64_t IRQS_OFF_TEST_CYCLES = 100000;
+
+static void test_interrupt_stats() {
+    kassert(interrupts::get_vector_stats(DEFERRED_TEST_VECTOR).count >= 1);
+
+    uint32_t line = __LINE__ + 2;
+    {
+        scoped_intlock lock;
+        uint64_t start = cpu::rdtsc();
+        while (cpu::rdtsc() - start < IRQS_OFF_TEST_CYCLES)
+            asm volatile("pause" ::: "memory");
+    }
+
+    interrupts::irqs_off_site *sites = static_cast<interrupts::irqs_off_site *>(memory::kmem_alloc_4k());
+    uint max = 4096 / sizeof(interrupts::irqs_off_site);
+    uint count = interrupts::get_irqs_off_sites(sites, max);
+    for (uint i = 1; i < count; i++)
+        kassert(sites[i - 1].max_cycles >= sites[i].max_cycles);
+    memory::kmem_free_4k(sites);
+
+    interrupts::irqs_off_site site = interrupts::get_irqs_off_site(__FILE__, line);
+    kassert(site.file != nullptr);
+    kassert(site.count >= 1);
+    kassert(site.max_cycles >= IRQS_OFF_TEST_CYCLES);
+    interrupts::dump_stats();
+    TINY_INFO("Pass test_interrupt_stats");
+}
+
+extern char _kernel_start;
+extern char _kernel_end;
+
+[[gnu::noinline]] static void profiler_spin(uint32_t ticks) {
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() - start < ticks)
+        asm volatile("pause" ::: "memory");
+}
+
+// the timer samples the spinning task, with a backtrace into the kernel
+static void test_profiler() {
+    interrupts::profiler::start();
+    profiler_spin(20);
+    interrupts::profiler::stop();
+    kassert(interrupts::profiler::samples_taken() >= 10);
+
+    using interrupts::profiler::sample;
+    uint32_t pid = scheduler::get_current_task()->pid;
+    uintptr_t text_min = reinterpret_cast<uintptr_t>(&_kernel_start), text_max = reinterpret_cast<uintptr_t>(&_kernel_end);
+    sample *samples = static_cast<sample *>(memory::kmem_alloc_32k());
+    uint max = 32768 / sizeof(sample), spinning = 0;
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        uint count = interrupts::profiler::get_samples(cpu, samples, max);
+        for (uint i = 0; i < count; i++) {
+            const sample &s = samples[i];
+            kassert(s.depth <= interrupts::profiler::MAX_FRAMES);
+            if (s.pid != pid)
+                continue;
+            kassert(!s.user && text_min <= s.eip && s.eip < text_max);
+            if (s.depth >= 1)
+                spinning++;
+        }
+    }
+    kassert(spinning >= 1);
+    memory::kmem_free_32k(samples);
+    TINY_INFO("Pass test_profiler, ", interrupts::profiler::samples_taken(), " samples");
+}
+
+// logging only queues for the COM1 interrupt, and flush waits for everything to go out
+static void test_serial_ring() {
+    for (uint i = 0; i < 64; i++)
+        LOCKED(serial_driver::write("[SERIAL] line ", i, " of the transmit ring test, long enough to need a few FIFO refills\n"));
+    serial::flush();
+    kassert(serial::pending() == 0);
+    TINY_INFO("Pass test_serial_ring");
+}
+
+// received characters are read from /dev/ttyS0, or as console input, the way a terminal sends them
+static void test_serial_input() {
+    fs::inode *a;
+    fs::file_desc *f;
+    kassert(fs::traverse("/dev/ttyS0", a) == errno::ok);
+    kassert((a->i_mode & fs::S_IFMT) == fs::S_IFCHR);
+    kassert(a->open(f) == errno::ok);
+    for (const char *p = "ls\x7f\r"; *p; p++)
+        serial::receive(*p);
+    char buf[8];
+    kassert(f->read(buf, sizeof(buf)) == 4);
+    kassert(!memcmp(buf, "ls\b\n", 4));
+    fs::file_desc::release(f);
+    fs::inode::release(a);
+
+    serial::receive('x');
+    kassert(devices::console::read(buf, sizeof(buf)) == 1);
+    kassert(buf[0] == 'x');
+    kassert(!serial::has_input());
+    TINY_INFO("Pass test_serial_input");
+}
+
+// a record keeps a copy of a string which changes later, and /proc/dmesg reads it back as text
+static void test_klog() {
+    char name[16] = "before";
+    TINY_INFO("klog test ", 42, ' ', -7, ' ', formatting::hex{0xbeef}, ' ', errno::again, ' ', name);
+    memcpy(name, "after", 6);
+    const char *expected = "[INFO] klog test 42 -7 beef errno::again before in file";
+    size_t expected_length = strlen(expected);
+
+    fs::inode *a;
+    fs::file_desc *f;
+    kassert(fs::traverse("/proc/dmesg", a) == errno::ok);
+    kassert(a->open(f) == errno::ok);
+    // windows which overlap by more than the expected text, so it can't fall between two
+    constexpr size_t WINDOW = 4096;
+    char *text = static_cast<char *>(memory::kmem_alloc_4k());
+    bool found = false;
+    for (uint64_t pos = 0; !found; pos += WINDOW - 128) {
+        ssize_t length = f->pread(text, WINDOW, pos);
+        kassert(length >= 0);
+        for (ssize_t i = 0; i + static_cast<ssize_t>(expected_length) <= length && !found; i++)
+            found = memcmp(text + i, expected, expected_length) == 0;
+        if (length < static_cast<ssize_t>(WINDOW))
+            break;
+    }
+    kassert(found);
+    memory::kmem_free_4k(text);
+    fs::file_desc::release(f);
+    fs::inode::release(a);
+
+    kassert(fs::traverse("/proc/nothing", a) == errno::no_entry);
+    TINY_INFO("Pass test_klog, ", klog::lost(), " records lost");
+}
+
+// all CPUs the firmware reported came up, each with its own per-CPU data
+static void test_smp() {
+    kassert(smp::online_count() == smp::cpu_count());
+    kassert(smp::this_cpu() == &smp::get_cpu(smp::this_cpu()->index));
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        smp::percpu &cpu = smp::get_cpu(i);
+        kassert(cpu.online);
+        kassert(cpu.self == &cpu);
+        kassert(cpu.index == i);
+    }
+
+    spinlock lock;
+    {
+        scoped_spinlock guard {lock};
+        kassert(lock.is_locked());
+        kassert(!lock.try_lock());
+    }
+    kassert(!lock.is_locked());
+    TINY_INFO("Pass test_smp with ", smp::cpu_count(), " CPUs");
+}
+
+// every CPU gets its own timer interrupts once the local APIC timers took over from the PIT
+static void test_local_timers() {
+    if (!interrupts::apic::is_timer_calibrated()) {
+        TINY_INFO("Skip test_local_timers, no local APIC");
+        return;
+    }
+    uint32_t before[smp::MAX_CPUS];
+    for (uint i = 0; i < smp::cpu_count(); i++)
+        before[i] = __atomic_load_n(&smp::get_cpu(i).local_ticks, __ATOMIC_RELAXED);
+    uint32_t start = scheduler::ticks();
+    while (scheduler::ticks() - start < 50) scheduler::yield();
+    for (uint i = 0; i < smp::cpu_count(); i++) {
+        // roughly the same rate everywhere
+        uint32_t passed = __atomic_load_n(&smp::get_cpu(i).local_ticks, __ATOMIC_RELAXED) - before[i];
+        kassert(passed >= 25 && passed <= 100);
+    }
+    TINY_INFO("Pass test_local_timers, ", interrupts::apic::tsc_per_tick(), " TSC cycles per tick",
+              interrupts::apic::uses_tsc_deadline() ? " (TSC deadline)" : " (one shot)");
+}
+
+// the clock never goes backwards on a CPU, and agrees with the timer ticks
+static void test_clock() {
+    uint64_t last = clock::now_ns();
+    for (int i = 0; i < 1000; i++) {
+        scoped_intlock lock;  // stay on this CPU
+        uint64_t now = clock::now_ns();
+        kassert(now >= last);
+        last = now;
+    }
+
+    uint32_t start_ticks = scheduler::ticks();
+    uint64_t start = clock::now_ns();
+    while (scheduler::ticks() - start_ticks < 100) scheduler::yield();
+    uint32_t elapsed_ms = static_cast<uint32_t>(div64_32(clock::now_ns() - start, 1000000));
+    kassert(elapsed_ms >= 90 && elapsed_ms <= 110);
+
+    if (clock::uses_tsc()) {
+        // cycle resolution - two reads in a row are less than a tick apart, but not always equal
+        uint64_t a = clock::now_ns();
+        uint64_t b = clock::now_ns();
+        kassert(b - a < 1000000);
+        uint64_t one_ms = clock::cycles_to_ns(clock::tsc_khz());
+        kassert(one_ms >= 999000 && one_ms <= 1000000);
+    }
+    TINY_INFO("Pass test_clock, ", clock::uses_tsc() ? "TSC at " : "ticks", clock::tsc_khz(), " kHz");
+}
+
+// loading a program maps the time page, and userspace sees the same clock through it, read as initrd/time.h does -
+// in a task of its own, whose address space the program can have
+static bool time_page_done;
+
+static void time_page_task() {
+    fs::inode *a;
+    fs::file_desc *f;
+    kassert(fs::traverse("/initrd/shell.elf", a) == errno::ok);
+    kassert(a->open(f) == errno::ok);
+    void *entry;
+    kassert(elf_loader::load_elf(f, entry) == errno::ok);
+    fs::file_desc::release(f);
+    fs::inode::release(a);
+
+    auto *page = reinterpret_cast<const volatile clock::time_page *>(clock::TIME_PAGE_ADDR);
+    kassert(syscalls::access_ok(const_cast<const clock::time_page *>(page), sizeof(clock::time_page), false));
+    kassert(!syscalls::access_ok(const_cast<const clock::time_page *>(page), 1, true));  // read-only
+
+    uint32_t seq, ticks, uses_tsc, mult, shift;
+    uint64_t tsc_base, base_ns;
+    do {
+        seq = page->seq;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        ticks = page->ticks;
+        uses_tsc = page->uses_tsc;
+        mult = page->mult;
+        shift = page->shift;
+        tsc_base = page->tsc_base;
+        base_ns = page->base_ns;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != page->seq);
+
+    kassert(scheduler::ticks() - ticks <= 1);
+    kassert(page->ns_per_tick == 1000000000ull * interrupts::PIT_DIVISOR / interrupts::PIT_FREQUENCY);
+    kassert(uses_tsc == (clock::uses_tsc() ? 1 : 0));
+    if (uses_tsc) {
+        uint64_t cycles = cpu::rdtsc() - tsc_base;
+        uint64_t low = static_cast<uint64_t>(static_cast<uint32_t>(cycles)) * mult;
+        uint64_t high = static_cast<uint64_t>(static_cast<uint32_t>(cycles >> 32)) * mult;
+        uint64_t user_ns = base_ns + (high << (32 - shift)) + (low >> shift);
+        uint64_t kernel_ns = clock::now_ns();
+        kassert(kernel_ns >= user_ns && kernel_ns - user_ns < 1000000);
+    }
+    __atomic_store_n(&time_page_done, true, __ATOMIC_SEQ_CST);
+}
+
+static void test_time_page() {
+    scheduler::link_task(scheduler::task::allocate(time_page_task));
+    while (!__atomic_load_n(&time_page_done, __ATOMIC_SEQ_CST)) scheduler::yield();
+    TINY_INFO("Pass test_time_page");
+}
+
+// a task pinned to a CPU runs there and nowhere else
+static uint affinity_cpu;
+static bool affinity_done;
+static bool affinity_moved;
+
+static void affinity_task() {
+    for (int i = 0; i < 100; i++) {
+        if (smp::this_cpu()->index != affinity_cpu)
+            affinity_moved = true;
+        scheduler::yield();
+    }
+    __atomic_store_n(&affinity_done, true, __ATOMIC_SEQ_CST);
+}
+
+static void test_affinity() {
+    for (uint cpu = 0; cpu < smp::cpu_count(); cpu++) {
+        affinity_cpu = cpu;
+        affinity_done = false;
+        scheduler::task *t = scheduler::task::allocate(affinity_task);
+        scheduler::set_affinity(t, 1u << cpu);
+        t->take_ref();  // its scheduling is read after it may have exited
+        scheduler::link_task(t);
+        kassert(t->scheduling.cpu == cpu);
+        while (!__atomic_load_n(&affinity_done, __ATOMIC_SEQ_CST)) scheduler::yield();
+        scheduler::task::release(t);
+    }
+    kassert(!affinity_moved);
+    TINY_INFO("Pass test_affinity");
+}
+
+// busy tasks all start on the bootstrap processor, then idle CPUs steal them once their affinity allows
+static constexpr uint STEAL_TASKS = 4;
+static scheduler::task *steal_tasks[STEAL_TASKS];
+static uint32_t steal_seen_cpus;
+static bool steal_release;
+static uint steal_done;
+
+static void steal_task() {
+    while (!__atomic_load_n(&steal_release, __ATOMIC_SEQ_CST)) {
+        __atomic_or_fetch(&steal_seen_cpus, 1u << smp::this_cpu()->index, __ATOMIC_SEQ_CST);
+        asm volatile("pause" ::: "memory");
+    }
+    __atomic_add_fetch(&steal_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static uint count_cpus(uint32_t mask) {
+    uint count = 0;
+    for (; mask != 0; mask &= mask - 1) count++;
+    return count;
+}
+
+static void test_work_stealing() {
+    if (smp::online_count() == 1) {
+        TINY_INFO("Skip test_work_stealing, uniprocessor");
+        return;
+    }
+    for (uint i = 0; i < STEAL_TASKS; i++) {
+        steal_tasks[i] = scheduler::task::allocate(steal_task);
+        scheduler::set_affinity(steal_tasks[i], 1u << 0);
+        steal_tasks[i]->take_ref();  // for set_affinity below, after they may have exited
+        scheduler::link_task(steal_tasks[i]);
+        kassert(steal_tasks[i]->scheduling.cpu == 0);
+    }
+    for (uint i = 0; i < STEAL_TASKS; i++) {
+        scheduler::set_affinity(steal_tasks[i], scheduler::AFFINITY_ALL);
+    }
+    // busy on more than one CPU
+    while (count_cpus(__atomic_load_n(&steal_seen_cpus, __ATOMIC_SEQ_CST)) < 2) scheduler::yield();
+
+    __atomic_store_n(&steal_release, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&steal_done, __ATOMIC_SEQ_CST) != STEAL_TASKS) scheduler::yield();
+    for (uint i = 0; i < STEAL_TASKS; i++) {
+        scheduler::task::release(steal_tasks[i]);
+    }
+    TINY_INFO("Pass test_work_stealing on ", count_cpus(steal_seen_cpus), " CPUs");
+}
+
+static void main_task() {
+    test_smp();
+    test_local_timers();
+    test_deferred_work();
+    test_clock();
+    test_time_page();
+    test_affinity();
+    test_work_stealing();
+    test_condition_variable();
+    test_adaptive_mutex();
+    test_exclusive_wakeup();
+    test_priority_inheritance();
+    test_rwlock();
+    test_rcu();
+    test_futex();
+    test_workqueue();
+    test_reaper();
+    test_accounting();
+    test_latency_tracing();
+    test_lazy_fpu();
+    test_string_functions();
+    bench_string_functions();
+    test_interrupt_stats();
+    test_profiler();
+    test_serial_ring();
+    test_serial_input();
+    test_klog();
+    test_uaccess();
+
+    // test done
+    klog::flush();
+    interrupts::cli();
+    serial_driver::write("TEST_SUCCESS");
+    serial::flush();
+    while (1) { asm volatile("hlt"); }
+}
+
+extern "C" void kmain(multiboot_info_t *multiboot_data, uint multiboot_magic) {
+    tty::initialize();
+    serial::initialize();
+    TINY_INFO("Early boot, initialized VGA and serial");
+
+    memory::read_multiboot_data(multiboot_data, multiboot_magic);
+    memory::init_gdt();
+    memory::init_page_allocator();
+
+    interrupts::initialize();
+    interrupts::init_pic();
+    scheduler::fpu::initialize();
+    interrupts::start();
+    serial::enable_interrupts();
+    clock::initialize();
+    smp::initialize();
+
+    scheduler::initialize();
+    scheduler::init_workqueue();
+    klog::start_flusher();
+    fs::register_procfs("/proc");
+    fs::register_devfs("/dev");
+    scheduler::task *main = scheduler::task::allocate(main_task);
+    scheduler::link_task(main);
+    scheduler::start();
+    kpanic("scheduler::start returned");
+}
@@ -2,6 +2,7 @@
 #include <kernel/tty.hpp>
 #include <kernel/util/asm_wrap.hpp>
 #include <kernel/serial.hpp>
+#include <kernel/util/lock.hpp>
 
 using formatting::color;
 using formatting::color_pair;
@@ -10,12 +11,17 @@ static constexpr size_t VGA_WIDTH = 80;
 static constexpr size_t VGA_HEIGHT = 25;
 static constexpr uintptr_t VGA_MEMORY = 0xC00B8000;
 
+// text memory holds VGA_MEMORY_ROWS rows, of which the screen shows VGA_HEIGHT from t_top on - scrolling moves the
+// CRTC's start address down a row, and only copies the screen back to the top once it reaches the end
+static constexpr size_t VGA_MEMORY_ROWS = 0x8000 / sizeof(uint16_t) / VGA_WIDTH;
+
 static size_t t_x;
 static size_t t_y;
+static size_t t_top;
 static uint8_t t_color;
 static volatile uint16_t *t_buf;
-static uint16_t internal_buf[VGA_WIDTH * VGA_HEIGHT];
-size_t internal_buf_i;  // ring buffer
+static spinlock tty_lock;  // guards the position, text memory, the start address and the cursor
+static bool panicking;     // set once by tty::panic
 
 static inline uint8_t vga_color(color fg, color bg) {
     return (uint8_t)fg | ((uint8_t)bg << 4);
@@ -26,14 +32,32 @@ static inline uint16_t vga_entry(unsigned char code, uint8_t color) {
 }
 
 static inline void set_char(unsigned char code, uint8_t color, size_t x, size_t y) {
-    t_buf[y * VGA_WIDTH + x] = vga_entry(code, color);
-    internal_buf[((y + internal_buf_i) % VGA_HEIGHT) * VGA_WIDTH + x] = vga_entry(code, color);
+    t_buf[(t_top + y) * VGA_WIDTH + x] = vga_entry(code, color);
+}
+
+static constexpr unsigned short FB_COMMAND_PORT = 0x3D4;
+static constexpr unsigned short FB_DATA_PORT    = 0x3D5;
+static constexpr unsigned char  FB_START_HIGH_BYTE_COMMAND = 12;
+static constexpr unsigned char  FB_START_LOW_BYTE_COMMAND  = 13;
+static constexpr unsigned char  FB_HIGH_BYTE_COMMAND = 14;
+static constexpr unsigned char  FB_LOW_BYTE_COMMAND  = 15;
+
+// the first cell of text memory on the screen
+static void set_start_address(unsigned short pos) {
+#ifndef TINY_TEST
+    asm_outb(FB_COMMAND_PORT, FB_START_HIGH_BYTE_COMMAND);
+    asm_outb(FB_DATA_PORT,    ((pos >> 8) & 0x00FF));
+    asm_outb(FB_COMMAND_PORT, FB_START_LOW_BYTE_COMMAND);
+    asm_outb(FB_DATA_PORT,    pos & 0x00FF);
+#else
+    kunused(pos);
+#endif
 }
 
 void tty::initialize() {
     t_x = 0;
     t_y = 0;
-    internal_buf_i = 0;
+    t_top = 0;
     set_color(color_pair {color::black, color::white});
     t_buf = reinterpret_cast<volatile uint16_t *>(VGA_MEMORY);
 	for (size_t y = 0; y < VGA_HEIGHT; y++) {
@@ -41,14 +65,9 @@ void tty::initialize() {
             set_char(' ', t_color, x, y);
 		}
 	}
+    set_start_address(0);
 }
 
-
-static constexpr unsigned short FB_COMMAND_PORT = 0x3D4;
-static constexpr unsigned short FB_DATA_PORT    = 0x3D5;
-static constexpr unsigned char  FB_HIGH_BYTE_COMMAND = 14;
-static constexpr unsigned char  FB_LOW_BYTE_COMMAND  = 15;
-
 void tty::move_cursor(unsigned short pos) {
 #ifndef TINY_TEST
     asm_outb(FB_COMMAND_PORT, FB_HIGH_BYTE_COMMAND);
@@ -62,15 +81,27 @@ void tty::move_cursor(unsigned short pos) {
 
 #ifndef TINY_TEST
 static void tty_scroll() {
-    if (++internal_buf_i == VGA_HEIGHT) internal_buf_i = 0;
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            t_buf[y * VGA_WIDTH + x] = internal_buf[((y + internal_buf_i) % VGA_HEIGHT) * VGA_WIDTH + x];
-        }
+    if (t_top + VGA_HEIGHT == VGA_MEMORY_ROWS) {
+        // out of text memory, the rows which stay on the screen go back to the top - once every few hundred lines
+        memmove(const_cast<uint16_t *>(t_buf), const_cast<uint16_t *>(t_buf) + (t_top + 1) * VGA_WIDTH,
+                (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
+        t_top = 0;
+    } else {
+        t_top++;
     }
     for (size_t x = 0; x < VGA_WIDTH; x++) {
         set_char(' ', t_color, x, VGA_HEIGHT - 1);
     }
+    set_start_address(t_top * VGA_WIDTH);
+}
+
+static inline void newline() {
+    t_x = 0;
+    if (t_y == VGA_HEIGHT - 1) {
+        tty_scroll();
+    } else {
+        t_y++;
+    }
 }
 #endif
 
@@ -78,32 +109,49 @@ static void tty_scroll() {
 void tty::put(char c) {
     serial::put(c);
 }
+
+void tty::write(const char *s, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        serial::put(s[i]);
+}
 #else
 void tty::put(char c) {
-    if (c == '\n') {
-        t_x = 0;
-        if (t_y == VGA_HEIGHT - 1) {
-            tty_scroll();
+    write(&c, 1);
+}
+
+static void write_locked(const char *s, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (s[i] == '\n') {
+            newline();
         } else {
-            t_y++;
-        }
-    } else {
-        unsigned char uc = c;
-        set_char(uc, t_color, t_x++, t_y);
-        if (t_x == VGA_WIDTH) {
-            t_x = 0;
-            if (t_y == VGA_HEIGHT - 1) {
-                tty_scroll();
-            } else {
-                t_y++;
-            }
+            unsigned char uc = s[i];
+            set_char(uc, t_color, t_x++, t_y);
+            if (t_x >= VGA_WIDTH)
+                newline();
         }
     }
+    // four port writes, once per run of characters
+    tty::move_cursor((t_top + t_y) * VGA_WIDTH + t_x);
+}
 
-    tty::move_cursor(t_x + t_y * VGA_WIDTH);
+void tty::write(const char *s, size_t length) {
+    if (__atomic_load_n(&panicking, __ATOMIC_RELAXED)) {
+        // the other CPUs may be stuck holding the lock, or this one
+        bool locked = !tty_lock.is_locked() && tty_lock.try_lock();
+        write_locked(s, length);
+        if (locked)
+            tty_lock.unlock();
+        return;
+    }
+    scoped_spinlock lock {tty_lock};
+    write_locked(s, length);
 }
 #endif
 
+void tty::panic() {
+    __atomic_store_n(&panicking, true, __ATOMIC_RELAXED);
+}
+
 #ifdef TINY_TEST
 void tty::set_color(color_pair set_color) {
     serial::set_color(set_color);
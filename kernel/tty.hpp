@@ -4,9 +4,14 @@
 
 namespace tty {
     void initialize();
+    // pos counts cells from the start of text memory, not of the screen
     void move_cursor(unsigned short pos);
     void put(char c);
+    // the same as put for each character, but moves the cursor only once - safe to call from any CPU
+    void write(const char *s, size_t length);
+    // kpanic: from now on write doesn't wait for a writer which may never finish
+    void panic();
     void set_color(formatting::color_pair set_color);
 }
 
-using tty_driver = formatting::log_driver<tty::put, tty::set_color>;
+using tty_driver = formatting::log_driver<tty::put, tty::set_color, tty::write>;
@@ -42,8 +42,19 @@ inline void quality_debugging() {
 
 #define kunused(var) ((void)(var))
 
-// TODO TODO TODO remember to make use of __user
-# define __user __attribute__((noderef, address_space(1)))
+// 64 by 32 bit division, without libgcc - the high half first, so neither divl can overflow
+inline uint64_t div64_32(uint64_t dividend, uint32_t divisor) {
+    uint32_t high = static_cast<uint32_t>(dividend >> 32);
+    uint32_t quotient_high = high / divisor;
+    uint32_t remainder = high % divisor;
+    uint32_t quotient_low;
+    asm("divl %4" : "=a"(quotient_low), "=d"(remainder) : "a"(static_cast<uint32_t>(dividend)), "d"(remainder), "rm"(divisor));
+    return (static_cast<uint64_t>(quotient_high) << 32) | quotient_low;
+}
+
+// marks pointers into user memory, which may only be accessed through syscalls/uaccess.hpp
+// documentation only - sparse's noderef and address_space attributes don't apply to C++
+#define __user
 
 // errno
 enum class errno : ssize_t {
@@ -53,12 +64,17 @@ enum class errno : ssize_t {
     no_process = -3,     // ESRCH
     interrupted = -4,    // EINTR
     io_error = -5,       // EIO
+    bad_fd = -9,         // EBADF
+    again = -11,         // EAGAIN
     no_memory = -12,     // ENOMEM
     no_access = -13,     // EACCESS
+    fault = -14,         // EFAULT
     exists = -17,        // EEXISTS
     not_dir = -20,       // ENOTDIR
     is_dir = -21,        // EISDIR
     invalid = -22,       // EINVAL
+    too_many_files = -24,  // EMFILE
+    no_syscall = -38,    // ENOSYS
 
     // tinylittleos extensions
     path_too_long = -1337,
@@ -1,4 +1,5 @@
 #pragma once
+#include <kernel/util.hpp>
 
 extern "C" {
     void asm_outb(unsigned short port, unsigned char data);
@@ -8,6 +9,6 @@ extern "C" {
     void asm_lidt(void *addr);
     void asm_set_cr3(void *addr);
     void asm_flush_tss();
-    [[noreturn]] void asm_enter_task(void *stack);
+    [[noreturn]] void asm_enter_task(void *stack, uint32_t *prev_on_cpu);
     void asm_enter_usermode(void *func, void *esp);
 }
@@ -114,14 +114,21 @@ asm_enter_usermode:
     iret
 
 ; asm_enter_task - enter task with iret
-; stack: [esp + 4] stack address to enter at
+; stack: [esp + 8] on_cpu flag of the previous task to clear once off its stack and page directory, or 0
+;        [esp + 4] stack address to enter at
 ;        [esp    ] the return address
 global asm_enter_task
 asm_enter_task:
+    mov eax, [esp + 8]
     mov esp, [esp + 4]
 
-    pop eax
-    mov cr3, eax
+    pop ecx             ; restored below, free until then
+    mov cr3, ecx
+    test eax, eax
+    jz .entered
+    mov dword [eax], 0  ; nothing uses the previous stack or page directory anymore, the reaper may free them
+.entered:
+
     pop ebp
     pop edi
     pop esi
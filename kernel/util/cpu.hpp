@@ -0,0 +1,42 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// wrappers for instructions the compiler has no builtins for
+namespace cpu {
+    struct cpuid_result {
+        uint32_t eax, ebx, ecx, edx;
+    };
+
+    inline cpuid_result cpuid(uint32_t leaf) {
+        cpuid_result r;
+        asm volatile("cpuid" : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx) : "a"(leaf), "c"(0));
+        return r;
+    }
+
+    // time stamp counter - not serializing, so it may be read a bit earlier or later than it appears
+    inline uint64_t rdtsc() {
+        uint32_t low, high;
+        asm volatile("rdtsc" : "=a"(low), "=d"(high));
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
+
+    inline uint64_t rdmsr(uint32_t msr) {
+        uint32_t low, high;
+        asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
+
+    inline void wrmsr(uint32_t msr, uint64_t value) {
+        asm volatile("wrmsr" :: "c"(msr), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32)) : "memory");
+    }
+
+    // CPUID leaf 1 feature bits
+    constexpr uint32_t FEATURE_ECX_TSC_DEADLINE = 1 << 24;
+    constexpr uint32_t FEATURE_EDX_FPU = 1 << 0;
+    constexpr uint32_t FEATURE_EDX_TSC = 1 << 4;
+    constexpr uint32_t FEATURE_EDX_MSR = 1 << 5;
+    constexpr uint32_t FEATURE_EDX_SEP = 1 << 11;
+    constexpr uint32_t FEATURE_EDX_FXSR = 1 << 24;
+    constexpr uint32_t FEATURE_EDX_SSE = 1 << 25;
+    constexpr uint32_t FEATURE_EDX_SSE2 = 1 << 26;
+}
@@ -8,32 +8,52 @@ size_t strlen(const char *s) {
     return len;
 }
 
-void *memcpy(void *__restrict dstptr, const void *__restrict srcptr, size_t size) {
-    unsigned char *dst = (unsigned char *)dstptr;
-    const unsigned char *src = (const unsigned char *)srcptr;
-    for (size_t i = 0; i < size; i++)
-        dst[i] = src[i];
+// the string instructions copy a dword at a time once the destination is aligned, and the few bytes around that
+// one at a time - inline assembly, so the compiler can't turn any of this back into calls to itself
+static inline void copy_forward(void *dst, const void *src, size_t size) {
+    if (size >= 16) {
+        size_t head = -reinterpret_cast<uintptr_t>(dst) & 3;
+        size_t words = (size - head) / 4;
+        size = (size - head) & 3;
+        asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(head) :: "memory");
+        asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+    }
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(size) :: "memory");
+}
 
+void *memcpy(void *__restrict dstptr, const void *__restrict srcptr, size_t size) {
+    copy_forward(dstptr, srcptr, size);
     return dstptr;
 }
- 
+
 void *memmove(void *dstptr, const void *srcptr, size_t size) {
-    unsigned char *dst = (unsigned char *)dstptr;
-    const unsigned char *src = (const unsigned char *)srcptr;
-    if (dst < src) {
-        for (size_t i = 0; i < size; i++)
-            dst[i] = src[i];
-    } else {
-        for (size_t i = size; i != 0; i--)
-            dst[i-1] = src[i-1];
+    uintptr_t dst = reinterpret_cast<uintptr_t>(dstptr), src = reinterpret_cast<uintptr_t>(srcptr);
+    if (dst - src >= size) {
+        // no overlap, or the destination is before the source - a forward copy reads every byte before overwriting it
+        copy_forward(dstptr, srcptr, size);
+        return dstptr;
     }
+    // backwards from the end, with the direction flag set
+    size_t words = size / 4, bytes = size & 3;
+    void *d = reinterpret_cast<void *>(dst + size - 4), *s = reinterpret_cast<void *>(src + size - 4);
+    asm volatile("std; rep movsl" : "+D"(d), "+S"(s), "+c"(words) :: "memory");
+    d = static_cast<char *>(d) + 3;
+    s = static_cast<char *>(s) + 3;
+    asm volatile("rep movsb; cld" : "+D"(d), "+S"(s), "+c"(bytes) :: "memory");
     return dstptr;
 }
 
 int memcmp(const void *aptr, const void *bptr, size_t size) {
+    using unaligned_u32 = uint32_t __attribute__((may_alias, aligned(1)));
     const unsigned char *a = (const unsigned char *)aptr;
     const unsigned char *b = (const unsigned char *)bptr;
-    for (size_t i = 0; i < size; i++) {
+    size_t i = 0;
+    // skip the equal words, the first differing byte is in the last one
+    for (; i + 4 <= size; i += 4) {
+        if (*reinterpret_cast<const unaligned_u32 *>(a + i) != *reinterpret_cast<const unaligned_u32 *>(b + i))
+            break;
+    }
+    for (; i < size; i++) {
         if (a[i] < b[i])
             return -1;
         else if (b[i] < a[i])
@@ -44,12 +64,29 @@ int memcmp(const void *aptr, const void *bptr, size_t size) {
 }
 
 void *memset(void *bufptr, int value, size_t size) {
-    unsigned char *buf = (unsigned char *)bufptr;
-    for (size_t i = 0; i < size; i++)
-        buf[i] = (unsigned char)value;
+    void *dst = bufptr;
+    uint32_t pattern = static_cast<unsigned char>(value) * 0x01010101u;
+    if (size >= 16) {
+        size_t head = -reinterpret_cast<uintptr_t>(dst) & 3;
+        size_t words = (size - head) / 4;
+        size = (size - head) & 3;
+        asm volatile("rep stosb" : "+D"(dst), "+c"(head) : "a"(pattern) : "memory");
+        asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(pattern) : "memory");
+    }
+    asm volatile("rep stosb" : "+D"(dst), "+c"(size) : "a"(pattern) : "memory");
     return bufptr;
 }
 
+void copy_page(void *__restrict dst, const void *__restrict src) {
+    size_t words = 1024;
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+}
+
+void clear_page(void *dst) {
+    size_t words = 1024;
+    asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(0) : "memory");
+}
+
 char *strcpy(char *dest, const char *src) {
     char *tmp_dest = dest;
 
@@ -0,0 +1,16 @@
+#include <kernel/util.hpp>
+
+// C++ runtime support needed by the compiler
+
+extern "C" {
+    void *__dso_handle = nullptr;
+
+    // static objects are never destroyed - the kernel does not exit
+    int __cxa_atexit(void (*)(void *), void *, void *) {
+        return 0;
+    }
+
+    void __cxa_pure_virtual() {
+        kpanic("pure virtual function called");
+    }
+}
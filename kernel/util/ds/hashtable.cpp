@@ -2,3 +2,4 @@
 
 // define global allocator
 memory::slab_allocator<ds::__ht_link> ds::__hashtable_link_alloc;
+spinlock ds::__hashtable_lock;
@@ -11,6 +11,8 @@ namespace ds {
         inline __ht_link() : key(0), obj(nullptr) {}
     };
     extern memory::slab_allocator<__ht_link> __hashtable_link_alloc;
+    // guards all hash tables and the link allocator - a lock per table wouldn't fit a table in a page
+    extern spinlock __hashtable_lock;
     static_assert(sizeof(__ht_link) == 16, "hashtable link size");
 
     template <size_t N>
@@ -37,7 +39,7 @@ namespace ds {
         inline hashtable() {}
 
         void insert(uint32_t key, void *value) {
-            scoped_preemptlock preempt_lock;
+            scoped_spinlock lock {__hashtable_lock};
             kassert(value != nullptr);
             uint32_t h = hash(key);
 
@@ -45,11 +47,7 @@ namespace ds {
                 m_arr[h].key = key;
                 m_arr[h].obj = value;
             } else {
-                __ht_link *link;
-                {
-                    scoped_intlock lock;
-                    link = __hashtable_link_alloc.allocate();
-                }
+                __ht_link *link = __hashtable_link_alloc.allocate();
                 link->key = key;
                 link->obj = value;
                 m_arr[h].add_after_self(link);
@@ -57,7 +55,7 @@ namespace ds {
         }
 
         bool remove(uint32_t key) {
-            scoped_preemptlock preempt_lock;
+            scoped_spinlock lock {__hashtable_lock};
             uint32_t h = hash(key);
 
             __ht_link *link = lookup_internal(key, h);
@@ -72,24 +70,18 @@ namespace ds {
                     link->key = next->key;
                     link->obj = next->obj;
                     next->unlink();
-                    {
-                        scoped_intlock lock;
-                        __hashtable_link_alloc.free(next);
-                    }
+                    __hashtable_link_alloc.free(next);
                 }
             } else {
                 link->unlink();
-                {
-                    scoped_intlock lock;
-                    __hashtable_link_alloc.free(link);
-                }
+                __hashtable_link_alloc.free(link);
             }
 
             return true;
         }
 
         void *lookup(uint32_t key) {
-            scoped_preemptlock preempt_lock;
+            scoped_spinlock lock {__hashtable_lock};
             __ht_link *link = lookup_internal(key, hash(key));
             if (link == nullptr) return nullptr;
             return link->obj;
@@ -28,6 +28,7 @@ namespace ds {
 
         inline void reset();
         inline intrusive_rb_node<T> *get_root_for_tests() { return m_root; }
+        inline bool empty() const { return m_root == nullptr; }
     public:
         inline constexpr rbtree() : m_root {nullptr} {}
         // no copy or move
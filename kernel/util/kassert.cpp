@@ -6,6 +6,9 @@
 void __kassert_fail_internal(const char *assertion, const char *file, uint line, const char *function) {
     using namespace formatting;
     asm volatile("cli");
+    tty::panic();
+    // what was logged before goes first
+    klog::flush_panic();
     tty_driver::write(color_pair { color::red, color::white }, "\nASSERTION FAILED: ", color_pair { color::black, color::white }, assertion);
     __kpanic_internal_after(file, line, function);
 }
@@ -13,6 +16,8 @@ void __kassert_fail_internal(const char *assertion, const char *file, uint line,
 void __kpanic_internal_before(void) {
     using namespace formatting;
     asm volatile("cli");
+    tty::panic();
+    klog::flush_panic();
     tty_driver::write(color_pair { color::red, color::white }, "\nKERNEL PANIC: ", color_pair { color::black, color::white });
 }
 
@@ -40,5 +45,7 @@ void __kpanic_internal_after(const char *file, uint line, const char *function)
         frame = next;
     }
 
+    // nothing drains the transmit ring anymore
+    serial::flush();
     while (1) asm("hlt");
 }
@@ -2,23 +2,30 @@
 #include <kernel/util.hpp>
 #include <kernel/scheduler/init.hpp>
 #include <kernel/scheduler/mutex.hpp>
+#include <kernel/util/spinlock.hpp>
 
 // Scoped Interrupt Lock - saves interrupt flag and restores it
+// the time interrupts were disabled is counted for the site which took the lock, see interrupts/stats.hpp
 struct scoped_intlock {
 public:
-    inline scoped_intlock() {
+    inline scoped_intlock(const char *file = __builtin_FILE(), uint32_t line = __builtin_LINE()) : m_file{file}, m_line{line} {
         asm volatile("pushf ; pop %0" : "=rm" (m_flags) : /* no input */ : "memory");
         asm volatile("cli" ::: "memory");
+        if (m_flags & (1 << 9))
+            m_start = cpu::rdtsc();
     }
     inline ~scoped_intlock() {
         if (m_flags & (1 << 9)) {
             // Interrupt Flag was set
+            interrupts::note_irqs_off(m_file, m_line, cpu::rdtsc() - m_start);
             asm volatile("sti");
         }
     }
 
     // move semantics
-    inline scoped_intlock(scoped_intlock&& other) noexcept : m_flags(other.m_flags) {
+    inline scoped_intlock(scoped_intlock&& other) noexcept
+        : m_flags(other.m_flags), m_file(other.m_file), m_line(other.m_line), m_start(other.m_start)
+    {
         other.m_flags = 0;  // shouldn't set interrupts back
     }
 
@@ -27,6 +34,9 @@ public:
     inline scoped_intlock &operator=(const scoped_intlock &other) = delete;
 private:
     reg_t m_flags;
+    const char *m_file;
+    uint32_t m_line;
+    uint64_t m_start = 0;
 };
 
 // Scoped Preemption Lock - disables preemption within scope, may be nested
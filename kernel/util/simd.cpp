@@ -0,0 +1,50 @@
+#include <kernel/util/simd.hpp>
+#include <kernel/util/string.hpp>
+#include <kernel/scheduler/fpu.hpp>
+#include <kernel/scheduler/init.hpp>
+
+extern "C" {
+    void asm_sse2_copy(void *dst, const void *src, size_t blocks);
+    void asm_sse2_fill(void *dst, uint32_t pattern, size_t blocks);
+}
+
+bool simd::usable() {
+    return scheduler::fpu::has_sse2() && scheduler::get_current_task() != nullptr && !interrupts::is_interrupt_context();
+}
+
+void *simd::memcpy(void *__restrict dst, const void *__restrict src, size_t size) {
+    if (size < SIMD_MIN_SIZE || !usable())
+        return ::memcpy(dst, src, size);
+
+    // align the destination, then whole blocks, then the rest
+    char *d = static_cast<char *>(dst);
+    const char *s = static_cast<const char *>(src);
+    size_t head = -reinterpret_cast<uintptr_t>(d) & 15;
+    ::memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+    size_t blocks = size / 64;
+    scheduler::fpu::kernel_begin();
+    asm_sse2_copy(d, s, blocks);
+    scheduler::fpu::kernel_end();
+    ::memcpy(d + blocks * 64, s + blocks * 64, size & 63);
+    return dst;
+}
+
+void *simd::memset(void *dst, int value, size_t size) {
+    if (size < SIMD_MIN_SIZE || !usable())
+        return ::memset(dst, value, size);
+
+    char *d = static_cast<char *>(dst);
+    size_t head = -reinterpret_cast<uintptr_t>(d) & 15;
+    ::memset(d, value, head);
+    d += head;
+    size -= head;
+    size_t blocks = size / 64;
+    scheduler::fpu::kernel_begin();
+    asm_sse2_fill(d, static_cast<unsigned char>(value) * 0x01010101u, blocks);
+    scheduler::fpu::kernel_end();
+    ::memset(d + blocks * 64, value, size & 63);
+    return dst;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <kernel/util.hpp>
+
+// SSE2 versions of memcpy and memset for large buffers, 64 bytes per iteration. They borrow the FPU with
+// fpu::kernel_begin, which costs an FXSAVE if the current task has its FPU state loaded, so they only take
+// the SSE2 path from SIMD_MIN_SIZE on. In interrupt context or without SSE2 they
+// fall back to the string instruction versions. Do NOT call them between kernel_begin and kernel_end
+namespace simd {
+    constexpr size_t SIMD_MIN_SIZE = 1024;
+
+    // can the SSE2 path be taken right now?
+    bool usable();
+    void *memcpy(void *__restrict dst, const void *__restrict src, size_t size);
+    void *memset(void *dst, int value, size_t size);
+}
@@ -0,0 +1,53 @@
+; SSE2 loops for util/simd.cpp - only call them between fpu::kernel_begin and fpu::kernel_end
+
+; asm_sse2_copy - copy 64 byte blocks, with the destination 16 byte aligned
+; stack: [esp + 12] number of blocks
+;        [esp + 8]  source
+;        [esp + 4]  destination
+;        [esp    ]  return address
+global asm_sse2_copy
+asm_sse2_copy:
+    mov edx, [esp + 4]
+    mov eax, [esp + 8]
+    mov ecx, [esp + 12]
+    test ecx, ecx
+    jz .done
+.loop:
+    movdqu xmm0, [eax]
+    movdqu xmm1, [eax + 16]
+    movdqu xmm2, [eax + 32]
+    movdqu xmm3, [eax + 48]
+    movdqa [edx], xmm0
+    movdqa [edx + 16], xmm1
+    movdqa [edx + 32], xmm2
+    movdqa [edx + 48], xmm3
+    add eax, 64
+    add edx, 64
+    dec ecx
+    jnz .loop
+.done:
+    ret
+
+; asm_sse2_fill - fill 64 byte blocks with a byte, with the destination 16 byte aligned
+; stack: [esp + 12] number of blocks
+;        [esp + 8]  the byte, repeated in all 4 bytes
+;        [esp + 4]  destination
+;        [esp    ]  return address
+global asm_sse2_fill
+asm_sse2_fill:
+    mov edx, [esp + 4]
+    movd xmm0, [esp + 8]
+    pshufd xmm0, xmm0, 0
+    mov ecx, [esp + 12]
+    test ecx, ecx
+    jz .done
+.loop:
+    movdqa [edx], xmm0
+    movdqa [edx + 16], xmm0
+    movdqa [edx + 32], xmm0
+    movdqa [edx + 48], xmm0
+    add edx, 64
+    dec ecx
+    jnz .loop
+.done:
+    ret
@@ -0,0 +1,80 @@
+#pragma once
+#include <kernel/util.hpp>
+#include <kernel/util/cpu.hpp>
+#include <kernel/interrupts/stats.hpp>
+
+// busy waiting lock, for short critical sections shared between CPUs
+// take it with scoped_spinlock, which also disables interrupts on this CPU -
+// otherwise an interrupt handler which takes the same lock would spin forever
+struct spinlock {
+public:
+    // compatible with static initialization
+    inline constexpr spinlock() : m_locked{false} {}
+
+    inline void lock() {
+        while (__atomic_exchange_n(&m_locked, true, __ATOMIC_ACQUIRE)) {
+            // wait without hammering the cache line with writes
+            while (__atomic_load_n(&m_locked, __ATOMIC_RELAXED))
+                asm volatile("pause" ::: "memory");
+        }
+    }
+
+    inline bool try_lock() {
+        return !__atomic_exchange_n(&m_locked, true, __ATOMIC_ACQUIRE);
+    }
+
+    inline void unlock() {
+        __atomic_store_n(&m_locked, false, __ATOMIC_RELEASE);
+    }
+
+    inline bool is_locked() {
+        return __atomic_load_n(&m_locked, __ATOMIC_RELAXED);
+    }
+
+    spinlock(const spinlock &other) = delete;
+    spinlock &operator=(const spinlock &other) = delete;
+private:
+    bool m_locked;
+};
+
+// Scoped Spinlock - saves and clears the interrupt flag like scoped_intlock, then takes the spinlock
+// the time interrupts were disabled is counted for the site which took the lock, see interrupts/stats.hpp
+struct scoped_spinlock {
+public:
+    inline scoped_spinlock(spinlock &lock, const char *file = __builtin_FILE(), uint32_t line = __builtin_LINE())
+        : m_lock{&lock}, m_file{file}, m_line{line}
+    {
+        asm volatile("pushf ; pop %0" : "=rm" (m_flags) : /* no input */ : "memory");
+        asm volatile("cli" ::: "memory");
+        if (m_flags & (1 << 9))
+            m_start = cpu::rdtsc();
+        m_lock->lock();
+    }
+    inline ~scoped_spinlock() {
+        if (m_lock) {
+            m_lock->unlock();
+            if (m_flags & (1 << 9)) {
+                // Interrupt Flag was set
+                interrupts::note_irqs_off(m_file, m_line, cpu::rdtsc() - m_start);
+                asm volatile("sti" ::: "memory");
+            }
+        }
+    }
+
+    // move semantics
+    inline scoped_spinlock(scoped_spinlock&& other) noexcept
+        : m_lock(other.m_lock), m_flags(other.m_flags), m_file(other.m_file), m_line(other.m_line), m_start(other.m_start)
+    {
+        other.m_lock = nullptr;
+    }
+
+    inline scoped_spinlock &operator=(scoped_spinlock&& other) = delete;
+    scoped_spinlock(const scoped_spinlock &other) = delete;
+    inline scoped_spinlock &operator=(const scoped_spinlock &other) = delete;
+private:
+    spinlock *m_lock;
+    reg_t m_flags;
+    const char *m_file;
+    uint32_t m_line;
+    uint64_t m_start = 0;
+};
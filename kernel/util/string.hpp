@@ -8,6 +8,10 @@ void* memset(void *, int, size_t);
 char* strcpy(char *, const char *);
 size_t strlen(const char *);
 
+// a whole page, 4096 bytes - both page aligned
+void copy_page(void *__restrict dst, const void *__restrict src);
+void clear_page(void *dst);
+
 struct string_buf {
     const char *data;  // may not be null terminated
     size_t length;
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# Turns the PROF lines of interrupts::profiler::dump in a serial log into folded stacks, one per line with its
+# sample count, outermost frame first - the input of flamegraph.pl or speedscope.
+# Usage (from the repository root): python3 scripts/profile.py log.txt [--by-pid] > kernel.folded
+import sys
+from collections import Counter
+from subprocess import run
+
+ELF = "./kernel/kernel.elf"
+
+
+def symbolize(addresses):
+    # one addr2line for all addresses, it prints function and file:line for each
+    if not addresses:
+        return {}
+    out = run(["addr2line", "-e", ELF, "-f", "-C"] + [hex(a) for a in addresses],
+              capture_output=True, text=True, check=True).stdout.splitlines()
+    names = {}
+    for i, address in enumerate(addresses):
+        function = out[2 * i] if 2 * i < len(out) else "??"
+        names[address] = function if function != "??" else hex(address)
+    return names
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    by_pid = "--by-pid" in sys.argv
+    if len(args) != 1:
+        print("What logfile? (e.g. log.txt)")
+        exit(1)
+
+    samples = []
+    with open(args[0], "r", errors="replace") as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 5 or fields[0] != "PROF":
+                continue
+            # PROF cpu pid user|kernel eip return addresses...
+            pid, mode = int(fields[2]), fields[3]
+            eip = int(fields[4], 16)
+            # a return address is after its call, look up the call itself
+            frames = [int(a, 16) - 1 for a in fields[5:]]
+            samples.append((pid, mode, eip, frames))
+
+    addresses = sorted({a for _, mode, eip, frames in samples if mode == "kernel" for a in [eip] + frames})
+    names = symbolize(addresses)
+
+    folded = Counter()
+    for pid, mode, eip, frames in samples:
+        if mode == "user":
+            stack = ["[user]"]
+        else:
+            stack = [names[a] for a in reversed(frames)] + [names[eip]]
+        if by_pid:
+            stack.insert(0, f"pid {pid}")
+        folded[";".join(stack)] += 1
+
+    for stack, count in folded.most_common():
+        print(stack, count)
+    print(f"{len(samples)} samples", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,7 @@
 from subprocess import Popen
 from time import sleep
 
-qemu = Popen(["qemu-system-i386", "-m", "64M", "-display", "none",
+qemu = Popen(["qemu-system-i386", "-m", "64M", "-smp", "4", "-display", "none",
               "-chardev", f"file,id=logfile,path=test.txt",
               "-serial", "chardev:logfile", "-cdrom", "os.iso"])
 